@@ -1,10 +1,14 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // NOTE: memmem()
+#endif
 
 #include <errno.h>
 #include <sys/ioctl.h>
 #include <signal.h>
+#include <setjmp.h>
 #include <termios.h>
 #include <string.h>
 #include <stdlib.h>
@@ -15,5 +19,14 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/xattr.h>
+#include <pthread.h>
 
 #endif
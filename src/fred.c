@@ -1,5 +1,9 @@
 #include "fred.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 
 bool FRED_open_file(FileBuf* file_buf, const char* file_path)
 {
@@ -24,6 +28,18 @@ bool FRED_open_file(FileBuf* file_buf, const char* file_path)
   if (fd == -1) ERROR("failed to open file '%s'. %s.", file_path, strerror(errno));
 
   file_buf->size = sb.st_size;
+  file_buf->mapped = false;
+  if (file_buf->size >= FILE_MMAP_MIN_SIZE) {
+    // NOTE: only the pages looked at get read, so a big file 
+    // can be shown before all of it was read
+    void* map = mmap(NULL, file_buf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      close(fd);
+      file_buf->text = map;
+      file_buf->mapped = true;
+      return failed;
+    }
+  }
   file_buf->text = malloc(sizeof(*file_buf->text) * file_buf->size);
   if (file_buf->text == NULL) ERROR("not enough memory for file file-buffer.");
   file_loaded = 1;
@@ -53,812 +69,4929 @@ end:
 }
 
 
-bool FRED_save_file(FredEditor* fe, const char* file_path)
+// DESC: lets the kernel drop the whole pages of a mapped file-buffer 
+// in [from, to); they get read back from the file if looked at again, 
+// so a big file read through once (scanned, searched) doesn't stay 
+// in memory. Nothing for a file-buffer that was read.
+void file_buf_drop(FileBuf* file_buf, size_t from, size_t to)
 {
-  bool failed = 0;
-  size_t file_size = 0;
-  PieceTable* table = &fe->piece_table;
-
-  for (size_t i = 0; i < table->len; i++){
-    file_size += table->items[i].len;
-  }
+  if (!file_buf->mapped) return;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t lo = (from + page - 1) / page * page, hi = to / page * page;
+  if (hi > lo) madvise(file_buf->text + lo, hi - lo, MADV_DONTNEED);
+}
 
-  FILE* f = fopen(file_path, "wb");
-  if (f == NULL){
-    ERROR("failed to open '%s' while trying to save it. %s.", file_path, strerror(errno));
-  }
 
-  if (file_size > 0){
-    for (size_t i = 0; i < table->len; i++){
-      Piece p = table->items[i];
-      // TODO: maybe we can just use the buf macro 
-      char* buf = !p.which_buf ? fe->file_buf.text : fe->add_buf.items;
-      fwrite(buf + p.offset, sizeof(*buf), p.len, f);
-    }
+// DESC: makes the file-buffer 'size' bytes long, the file read 
+// through 'fd' having grown to it: a mapping is extended, a small 
+// read buffer gets only the new bytes read in, and one getting 
+// past FILE_MMAP_MIN_SIZE becomes a mapping
+bool file_buf_grow(FileBuf* file_buf, int fd, size_t size)
+{
+  bool failed = 0;
+  if (size <= file_buf->size) return failed;
+  if (file_buf->mapped) {
+    void* map = mremap(file_buf->text, file_buf->size, size, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED) ERROR("failed to map the grown file. %s.", strerror(errno));
+    file_buf->text = map;
+  } else if (size >= FILE_MMAP_MIN_SIZE) {
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) ERROR("failed to map the grown file. %s.", strerror(errno));
+    free(file_buf->text);
+    file_buf->text = map;
+    file_buf->mapped = true;
   } else {
-    int fd = fileno(f);
-    if (-1 == ftruncate(fd, 0)) {
-      ERROR("failed to truncate file while trying to save emptied out file. %s.", strerror(errno));
+    char* text = realloc(file_buf->text, size);
+    if (text == NULL) ERROR("not enough memory for the grown file.");
+    file_buf->text = text;
+    size_t got = file_buf->size;
+    while (got < size) {
+      ssize_t n = pread(fd, text + got, size - got, got);
+      if (n == -1 && errno == EINTR) continue;
+      if (n == -1) ERROR("failed to read the grown file. %s.", strerror(errno));
+      if (n == 0) break; // NOTE: cut again in the meantime
+      got += n;
     }
+    size = got;
   }
-
-  fclose(f);
-end: 
+  file_buf->size = size;
+end:
   return failed;
 }
 
 
+__thread sigjmp_buf* file_buf_guard = NULL;
+__thread const char* file_buf_fault = NULL;
 
+// DESC: SIGBUS handler: a mapped file-buffer read past the end of a 
+// file someone else cut jumps back to the guard of the thread that 
+// read it, with 'file_buf_fault' where; no byte of the missing pages 
+// is ever made up. Without a guard, or for a fault that isn't a read 
+// past the end of a file, the read faults again and kills the editor 
+// as usual.
+void file_buf_sigbus(int sig, siginfo_t* si, void* ctx)
+{
+  (void)ctx;
+  if (si->si_code != BUS_ADRERR || file_buf_guard == NULL) {
+    signal(sig, SIG_DFL);
+    return;
+  }
+  file_buf_fault = si->si_addr;
+  siglongjmp(*file_buf_guard, 1);
+}
 
 
-
-bool fred_editor_init(FredEditor* fe, const char* file_path)
+void FRED_close_file(FileBuf* file_buf)
 {
-  bool failed = 0;
-  bool file_loaded = 0;
-
-  DA_INIT(&fe->piece_table);
-  DA_INIT(&fe->add_buf);
-  DA_INIT(&fe->lines_len);
+  if (file_buf->mapped) munmap(file_buf->text, file_buf->size);
+  else free(file_buf->text);
+  file_buf->text = NULL;
+}
 
-  failed = FRED_open_file(&fe->file_buf, file_path);
-  if (failed) GOTO_END(1);
-  file_loaded = 1;
 
-  if (fe->file_buf.size > 0){
-    PIECE_TABLE_PUSH(&fe->piece_table, ((Piece){
-      .which_buf = 0,
-      .offset = 0,
-      .len = fe->file_buf.size,
-    }));
+// DESC: gives the new file 'fd' the owner, group, mode and extended 
+// attributes (ACLs, security labels) of the file 'sb' at 'path'; fails 
+// if any of them can't be kept, the save then writes in place instead
+bool save_copy_attrs(int fd, const char* path, struct stat* sb)
+{
+  bool failed = 0;
+  int src = -1;
+  char* names = NULL;
+  char* value = NULL;
+  // NOTE: the mode after the owner, a chown() drops the set-id bits
+  if (fchown(fd, sb->st_uid, sb->st_gid) == -1) GOTO_END(1);
+  if (fchmod(fd, sb->st_mode & 07777) == -1) GOTO_END(1);
+
+  src = open(path, O_RDONLY | O_CLOEXEC);
+  if (src == -1) GOTO_END(1);
+  ssize_t names_len = flistxattr(src, NULL, 0);
+  if (names_len == -1) GOTO_END(errno != ENOTSUP);
+  if (names_len == 0) GOTO_END(0);
+  names = malloc(names_len);
+  if (names == NULL) GOTO_END(1);
+  names_len = flistxattr(src, names, names_len);
+  if (names_len == -1) GOTO_END(1); // NOTE: more of them in the meantime
+  for (char* name = names; name < names + names_len; name += strlen(name) + 1) {
+    ssize_t value_len = fgetxattr(src, name, NULL, 0);
+    if (value_len == -1) GOTO_END(1);
+    char* grown = realloc(value, value_len ? value_len : 1);
+    if (grown == NULL) GOTO_END(1);
+    value = grown;
+    value_len = fgetxattr(src, name, value, value_len);
+    if (value_len == -1 || fsetxattr(fd, name, value, value_len, 0) == -1) GOTO_END(1);
   }
-
-  fe->cursor = (Cursor){0};
-  fe->last_edit = (LastEdit){0};
-
-  GOTO_END(failed);
 end:
-  if (failed){
-    if (file_loaded) free(fe->file_buf.text);
-  }
+  if (src != -1) close(src);
+  free(names);
+  free(value);
   return failed;
 }
 
-void fred_editor_free(FredEditor* fe)
-{
-  DA_FREE(&fe->piece_table, 1);
-  DA_FREE(&fe->add_buf, 1);
-  DA_FREE(&fe->lines_len, 1);
-  free(fe->file_buf.text);
-}
-
 
-bool FRED_win_resize(TermWin* tw)
+// DESC: copies the new file 'fd' ('size' bytes) over the file at 'path' 
+// in place, keeping its inode: for a file a rename would break, one 
+// with other hard links or whose owner or attributes the new file 
+// can't get. The copy comes from the new file, never from the text, 
+// whose file-buffer may be the very file being written.
+bool save_in_place(int fd, const char* path, size_t size)
 {
-  bool failed = false;
-  struct winsize w;
-  if (-1 == ioctl(STDIN_FILENO, TIOCGWINSZ, &w)){
-    ERROR("failed to retrieve terminal size. %s.", strerror(errno));
+  bool failed = 0;
+  int dst = -1;
+  char* buf = malloc(SAVE_COPY_LEN);
+  if (buf == NULL) ERROR("not enough memory to save '%s'.", path);
+  dst = open(path, O_WRONLY | O_CLOEXEC);
+  if (dst == -1) ERROR("failed to open '%s' while trying to save it. %s.", path, strerror(errno));
+  for (size_t done = 0; done < size; ) {
+    ssize_t n = pread(fd, buf, SAVE_COPY_LEN, done);
+    if (n == -1 && errno == EINTR) continue;
+    if (n <= 0) ERROR("failed to read the new text of '%s' back. %s.", path, n ? strerror(errno) : "it got cut");
+    for (ssize_t at = 0; at < n; ) {
+      ssize_t w = pwrite(dst, buf + at, n - at, done + at);
+      if (w == -1 && errno == EINTR) continue;
+      if (w == -1) ERROR("failed to write '%s' while trying to save it. %s.", path, strerror(errno));
+      at += w;
+    }
+    done += n;
+  }
+  if (ftruncate(dst, size) == -1 || fsync(dst) == -1) {
+    ERROR("failed to write '%s' while trying to save it. %s.", path, strerror(errno));
   }
-  
-  tw->size = w.ws_row * w.ws_col;
-  tw->height = w.ws_row;
-  tw->width = w.ws_col;
-  void* temp = realloc(tw->elems, tw->size);
-  if (temp == NULL) ERROR("not enough memory to get and display text.");
-  tw->elems = temp;
-  GOTO_END(failed);
 end:
+  if (dst != -1) close(dst);
+  free(buf);
   return failed;
 }
 
 
-// TODO+NOTE: EOL at end of file (like the ones saved 
-// with neovim) will get considered as proper line 
-// NOTE: last 2 bytes in line-item are reserved 
-// for the keywords-per-line count, used for 
-// rendering highlighting
-bool FRED_get_lines_len(FredEditor* fe)
+// DESC: writes the text to a new file next to the file 'file_path' 
+// points to (through any symlinks), gives it the old file's owner, 
+// mode and attributes, syncs it and renames it over the old one, so 
+// a mapped file-buffer doesn't get cut under it. A file the rename 
+// would break (hard links, an owner or attributes that can't be kept) 
+// gets the new file copied into it in place instead. What another 
+// writer changed in the file since it was read gets merged in first, 
+// not overwritten; a text in conflict with the file (see FileReload) 
+// isn't saved over it. The saved file becomes the file of the text.
+bool FRED_save_file(FredEditor* fe, const char* file_path)
 {
-#define is_last_char(t, p, i, j) ((i) == (t)->len - 1 && (j) == (p).len - 1)
-#define buf(p, offset)((!(p).which_buf ? fe->file_buf.text: fe->add_buf.items)[(offset)])
-
   bool failed = 0;
+  bool saved = 0;
+  char* real_path = NULL;
+  char* tmp_path = NULL;
+  int fd = -1;
+  FileBuf fb = {0};
   PieceTable* table = &fe->piece_table;
-  LinesLen* ll = &fe->lines_len;
-  
-  ll->len = 0;
-  size_t line_start = 0;
-  size_t tot_text_len = 0;
-  DA_PUSH(ll, 0, 8, LinesLen);
+  if (FRED_index_until(fe, SIZE_MAX)) GOTO_END(1);
+  if (FRED_reload_check(fe, file_path)) GOTO_END(1);
+  if (fe->reload.conflict) {
+    ERROR("'%s' got written over in place under the edits, not saving the text over it.", file_path);
+  }
 
-  for (size_t i = 0; i < table->len; i++) {
-    Piece p = table->items[i];
-    for (size_t j = 0; j < p.len; j++) {
-      char c = buf(p, p.offset + j);
-      if (c == '\n' || is_last_char(table, p, i, j)) {
-        size_t line_end = tot_text_len + j + (c != '\n');
-        size_t line_len = line_end - line_start;
-        // TODO: what if file is some big ass data not separated by newlines?
-        assert(line_len <= UINT16_MAX, "line-length overflow (max line-length is UINT16_MAX, 65535), "
-                                       "length cannot be stored for later usage");
-        ll->items[ll->len - 1] = (uint16_t)line_len;
-        line_start = line_end + 1;
-        if (c == '\n') DA_PUSH(ll, 0, 8, LinesLen);
-      }
+  real_path = realpath(file_path, NULL);
+  if (real_path == NULL && errno == ENOENT) real_path = strdup(file_path); // NOTE: a new file
+  if (real_path == NULL) ERROR("failed to find the file '%s' to save. %s.", file_path, strerror(errno));
+  struct stat target;
+  bool exists = stat(real_path, &target) == 0;
+
+  tmp_path = sidecar_path(real_path, ".fred-save");
+  if (tmp_path == NULL) ERROR("not enough memory for the path to save '%s'.", file_path);
+  fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1) ERROR("failed to open '%s' while trying to save it. %s.", tmp_path, strerror(errno));
+  // NOTE: write() straight from the pieces, not through a copy: bytes of 
+  // a mapped file cut in the meantime fail it with EFAULT, the kernel 
+  // doesn't fault, and the old file stays
+  size_t size = 0;
+  PieceIter it = piece_iter_at(fe, 0);
+  PieceSpan span;
+  while ((span = piece_iter_span(&it)).len) {
+    ssize_t n = write(fd, span.text, span.len);
+    if (n == -1 && errno == EINTR) continue;
+    if (n == -1 && errno == EFAULT) ERROR("failed to save '%s', the file got cut under the text.", file_path);
+    if (n == -1) ERROR("failed to write '%s' while trying to save it. %s.", tmp_path, strerror(errno));
+    piece_iter_skip(&it, n);
+    size += n;
+  }
+  bool in_place = exists && (target.st_nlink > 1 || save_copy_attrs(fd, real_path, &target));
+  // NOTE: on the disk before the rename or the copy, or a crash right 
+  // after either could leave an empty (or half written) file
+  if (fsync(fd) == -1) ERROR("failed to write '%s' while trying to save it. %s.", tmp_path, strerror(errno));
+  if (in_place) {
+    // NOTE: the register may hold bytes of the file being written
+    if (register_detach(fe)) GOTO_END(1);
+    if (save_in_place(fd, real_path, size)) {
+      saved = 1; // NOTE: the old file is half written, the new text stays next to it
+      ERROR("'%s' is only partly saved, the whole text is in '%s'.", file_path, tmp_path);
     }
-    tot_text_len += p.len;
+  } else if (rename(tmp_path, real_path) == -1) {
+    ERROR("failed to save '%s'. %s.", file_path, strerror(errno));
   }
-end:
+  saved = 1;
+  if (in_place) unlink(tmp_path);
+
+  // NOTE: the text is the file now, one piece of it; the lines stay
+  struct stat sb;
+  if (stat(file_path, &sb) == -1) ERROR("failed to retrieve any info about file '%s'. %s.", file_path, strerror(errno));
+  if (FRED_open_file(&fb, file_path)) GOTO_END(1);
+  bool is_ascii = true;
+  for (size_t i = 0; i < table->len; i++) is_ascii &= table->items[i].is_ascii;
+  if (register_detach(fe)) GOTO_END(1);
+  FRED_close_file(&fe->file_buf);
+  fe->file_buf = fb;
+  table->len = 0;
+  fe->add_buf.len = 0;
+  if (fb.size > 0) PIECE_TABLE_PUSH(table, ((Piece){ .which_buf = 0, .is_ascii = is_ascii, .offset = 0, .len = fb.size }));
+  fe->last_edit.locus_valid = false;
+  fe->index.frontier = fb.size;
+  fe->reload.file_stat = sb;
+  if (journal_restart(fe, file_path, &sb)) GOTO_END(1);
+end: 
+  if (fd != -1) close(fd);
+  if (tmp_path != NULL && !saved) unlink(tmp_path);
+  free(tmp_path);
+  free(real_path);
   return failed;
-#undef is_last_char
-#undef buf
 }
 
 
 
-// NOTE+TODO: get_lines_len() and build_table_text_for_render()
-// parse the table twice back to back, so it would 
-// be reasonable to have just one big function.
-// However, this mixes up the editor's logic with 
-// rendering logic, which doesn't play nice with 
-// 'test.c' since it should only test the piece-table 
-// (and later on the more of editor logic) and shouldn't 
-// need any rendering info (TermWin array, win size etc.) at all.
-// I tried using one big function and disabling 
-// the rendering logic with the preprocessor,
-// but i couldn't make it work and everything got messy.
-// I would like to fix this in the future, but 
-// for now we will keep it like this.
 
 
 
-// DESC: stores table-text in dyn-array, where
-// each keyword's start is flagged with a negative keywordID.
-// Also stores the keywords-per-line count in the last 
-// 2 bytes of each LinesLen item. 
-// All this is solely for easier rendering, 
-// never used in editing logic.
-bool build_table_text_for_render(FredEditor* fe, TermWin* tw)
+double monotonic_ms()
 {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
 
-#define highlight(keyword, keyword_len, keyword_id) do { \
-  DA_MAYBE_GROW(tt, 1, TABLE_TEXT_INIT_CAP, TableText); \
-  tt->items[tt->len - (keyword_len)] = (int8_t)(keyword_id) * -1; \
-  memcpy(tt->items + tt->len - (keyword_len) + 1, (keyword), (keyword_len) * sizeof(*tt->items)); \
-  tt->len += 1; \
-  keywords_per_line++; \
-} while (0)
-#define match(match)(0 == memcmp(word, (match), word_len))
-#define is_last_char(t, p, i, j) ((i) == (t)->len - 1 && (j) == (p).len - 1)
-#define buf(p, offset) ((!(p).which_buf ? fe->file_buf.text: fe->add_buf.items)[(offset)])
-#define MAX_WORD_LEN 32
-
-  bool failed = 0;
-  PieceTable* table = &fe->piece_table;
-  LinesLen* ll = &fe->lines_len;
-  size_t curr_line = 0;
 
-  TableText* tt = &tw->table_text;
-  tt->len = 0;  
+#define JOURNAL_HEADER_LEN (sizeof(JOURNAL_MAGIC) - 1 + 4 * sizeof(uint64_t))
+#define JOURNAL_PIECE_LEN (1 + 2 * sizeof(uint64_t))
 
-  char word[MAX_WORD_LEN] = {0};
-  size_t word_len = 0;
-  size_t word_offset = 0;
-  size_t keywords_per_line = 0;
-  bool is_comment = false;
+// NOTE: the files fred keeps for 'dir/name' are 'dir/.name<suffix>', 
+// like 'dir/.name.fred-journal'
+char* sidecar_path(const char* file_path, const char* suffix)
+{
+  const char* slash = strrchr(file_path, '/');
+  size_t dir_len = slash ? (size_t)(slash - file_path) + 1 : 0;
+  size_t path_len = strlen(file_path) + 1 + strlen(suffix) + 1;
+  char* path = malloc(path_len);
+  if (path == NULL) return NULL;
+  snprintf(path, path_len, "%.*s.%s%s", (int)dir_len, file_path, file_path + dir_len, suffix);
+  return path;
+}
 
-  for (size_t i = 0; i < table->len; i++) {
-    Piece p = table->items[i];
-    for (size_t j = 0; j < p.len; j++) {
-      char c = buf(p, p.offset + j);
-
-      if (c == '\n' || is_last_char(table, p, i, j)) {
-        assert(curr_line < ll->len, "tried to write past limit, when saving keywords count per line");
-        ll->items[curr_line++] |= (keywords_per_line << (16*1));
-        keywords_per_line = 0;
-      }
-
-      if (word[0] == '/' && word[1] == '/') {
-        highlight("//", word_len, KW_COMMENT);
-        is_comment = true;
-        word_len = 0;
-        memset(word, 0, MAX_WORD_LEN);
-      }
-
-      if (!is_comment) {
-        if (word_len >= MAX_WORD_LEN) {
-          memset(word, 0, MAX_WORD_LEN);
-          word_len = 0;
-
-        } else if ((c < 'a' || c > 'z') && c != '#' && c != '/') {
-          switch (word_len) {
-            case 2: {
-              if (word[0] == 'i' && word[1] == 'f') 
-                highlight("if", word_len, KW_IF);
-              break;
-            }
-            case 3: {
-              if (word[0] == 'f' && match("for")) 
-                highlight("for", word_len, KW_FOR);
-              else if (word[0] == '#' && match("#if")) 
-                highlight("#if", word_len, KW_IF_PREPROC);
-              break;
-            }
-            case 4: {
-              if (word[0] == 'e' && match("else")) 
-                highlight("else", word_len, KW_ELSE);
-              break;
-            }
-            case 5: {
-              if (word[0] == 'w' && match("while")) 
-                highlight("while", word_len, KW_WHILE);
-              else if (word[0] == '#' && match("#else")) 
-                highlight("#else", word_len, KW_ELSE_PREPROC);
-              break;
-            }
-            case 6: {
-              if (word[0] == 'r' && match("return")) 
-                highlight("return", word_len, KW_RETURN);
-              else if (word[0] == '#' && match("#ifdef")) 
-                highlight("#ifdef", word_len, KW_IFDEF);
-              else if (match("#endif")) 
-                highlight("#endif", word_len, KW_ENDIF);
-              break;
-            }
-            case 7: {
-              if (word[1] == 'd' && match("#define")) 
-                highlight("#define", word_len, KW_DEFINE);
-              else if (word[1] == 'i' && match( "#ifndef")) 
-                highlight("#ifndef", word_len, KW_IFNDEF);
-              break;
-            }
-            case 8: {
-              if (word[0] == 'c' && match("continue")) 
-                highlight("continue", word_len, KW_CONTINUE);
-              else if (word[0] == '#' && match( "#include")) 
-                highlight("#include", word_len, KW_INCLUDE);
-            }
-          }
-          memset(word, 0, MAX_WORD_LEN);
-          word_len = 0;
-        } else {
-          word[word_len++] = c;
-        }
-      }
 
-      if (c == '\n') is_comment = false;
+char* journal_put_u64(char* out, uint64_t n)
+{
+  memcpy(out, &n, sizeof(n));
+  return out + sizeof(n);
+}
 
-      
-      DA_PUSH(tt, c, TABLE_TEXT_INIT_CAP, TableText);
-    }
-    word_offset += p.len;
-  }
 
-end:
-  return failed;
-#undef buf
-#undef matches
-#undef MAX_WORD_LEN
+// DESC: reads a u64 at '*pos' if it fits in 'len'
+bool journal_get_u64(const char* data, size_t len, size_t* pos, uint64_t* n)
+{
+  if (len - *pos < sizeof(*n)) return false;
+  memcpy(n, data + *pos, sizeof(*n));
+  *pos += sizeof(*n);
+  return true;
 }
 
 
-
-// DESC: places the editor's text char-by-char
-// into TermWin array, saves ID and row/col in TermWin
-// of keywords into a dyn-array for highlighting. 
-// When parsing a comment also saves 
-// comment's length + any right/left-padding.
-// This way we can print the highlighted comment directly
-// from the TermWin array.
-bool FRED_get_text_to_render(FredEditor* fe, TermWin* tw, bool insert)
+// DESC: 'dst' becomes a copy of 'src', reusing its memory
+bool journal_copy_table(PieceTable* dst, const PieceTable* src)
 {
-#define buf(p, offset)((!(p).which_buf ? fe->file_buf.text: fe->add_buf.items)[(offset)])
-
   bool failed = 0;
-
-  memset(tw->elems, SPACE_CH, tw->size);
-
-  LinesLen* ll = &fe->lines_len;
-  Cursor* cr = &fe->cursor;
-  TableText* tt = &tw->table_text;
-  HighlightOffsets* ho = &tw->ho;
-  ho->len = 0;
-
-  size_t last_row_offset = tw->size - tw->width;
-  {
-    size_t curs_offset = last_row_offset + tw->width - 1;
-    size_t first_linenum_offset = tw->linenum_width - tw->linenum_width / 3;
-    char* mode = insert ? "-- INSERT --" : "-- NORMAL --";
-    memcpy(tw->elems + last_row_offset + 2, mode, strlen(mode));
-    TW_WRITE_NUM_AT(tw, curs_offset, "%-d:%-d", (int)cr->row + 1, (int)cr->col + 1); 
-    TW_WRITE_NUM_AT(tw, first_linenum_offset, "%ld", tw->lines_to_scroll + 1);
+  if (src->len > dst->cap) {
+    void* temp = realloc(dst->items, src->len * sizeof(*src->items));
+    if (temp == NULL) ERROR("not enough memory for the journal piece-table.");
+    dst->items = temp;
+    dst->cap = src->len;
   }
+  if (src->len) memcpy(dst->items, src->items, src->len * sizeof(*src->items));
+  dst->len = src->len;
+end:
+  return failed;
+}
 
-  if (ll->len == 0) return failed;
 
-  // TODO: cache it
-  size_t fl_offset = 0; // First Line to render
-  for (size_t i = 0; i < tw->lines_to_scroll; i++) {
-    size_t item = ll->items[i];
-    size_t line_len = (item & 0xffff) + ((item >> (16*1)) & 0xffff); // NOTE: line len + keywords count in line
-    fl_offset +=  line_len + 1; // NOTE: '+1' is for '\n' 
+// DESC: replays the journal in 'data' onto the editor, which has just 
+// loaded the file. Stops at the first record cut by a crash, 'valid_len' 
+// is where it starts; returns false (leaving the editor as loaded) if 
+// the journal doesn't apply.
+bool journal_replay(FredEditor* fe, const char* data, size_t len, size_t* valid_len)
+{
+  Journal* j = &fe->journal;
+  PieceTable table = {0};
+  AddBuf add_buf = {0};
+  Cursor cursor = {0};
+  bool replayed = false;
+  uint64_t file_size = 0, mtime_sec = 0, mtime_nsec = 0, unused = 0;
+
+  size_t pos = sizeof(JOURNAL_MAGIC) - 1;
+  if (len < JOURNAL_HEADER_LEN || memcmp(data, JOURNAL_MAGIC, pos)) return false;
+  journal_get_u64(data, len, &pos, &file_size);
+  journal_get_u64(data, len, &pos, &mtime_sec);
+  journal_get_u64(data, len, &pos, &mtime_nsec);
+  journal_get_u64(data, len, &pos, &unused);
+  if (file_size != j->file_size || mtime_sec != (uint64_t)j->file_mtime.tv_sec || 
+      mtime_nsec != (uint64_t)j->file_mtime.tv_nsec) {
+    return false;
   }
 
-  size_t tw_elems_idx = tw->linenum_width;
-  size_t line = tw->lines_to_scroll;
-  size_t linenum_offset = tw->linenum_width / 3; // TODO: cache it 
-  size_t tw_row = 0, tw_col = tw->linenum_width;
-  size_t comment_start = 0;
-
-  for (size_t i = fl_offset; i < tt->len; i++) {
-    if (tw_elems_idx >= last_row_offset) break;
-    char c = tt->items[i];
-
-    if (c < 0) { // NOTE: Next there's a keyword to highlight
-      size_t keyword_id = c * -1;
-      if (keyword_id == KW_COMMENT) comment_start = tw_elems_idx;
-      size_t item = tw_row | (tw_col << (16*1)) | (keyword_id << (16 * 2));
-      DA_PUSH(ho, item, 8, HighlightOffsets); // TODO: make a ho-init-cap
-      continue;
-    }
-
-    if (c != '\n'){ 
-      if (tw_col + 1 > tw->width) {
-        tw_elems_idx += tw->linenum_width;
-        tw_col = tw->linenum_width;
-        tw_row++;
+  // NOTE: a copy, so a journal that turns out broken changes nothing
+  if (journal_copy_table(&table, &fe->piece_table)) return false;
+
+  while ((*valid_len = pos) < len) {
+    char kind = data[pos++];
+    if (kind == 'A') {
+      uint64_t n = 0;
+      if (!journal_get_u64(data, len, &pos, &n) || len - pos < n) break;
+      if (add_buf.len + n > add_buf.cap) {
+        add_buf.cap = (add_buf.len + n) * 2;
+        char* temp = realloc(add_buf.items, add_buf.cap);
+        if (temp == NULL) goto broken;
+        add_buf.items = temp;
       }
-      if (comment_start && i == tt->len - 1) { // NOTE: saving comment length + any right/left-padding
-        ho->items[ho->len - 1] |= ((tw_elems_idx + 1) - comment_start) << (16 * 3);
-        comment_start = 0;
+      memcpy(add_buf.items + add_buf.len, data + pos, n);
+      add_buf.len += n;
+      pos += n;
+    } else if (kind == 'P') {
+      uint64_t front = 0, back = 0, count = 0, row = 0, col = 0;
+      if (!journal_get_u64(data, len, &pos, &front) || !journal_get_u64(data, len, &pos, &back) ||
+          !journal_get_u64(data, len, &pos, &count) || !journal_get_u64(data, len, &pos, &row) ||
+          !journal_get_u64(data, len, &pos, &col) || (len - pos) / JOURNAL_PIECE_LEN < count) {
+        break;
       }
-      tw->elems[tw_elems_idx++] = c;
-      tw_col++;
-    } else {
-      line++;
-      if (comment_start) { // NOTE: saving comment length + any right/left-padding
-        ho->items[ho->len - 1] |= (tw_elems_idx - comment_start) << (16 * 3);
-        comment_start = 0;
+      if (front + back > table.len) goto broken;
+      size_t new_len = front + count + back;
+      if (new_len > table.cap) {
+        table.cap = new_len * 2;
+        Piece* temp = realloc(table.items, table.cap * sizeof(*table.items));
+        if (temp == NULL) goto broken;
+        table.items = temp;
       }
-      tw_elems_idx += (tw->width - tw_col) + tw->linenum_width;
-      tw_col = tw->linenum_width;
-      tw_row++;
-      if (tw_elems_idx < last_row_offset){
-        TW_WRITE_NUM_AT(tw, tw_elems_idx - linenum_offset, "%ld", line + 1);
+      memmove(table.items + front + count, table.items + table.len - back, back * sizeof(*table.items));
+      for (size_t i = 0; i < count; i++) {
+        Piece* p = &table.items[front + i];
+        uint64_t offset = 0, piece_len = 0;
+        char flags = data[pos++];
+        journal_get_u64(data, len, &pos, &offset);
+        journal_get_u64(data, len, &pos, &piece_len);
+        *p = (Piece){ .which_buf = flags & 1, .is_ascii = (flags >> 1) & 1, .offset = offset, .len = piece_len };
+        size_t buf_len = p->which_buf ? add_buf.len : fe->file_buf.size;
+        if (!piece_len || offset > buf_len || piece_len > buf_len - offset) goto broken;
       }
+      table.len = new_len;
+      cursor = (Cursor){ .row = row, .col = col };
+      replayed = true;
+    } else {
+      goto broken;
     }
   }
-end:
-  return failed;
- 
-#undef buf
+  if (!replayed) goto broken;
+
+  free(fe->piece_table.items);
+  free(fe->add_buf.items);
+  fe->piece_table = table;
+  fe->add_buf = add_buf;
+  fe->cursor = cursor;
+  j->cursor_flushed = cursor;
+  j->recovered = !journal_copy_table(&j->table_flushed, &table);
+  j->add_buf_flushed = j->recovered ? add_buf.len : 0;
+  return j->recovered;
+
+broken:
+  free(table.items);
+  free(add_buf.items);
+  return false;
 }
 
 
+// DESC: sets up the journal of 'file_path' and, if a crashed 
+// session left one that applies to the file, replays it
+bool journal_init(FredEditor* fe, const char* file_path)
+{
+  bool failed = 0;
+  Journal* j = &fe->journal;
+  *j = (Journal){ .fd = -1 };
+  j->path = sidecar_path(file_path, ".fred-journal");
+  if (j->path == NULL) ERROR("not enough memory for the journal path.");
 
+  struct stat sb;
+  if (stat(file_path, &sb) == -1) ERROR("failed to retrieve any info about file '%s'. %s.", file_path, strerror(errno));
+  j->file_size = sb.st_size;
+  j->file_mtime = sb.st_mtim;
+
+  // NOTE: the journal starts from the table of the loaded file
+  if (journal_copy_table(&j->table_flushed, &fe->piece_table)) GOTO_END(1);
+
+  int fd = open(j->path, O_RDONLY);
+  if (fd == -1) return failed; // NOTE: no crashed session
+  struct stat jsb;
+  if (fstat(fd, &jsb) == 0 && jsb.st_size > 0) {
+    char* data = malloc(jsb.st_size);
+    if (data != NULL) {
+      size_t got = 0;
+      ssize_t n = 0;
+      while (got < (size_t)jsb.st_size && (n = read(fd, data + got, jsb.st_size - got)) > 0) got += n;
+      size_t valid_len = 0;
+      // NOTE: the next flush appends, not after a cut record
+      if (journal_replay(fe, data, got, &valid_len) && valid_len < got) truncate(j->path, valid_len);
+      free(data);
+    }
+  }
+  close(fd);
+end:
+  return failed;
+}
 
 
-bool FRED_render_text(TermWin* tw, Cursor* cr)
+// DESC: thread body, writes what gets queued in the journal, and 
+// syncs it when asked; when told to stop, only once all is written
+void* journal_writer(void* arg)
 {
-  bool failed = 0;
-  fprintf(stdout, "\x1b[H");
-  fwrite(tw->elems, sizeof(*tw->elems), tw->size, stdout);
-  
-  HighlightOffsets* ho = &tw->ho;
-  for (size_t i = 0; i < ho->len; i++) {
-    size_t n = ho->items[i];
-    uint16_t tw_row = n & 0xffff;
-    uint16_t tw_col = (n >> (16 * 1)) & 0xffff;
-    uint16_t kw_id = (n >> (16 * 2)) & 0xffff;
-    uint16_t kw_len = 0;
-    char* kw = NULL;
-
-    switch (kw_id) {
-      case KW_IF:           { kw_len = 2; kw = "if"; break; }
-      case KW_WHILE:        { kw_len = 5; kw = "while"; break; }
-      case KW_RETURN:       { kw_len = 6; kw = "return"; break; }
-      case KW_FOR:          { kw_len = 3; kw = "for"; break; }
-      case KW_CONTINUE:     { kw_len = 8; kw = "continue"; break; }
-      case KW_ELSE:         { kw_len = 4; kw = "else"; break; }
-      case KW_INCLUDE:      { kw_len = 8; kw = "#include"; break; }
-      case KW_IFDEF:        { kw_len = 6; kw = "#ifdef"; break; }
-      case KW_IFNDEF:       { kw_len = 7; kw = "#ifndef"; break; }
-      case KW_ELSE_PREPROC: { kw_len = 5; kw = "#else"; break; }
-      case KW_IF_PREPROC:   { kw_len = 3; kw = "#if"; break; }
-      case KW_ENDIF:        { kw_len = 6; kw = "#endif"; break; }
-      case KW_DEFINE:       { kw_len = 7; kw = "#define"; break; }
-      case KW_COMMENT: {
-        uint16_t comment_len = (n >> (16 * 3) & 0xffff);
-        char* comment_start = &tw->elems[tw_row * tw->width + tw_col];
-        fprintf(stdout, "\x1b[%u;%uH", tw_row + 1, tw_col + 1);
-        fprintf(stdout, "\x1b[33m%.*s\x1b[0m", (int)(comment_len), comment_start);
-        continue; // NOTE: text is already wrapped 
-      }
-      default: { 
-        fflush(stdout);
-        ERROR("internal (highlighting): unexpected keyword ID (%d)", kw_id);
-      }
-    }
-
-    fprintf(stdout, "\x1b[%u;%uH", tw_row + 1, tw_col + 1);
-    if (tw_col + kw_len > tw->width) { // keywords wraps into the next line
-      size_t kw_rest = tw_col + kw_len - tw->width;
-      fprintf(stdout, "\x1b[31m%.*s", (int)(kw_len - kw_rest), kw);
-      fprintf(stdout, "\x1b[%u;%uH", tw_row + 2, tw->linenum_width + 1);
-      fprintf(stdout, "%.*s\x1b[0m", (int)kw_rest, kw + (kw_len - kw_rest));
-    } else {
-      fprintf(stdout, "\x1b[31m%.*s\x1b[0m",(int)kw_len, kw);
+  Journal* j = arg;
+  JournalQueue out = {0}; // NOTE: swapped with the queue, the flushes don't wait for the writes
+  pthread_mutex_lock(&j->lock);
+  for (;;) {
+    while (!j->queue.len && !j->sync_asked && !j->stopping) pthread_cond_wait(&j->wake, &j->lock);
+    if (!j->queue.len && !j->sync_asked) break;
+    JournalQueue tmp = out;
+    out = j->queue;
+    j->queue = tmp;
+    bool sync = j->sync_asked;
+    j->sync_asked = false;
+    j->writing = true;
+    pthread_cond_broadcast(&j->idle);
+    pthread_mutex_unlock(&j->lock);
+
+    int err = 0;
+    for (size_t done = 0; done < out.len && !err; ) {
+      ssize_t n = write(j->fd, out.items + done, out.len - done);
+      if (n > 0) done += n;
+      else if (n == 0) err = EIO;
+      else if (errno != EINTR) err = errno;
     }
+    if (!err && sync && fdatasync(j->fd) == -1) err = errno;
+    out.len = 0;
+
+    pthread_mutex_lock(&j->lock);
+    j->writing = false;
+    if (err) j->write_errno = err;
+    pthread_cond_broadcast(&j->idle);
   }
+  pthread_mutex_unlock(&j->lock);
+  free(out.items);
+  return NULL;
+}
 
-  fprintf(stdout, "\x1b[%zu;%zuH", cr->win_row + 1, tw->linenum_width + cr->win_col + 1);
-  fflush(stdout);
 
-  GOTO_END(failed);
+bool journal_writer_start(Journal* j)
+{
+  bool failed = 0;
+  j->queue = (JournalQueue){0};
+  j->writing = j->sync_asked = j->stopping = false;
+  j->write_errno = 0;
+  pthread_mutex_init(&j->lock, NULL);
+  pthread_cond_init(&j->wake, NULL);
+  pthread_cond_init(&j->idle, NULL);
+  int err = pthread_create(&j->writer, NULL, journal_writer, j);
+  if (err) {
+    pthread_mutex_destroy(&j->lock);
+    pthread_cond_destroy(&j->wake);
+    pthread_cond_destroy(&j->idle);
+    ERROR("failed to start the writer of the journal '%s'. %s.", j->path, strerror(err));
+  }
+  j->writer_on = true;
 end:
   return failed;
 }
 
 
+// DESC: lets the writer write what's queued, then stops it
+void journal_writer_stop(Journal* j)
+{
+  if (!j->writer_on) return;
+  pthread_mutex_lock(&j->lock);
+  j->stopping = true;
+  pthread_cond_signal(&j->wake);
+  pthread_mutex_unlock(&j->lock);
+  pthread_join(j->writer, NULL);
+  pthread_mutex_destroy(&j->lock);
+  pthread_cond_destroy(&j->wake);
+  pthread_cond_destroy(&j->idle);
+  free(j->queue.items);
+  j->queue = (JournalQueue){0};
+  j->writer_on = false;
+}
+
 
-bool insert_at_table_start(FredEditor* fe)
+// DESC: hands 'len' bytes of records to the writer; only waits for 
+// it if it's more than JOURNAL_QUEUE_MAX bytes behind
+bool journal_enqueue(Journal* j, const char* data, size_t len)
 {
   bool failed = 0;
-  PieceTable* table = &fe->piece_table;
-  DA_MAYBE_GROW(table, 1, PIECE_TABLE_INIT_CAP, PieceTable);
-  memmove(table->items + 1, table->items, table->len * sizeof(*table->items));
-  table->items[0] = (Piece) {
-    .which_buf = 1,
-    .offset = fe->add_buf.len - 1,
-    .len = 1,
-  };
-  table->len++;
+  pthread_mutex_lock(&j->lock);
+  while (j->queue.len && j->queue.len + len > JOURNAL_QUEUE_MAX && !j->write_errno) {
+    pthread_cond_wait(&j->idle, &j->lock);
+  }
+  int err = j->write_errno;
+  bool grown = true;
+  if (!err && j->queue.len + len > j->queue.cap) {
+    size_t cap = (j->queue.len + len) * 2;
+    char* temp = realloc(j->queue.items, cap);
+    grown = temp != NULL;
+    if (grown) {
+      j->queue.items = temp;
+      j->queue.cap = cap;
+    }
+  }
+  if (!err && grown) {
+    memcpy(j->queue.items + j->queue.len, data, len);
+    j->queue.len += len;
+    pthread_cond_signal(&j->wake);
+  }
+  pthread_mutex_unlock(&j->lock);
+  if (err) ERROR("failed to write the journal '%s'. %s.", j->path, strerror(err));
+  if (!grown) ERROR("not enough memory for the journal queue.");
 end:
   return failed;
 }
 
 
-// DESC: either grows the piece at 'piece_idx' or 
-// adds a new piece after it
-bool insert_after_piece(FredEditor* fe, size_t piece_idx)
+// DESC: queues for the journal the add-buf bytes and the piece-table 
+// changes since the last flush, as one record; nothing if there are 
+// none. Only the common front and back of the old and new tables 
+// are kept, the pieces in between get written.
+bool FRED_journal_flush(FredEditor* fe)
 {
-#define AT_LAST_EDIT_POS (fe->cursor.row == fe->last_edit.cursor.row && fe->cursor.col == fe->last_edit.cursor.col)
-#define LAST_ACT_WAS_INSERT (fe->last_edit.action == ACT_INSERT)
-#define IS_ADD_BUF_PIECE (table->items[piece_idx].which_buf)
-
   bool failed = 0;
+  Journal* j = &fe->journal;
+  FileBuf* fb = &fe->file_buf;
   PieceTable* table = &fe->piece_table;
+  PieceTable* old = &j->table_flushed;
+  PieceTable whole = {0};
+  char* rec = NULL;
+  if (j->path == NULL) return failed;
+
+  // NOTE: the rest of a file still being indexed goes after the text, 
+  // where the steps will append it, so a replay gets all of the file; 
+  // the file pieces don't move while indexing
+  if (!fe->index.done && fe->index.frontier < fb->size) {
+    if (journal_copy_table(&whole, table)) GOTO_END(1);
+    size_t rest = fb->size - fe->index.frontier;
+    Piece* last = whole.len ? &whole.items[whole.len - 1] : NULL;
+    if (last != NULL && !last->which_buf && last->offset + last->len == fe->index.frontier) {
+      last->len += rest;
+      last->is_ascii = false; // NOTE: not known yet
+    } else {
+      PIECE_TABLE_PUSH(&whole, ((Piece){ .which_buf = 0, .is_ascii = false, .offset = fe->index.frontier, .len = rest }));
+    }
+    table = &whole;
+  }
 
-  if (AT_LAST_EDIT_POS && LAST_ACT_WAS_INSERT && IS_ADD_BUF_PIECE) {
-    table->items[piece_idx].len++;
-  } else {
-    DA_MAYBE_GROW(table, 1, PIECE_TABLE_INIT_CAP, PieceTable);
-    size_t n = (table->len - (piece_idx + 1)) * sizeof(*table->items);
-    memmove(&table->items[piece_idx+2], &table->items[piece_idx+1], n);
-    table->items[piece_idx + 1] = (Piece) {
-      .which_buf = 1,
-      .offset = fe->add_buf.len - 1,
-      .len = 1,
-    };
-    table->len++;
+#define SAME_PIECE(a, b) ((a).which_buf == (b).which_buf && (a).offset == (b).offset && (a).len == (b).len)
+  size_t front = 0, back = 0;
+  while (front < table->len && front < old->len && SAME_PIECE(table->items[front], old->items[front])) front++;
+  while (back < table->len - front && back < old->len - front && 
+         SAME_PIECE(table->items[table->len - 1 - back], old->items[old->len - 1 - back])) back++;
+#undef SAME_PIECE
+  size_t count = table->len - front - back;
+  size_t new_bytes = fe->add_buf.len - j->add_buf_flushed;
+  bool cursor_moved = fe->cursor.row != j->cursor_flushed.row || fe->cursor.col != j->cursor_flushed.col;
+  bool unchanged = !new_bytes && !count && table->len == old->len;
+  if (unchanged && (!cursor_moved || (j->fd == -1 && !j->recovered))) { // NOTE: no journal if the text is as loaded
+    j->last_flush_ms = monotonic_ms();
+    GOTO_END(failed);
+  }
+
+  bool header = false;
+  if (j->fd == -1) {
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (j->recovered ? O_APPEND : O_TRUNC);
+    j->fd = open(j->path, flags, 0600);
+    if (j->fd == -1) ERROR("failed to open the journal '%s'. %s.", j->path, strerror(errno));
+    header = !j->recovered;
+  }
+  if (!j->writer_on && journal_writer_start(j)) GOTO_END(1);
+
+  size_t rec_len = (header ? JOURNAL_HEADER_LEN : 0) + (new_bytes ? 1 + sizeof(uint64_t) + new_bytes : 0) + 
+                   1 + 5 * sizeof(uint64_t) + count * JOURNAL_PIECE_LEN;
+  rec = malloc(rec_len);
+  if (rec == NULL) ERROR("not enough memory for the journal record.");
+  char* out = rec;
+  if (header) {
+    memcpy(out, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC) - 1);
+    out += sizeof(JOURNAL_MAGIC) - 1;
+    out = journal_put_u64(out, j->file_size);
+    out = journal_put_u64(out, j->file_mtime.tv_sec);
+    out = journal_put_u64(out, j->file_mtime.tv_nsec);
+    out = journal_put_u64(out, 0); // NOTE: reserved
   }
+  if (new_bytes) {
+    *out++ = 'A';
+    out = journal_put_u64(out, new_bytes);
+    memcpy(out, fe->add_buf.items + j->add_buf_flushed, new_bytes);
+    out += new_bytes;
+  }
+  *out++ = 'P';
+  out = journal_put_u64(out, front);
+  out = journal_put_u64(out, back);
+  out = journal_put_u64(out, count);
+  out = journal_put_u64(out, fe->cursor.row);
+  out = journal_put_u64(out, fe->cursor.col);
+  for (size_t i = front; i < front + count; i++) {
+    Piece p = table->items[i];
+    *out++ = p.which_buf | (p.is_ascii << 1);
+    out = journal_put_u64(out, p.offset);
+    out = journal_put_u64(out, p.len);
+  }
+  if (journal_enqueue(j, rec, rec_len)) GOTO_END(1);
+
+  j->bytes_written += rec_len;
+  j->add_buf_flushed = fe->add_buf.len;
+  if (journal_copy_table(old, table)) GOTO_END(1);
+  j->cursor_flushed = fe->cursor;
+  j->needs_sync = true;
+  j->last_flush_ms = monotonic_ms();
 end:
+  free(rec);
+  DA_FREE(&whole, 1);
   return failed;
-
-#undef AT_LAST_EDIT_POS
-#undef LAST_ACT_WAS_INSERT
-#undef IS_ADD_BUF_PIECE
 }
 
 
-
-
-
-// DESC: splits the piece at 'piece_idx' 
-// into two and adds a new one in the middle 
-bool insert_inside_piece(FredEditor* fe, size_t piece_idx, size_t edit_offset) 
+// DESC: asks the writer to make what got flushed durable, only 
+// done when idle; a write that failed since gets reported here
+bool FRED_journal_sync(FredEditor* fe)
 {
   bool failed = 0;
+  Journal* j = &fe->journal;
+  if (!j->writer_on || !j->needs_sync) return failed;
+  pthread_mutex_lock(&j->lock);
+  int err = j->write_errno;
+  j->sync_asked = true;
+  pthread_cond_signal(&j->wake);
+  pthread_mutex_unlock(&j->lock);
+  if (err) ERROR("failed to write the journal '%s'. %s.", j->path, strerror(err));
+  j->needs_sync = false;
+end:
+  return failed;
+}
 
-  PieceTable* table = &fe->piece_table;
-  Piece curr_piece = table->items[piece_idx];
-  size_t piece_1_len = edit_offset; 
-  size_t piece_3_offset = curr_piece.offset + piece_1_len;
-  size_t piece_3_len = curr_piece.len - piece_1_len;
- 
-  DA_MAYBE_GROW(table, 2, PIECE_TABLE_INIT_CAP, PieceTable);
-  size_t n = (table->len - (piece_idx + 1)) * sizeof(*table->items);
-  memmove(&table->items[piece_idx + 3], &table->items[piece_idx + 1], n);
 
-  table->items[piece_idx + 1] = (Piece){ 1, fe->add_buf.len - 1, 1};
-  table->items[piece_idx + 2] = (Piece){ curr_piece.which_buf, piece_3_offset, piece_3_len};
-  table->items[piece_idx].len = piece_1_len;
-  table->len += 2;
+// DESC: waits till the writer has written (and synced, if asked) 
+// all that got queued; the editor never does, the tests do
+bool FRED_journal_wait(FredEditor* fe)
+{
+  bool failed = 0;
+  Journal* j = &fe->journal;
+  if (!j->writer_on) return failed;
+  pthread_mutex_lock(&j->lock);
+  while (j->queue.len || j->writing || j->sync_asked) pthread_cond_wait(&j->idle, &j->lock);
+  int err = j->write_errno;
+  pthread_mutex_unlock(&j->lock);
+  if (err) ERROR("failed to write the journal '%s'. %s.", j->path, strerror(err));
 end:
   return failed;
 }
 
 
+// DESC: closes the journal, once the writer wrote all it was 
+// handed, removing its file on a clean exit
+void FRED_journal_close(FredEditor* fe, bool remove_file)
+{
+  Journal* j = &fe->journal;
+  journal_writer_stop(j);
+  if (j->fd != -1) close(j->fd);
+  if (remove_file && j->path != NULL && (j->fd != -1 || j->recovered)) unlink(j->path);
+  j->fd = -1;
+  free(j->path);
+  j->path = NULL;
+  DA_FREE(&j->table_flushed, 0);
+}
 
 
-
-bool FRED_insert_text(FredEditor* fe, char text_char)
+// DESC: starts the journal over for the file as it is now ('sb'), 
+// after a reload or a save: the old one only applies to the old file
+bool journal_restart(FredEditor* fe, const char* file_path, struct stat* sb)
 {
-#define LAST_ACT_WAS_INSERT (fe->last_edit.action == ACT_INSERT)
-#define AT_LAST_LINE_END (cr->row == ll->len - 1 && cr->col == (size_t)(ll->items[cr->row] & 0xffff))
   bool failed = 0;
+  Journal* j = &fe->journal;
+  if (j->path == NULL) return failed; // NOTE: read-only, or dropped
+  FRED_journal_close(fe, true);
+  j->path = sidecar_path(file_path, ".fred-journal");
+  if (j->path == NULL) ERROR("not enough memory for the journal path.");
+  j->file_size = sb->st_size;
+  j->file_mtime = sb->st_mtim;
+  j->add_buf_flushed = 0;
+  j->cursor_flushed = (Cursor){0};
+  j->recovered = false;
+  j->needs_sync = false;
+  // NOTE: replaying it starts from the file as loaded, one piece of it
+  if (fe->file_buf.size > 0) {
+    PIECE_TABLE_PUSH(&j->table_flushed, ((Piece){ .which_buf = 0, .offset = 0, .len = fe->file_buf.size }));
+  }
+end:
+  return failed;
+}
 
-  PieceTable* table = &fe->piece_table;
-  LinesLen* ll = &fe->lines_len;
-  Cursor* cr = &fe->cursor;
-
-  ADD_BUF_PUSH(&fe->add_buf, text_char);
 
-  if (table->len == 0 || (!LAST_ACT_WAS_INSERT && AT_LAST_LINE_END)) {
-    PIECE_TABLE_PUSH(table, ((Piece){1, fe->add_buf.len - 1, 1}));
-    GOTO_END(failed);
-  } else if (cr->row == 0 && cr->col == 0) {
-    failed = insert_at_table_start(fe);
-    GOTO_END(failed);
-  }
+bool fred_editor_init(FredEditor* fe, const char* file_path)
+{
+  bool failed = 0;
+  bool file_loaded = 0;
 
-  size_t place_to_edit_offset = 0; // NOTE: offset in the fully built text
-  for ( size_t i = 0; i < cr->row; i++) {
-    // NOTE: no NULL-check needed for 'll' cause the loop 
-    // would be unreachable, since cr->row would be 0
-    place_to_edit_offset += (ll->items[i] & 0xffff) + 1; // NOTE: '+1' is for '\n' 
-  }
-  place_to_edit_offset += cr->col;
+  DA_INIT(&fe->piece_table);
+  DA_INIT(&fe->add_buf);
+  DA_INIT(&fe->lines_len);
+  DA_INIT(&fe->lines_width);
+  DA_INIT(&fe->line_starts);
+  fe->line_starts.shift_from = fe->line_starts.shift = 0;
+  fe->row_index = NULL;
+  fe->follow = (FileFollow){ .fd = -1, .wd = -1 }; // NOTE: see FRED_follow_start()
+  fe->reload = (FileReload){0};
+  stat(file_path, &fe->reload.file_stat); // NOTE: before reading it, a write meanwhile gets merged in later
 
-  for (size_t i = 0, pieces_len = 0; i < table->len; i++) {
-    pieces_len += table->items[i].len;
-    if (place_to_edit_offset == pieces_len) {
-      failed = insert_after_piece(fe, i);
-      GOTO_END(failed);
-    } else if (pieces_len > place_to_edit_offset) {
-      size_t edit_offset = table->items[i].len - (pieces_len - place_to_edit_offset);
-      failed = insert_inside_piece(fe, i, edit_offset);
-      GOTO_END(failed);
+  failed = FRED_open_file(&fe->file_buf, file_path);
+  if (failed) GOTO_END(1);
+  file_loaded = 1;
+
+  bool progressive = fe->progressive && fe->file_buf.size >= LINES_CACHE_MIN_SIZE;
+  if (fe->file_buf.size > 0){
+    PIECE_TABLE_PUSH(&fe->piece_table, ((Piece){
+      .which_buf = 0,
+      .is_ascii = !progressive && FRED_is_ascii(fe->file_buf.text, fe->file_buf.size), // NOTE: else found out step by step
+      .offset = 0,
+      .len = fe->file_buf.size,
+    }));
+  }
+  fe->index = (LinesIndex){ .done = true, .frontier = fe->file_buf.size };
+
+  fe->cursor = (Cursor){0};
+  fe->last_edit = (LastEdit){0};
+  fe->disp_col_cache = (DispColCache){0};
+  if (!fe->tab_width) fe->tab_width = TAB_WIDTH_DEFAULT; // NOTE: the caller may set it beforehand
+
+  if (fe->read_only) fe->journal = (Journal){ .fd = -1 }; // NOTE: nothing to recover
+  else failed = journal_init(fe, file_path);
+  if (failed) GOTO_END(1);
+
+  // NOTE: from here on edits keep the lines up to date themselves
+  if (fe->journal.recovered) failed = FRED_get_lines_len(fe);
+  else failed = lines_cache_load(fe, file_path, progressive);
+  if (failed) GOTO_END(1);
+end:
+  if (failed){
+    if (file_loaded) FRED_close_file(&fe->file_buf);
+  }
+  return failed;
+}
+
+void fred_editor_free(FredEditor* fe)
+{
+  index_stop(fe);
+  DA_FREE(&fe->piece_table, 1);
+  DA_FREE(&fe->add_buf, 1);
+  DA_FREE(&fe->lines_len, 1);
+  DA_FREE(&fe->lines_width, 1);
+  DA_FREE(&fe->line_starts, 1);
+  DA_FREE(&fe->multi, 1);
+  DA_FREE(&fe->reg.pieces, 1);
+  free(fe->reg.text);
+  FRED_close_file(&fe->file_buf);
+  FRED_journal_close(fe, false);
+  FRED_follow_stop(fe);
+  free(fe->index.cache_path);
+}
+
+
+// DESC: checks the high bit of every byte, 16 bytes at a time
+// with SSE2 (8 with the fallback), so it costs next to nothing 
+// on the ascii-only files that most files are
+bool FRED_is_ascii(const char* text, size_t len)
+{
+  size_t i = 0;
+#ifdef __SSE2__
+  __m128i acc = _mm_setzero_si128();
+  for (; i + 16 <= len; i += 16) {
+    acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i*)(text + i)));
+  }
+  if (_mm_movemask_epi8(acc)) return false;
+#else
+  uint64_t acc = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t word;
+    memcpy(&word, text + i, sizeof(word));
+    acc |= word;
+  }
+  if (acc & 0x8080808080808080ull) return false;
+#endif
+  for (; i < len; i++) {
+    if ((unsigned char)text[i] >= 0x80) return false;
+  }
+  return true;
+}
+
+
+// DESC: length of the utf-8 sequence starting with 'c';
+// invalid lead bytes and continuation bytes count as 1
+size_t utf8_len(unsigned char c)
+{
+  if (c < 0x80) return 1;
+  if ((c & 0xe0) == 0xc0) return 2;
+  if ((c & 0xf0) == 0xe0) return 3;
+  if ((c & 0xf8) == 0xf0) return 4;
+  return 1;
+}
+
+
+// DESC: cells taken by 'cp' on the screen: 0 for combining 
+// and zero-width chars, 2 for east-asian wide chars and emojis.
+// NOTE: this only covers the common ranges, not the whole 
+// unicode tables like wcwidth() does
+size_t utf8_cp_width(uint32_t cp)
+{
+  if ((cp >= 0x0300 && cp <= 0x036f) || (cp >= 0x1ab0 && cp <= 0x1aff) ||
+      (cp >= 0x1dc0 && cp <= 0x1dff) || (cp >= 0x200b && cp <= 0x200f) ||
+      (cp >= 0x20d0 && cp <= 0x20ff) || (cp >= 0xfe00 && cp <= 0xfe0f) ||
+      (cp >= 0xfe20 && cp <= 0xfe2f) || cp == 0xfeff) {
+    return 0;
+  }
+  if ((cp >= 0x1100 && cp <= 0x115f) || (cp >= 0x2e80 && cp <= 0x303e) ||
+      (cp >= 0x3041 && cp <= 0xa4cf) || (cp >= 0xac00 && cp <= 0xd7a3) ||
+      (cp >= 0xf900 && cp <= 0xfaff) || (cp >= 0xfe30 && cp <= 0xfe4f) ||
+      (cp >= 0xff00 && cp <= 0xff60) || (cp >= 0xffe0 && cp <= 0xffe6) ||
+      (cp >= 0x1f300 && cp <= 0x1f64f) || (cp >= 0x1f900 && cp <= 0x1f9ff) ||
+      (cp >= 0x20000 && cp <= 0x3fffd)) {
+    return 2;
+  }
+  return 1;
+}
+
+
+// DESC: feeds one byte to the decoder and returns how many cells 
+// it moves the display column 'disp_col' forward. Only the last byte 
+// of a multi-byte char moves it, with 'd->cp' set to the decoded 
+// code-point; invalid bytes take one cell each and decode to U+FFFD.
+size_t utf8_cells(Utf8Decoder* d, unsigned char c, size_t disp_col, size_t tab_width)
+{
+  if (c < 0x80) {
+    d->left = 0;
+    d->cp = c;
+    return c == '\t' ? tab_width - disp_col % tab_width : 1;
+  }
+
+  if (IS_UTF8_CONT(c)) {
+    if (!d->left) {
+      d->cp = 0xfffd;
+      return 1;
+    }
+    d->cp = (d->cp << 6) | (c & 0x3f);
+    if (--d->left) return 0;
+    return utf8_cp_width(d->cp);
+  }
+
+  size_t n = utf8_len(c);
+  if (n == 1) {
+    d->left = 0;
+    d->cp = 0xfffd;
+    return 1;
+  }
+  d->cp = c & (0x7f >> n);
+  d->left = n - 1;
+  return 0;
+}
+
+
+
+bool FRED_win_resize(TermWin* tw)
+{
+  bool failed = false;
+  struct winsize w;
+  if (-1 == ioctl(STDIN_FILENO, TIOCGWINSZ, &w)){
+    ERROR("failed to retrieve terminal size. %s.", strerror(errno));
+  }
+  
+  tw->size = w.ws_row * w.ws_col;
+  tw->height = w.ws_row;
+  tw->width = w.ws_col;
+  void* temp = realloc(tw->elems, tw->size);
+  if (temp == NULL) ERROR("not enough memory to get and display text.");
+  tw->elems = temp;
+
+  temp = realloc(tw->cps, tw->size * sizeof(*tw->cps));
+  if (temp == NULL) ERROR("not enough memory to get and display text.");
+  tw->cps = temp;
+  memset(tw->cps, 0, tw->size * sizeof(*tw->cps));
+  tw->has_utf8 = false;
+
+  temp = realloc(tw->attrs, tw->size * sizeof(*tw->attrs));
+  if (temp == NULL) ERROR("not enough memory to get and display text.");
+  tw->attrs = temp;
+  memset(tw->attrs, 0, tw->size * sizeof(*tw->attrs));
+  tw->has_attrs = false;
+  tw->row_index.valid = false; // NOTE: rebuilt lazily for the new width
+  GOTO_END(failed);
+end:
+  return failed;
+}
+
+
+// DESC: adds the display width of 'len' bytes of a line to 'line_width', 
+// clearing 'line_is_ascii' on utf-8 bytes; ascii spans 
+// without tabs are as wide as they are long.
+size_t add_span_width(FredEditor* fe, const char* text, size_t len, bool span_is_ascii, 
+                      size_t line_width, bool* line_is_ascii, Utf8Decoder* decoder)
+{
+  if (span_is_ascii && memchr(text, '\t', len) == NULL) return line_width + len;
+  for (size_t j = 0; j < len; j++) {
+    char c = text[j];
+    if (c == '\t') line_width += fe->tab_width - line_width % fe->tab_width;
+    else if ((unsigned char)c < 0x80) line_width++;
+    else {
+      line_width += utf8_cells(decoder, c, line_width, fe->tab_width);
+      *line_is_ascii = false;
+    }
+  }
+  return line_width;
+}
+
+
+// TODO+NOTE: EOL at end of file (like the ones saved 
+// with neovim) will get considered as proper line 
+// NOTE: last 2 bytes in line-item are reserved 
+// for the keywords-per-line count, used for 
+// rendering highlighting.
+// Also stores the display width of each line in 'lines_width'.
+bool FRED_get_lines_len(FredEditor* fe)
+{
+  fe->lines_len.len = 0;
+  fe->lines_width.len = 0;
+  fe->line_starts.len = 0;
+  return lines_scan_from(fe, 0);
+}
+
+
+// DESC: (re)builds the lines from the one starting at 'offset' to 
+// the end, keeping the ones before it; 'offset' must be the start 
+// of a line already in the tables, or 0 with the tables empty.
+bool lines_scan_from(FredEditor* fe, size_t offset)
+{
+  bool failed = 0;
+  LinesLen* ll = &fe->lines_len;
+  LinesWidth* lw = &fe->lines_width;
+  LineStarts* ls = &fe->line_starts;
+  
+  line_starts_settle(ls);
+  size_t row = offset ? get_offset_row(fe, offset) : 0;
+  assert(!offset || ls->items[row] == offset, "offset %zu is not the start of a line", offset);
+  ll->len = row;
+  lw->len = row;
+  ls->len = row;
+  fe->disp_col_cache.valid = false;
+  fe->lines_version++;
+  size_t next = 0;
+  failed = lines_scan_range(fe, offset, SIZE_MAX, &next, ll, lw, ls);
+end:
+  return failed;
+}
+
+
+// DESC: appends to the tables the lines of the text from the one 
+// starting at 'offset' to the one whose '\n' is at or past 'until'; 
+// 'next' gets the start of the line after them, or SIZE_MAX if 
+// they went on to the end of the text.
+bool lines_scan_range(FredEditor* fe, size_t offset, size_t until, size_t* next, 
+                      LinesLen* ll, LinesWidth* lw, LineStarts* ls)
+{
+// TODO: what if file is some big ass data not separated by newlines?
+#define end_line(line_end) do { \
+  size_t line_len = (line_end) - line_start; \
+  assert(line_len <= LINE_LEN_MAX, "line-length overflow (max line-length is LINE_LEN_MAX, 4 GiB - 1), " \
+                                   "length cannot be stored for later usage"); \
+  ll->items[ll->len - 1] = (uint32_t)line_len; \
+  lw->items[lw->len - 1] = LINE_WIDTH_ITEM(line_width, line_is_ascii); \
+} while (0)
+
+  bool failed = 0;
+  size_t line_start = offset;
+  size_t line_width = 0;
+  bool line_is_ascii = true;
+  Utf8Decoder decoder = {0};
+  *next = SIZE_MAX;
+  DA_PUSH(ll, 0, 8, LinesLen);
+  DA_PUSH(lw, 0, 8, LinesWidth);
+  DA_PUSH(ls, offset, 8, LineStarts);
+
+  PieceIter it = piece_iter_at(fe, offset);
+  PieceSpan span;
+  while ((span = piece_iter_span(&it)).len) {
+    size_t span_start = it.offset;
+    size_t i = 0;
+    while (i < span.len) {
+      // NOTE: one line (or the part of it in this span) at a time
+      const char* nl = memchr(span.text + i, '\n', span.len - i);
+      size_t seg_end = nl != NULL ? (size_t)(nl - span.text) : span.len;
+
+      line_width = add_span_width(fe, span.text + i, seg_end - i, span.is_ascii, 
+                                  line_width, &line_is_ascii, &decoder);
+
+      if (nl == NULL) break;
+      end_line(span_start + seg_end);
+      line_start = span_start + seg_end + 1;
+      if (span_start + seg_end >= until) {
+        *next = line_start;
+        return failed;
+      }
+      line_width = 0;
+      line_is_ascii = true;
+      DA_PUSH(ll, 0, 8, LinesLen);
+      DA_PUSH(lw, 0, 8, LinesWidth);
+      DA_PUSH(ls, line_start, 8, LineStarts);
+      i = seg_end + 1;
+    }
+    piece_iter_skip(&it, span.len);
+  }
+  end_line(it.offset); // NOTE: last line, not ended by '\n'
+end:
+  return failed;
+#undef end_line
+}
+
+
+// DESC: scans the lines of the chunk into its own tables
+void lines_scan_lines(LinesChunk* c)
+{
+  bool failed = 0;
+  FredEditor* fe = c->fe;
+  const char* text = c->text;
+  size_t size = c->size;
+  bool is_ascii = c->is_ascii;
+  Utf8Decoder decoder = {0};
+
+  for (size_t line_start = c->start; line_start < c->end; ) {
+    const char* nl = memchr(text + line_start, '\n', size - line_start);
+    size_t line_end = nl != NULL ? (size_t)(nl - text) : size;
+    bool line_is_ascii = true;
+    size_t line_width = add_span_width(fe, text + line_start, line_end - line_start, is_ascii, 
+                                       0, &line_is_ascii, &decoder);
+    if (line_end - line_start > LINE_LEN_MAX) GOTO_END(1); // NOTE: reported by the caller
+    DA_PUSH(&c->lines_len, (uint32_t)(line_end - line_start), 1024, LinesLen);
+    DA_PUSH(&c->lines_width, LINE_WIDTH_ITEM(line_width, line_is_ascii), 1024, LinesWidth);
+    DA_PUSH(&c->line_starts, line_start, 1024, LineStarts);
+    if (nl == NULL) break;
+    line_start = line_end + 1;
+  }
+end:
+  c->failed = failed;
+}
+
+
+// DESC: thread body, lines_scan_lines() with a guard: a read past 
+// the end of a file cut under it leaves 'fault' set, for the thread 
+// that started it to hand over, see file_buf_fault_again()
+void* lines_scan_chunk(void* arg)
+{
+  LinesChunk* c = arg;
+  sigjmp_buf guard;
+  sigjmp_buf* outer = file_buf_guard;
+  if (sigsetjmp(guard, 1)) {
+    file_buf_guard = outer;
+    c->fault = file_buf_fault;
+    return NULL;
+  }
+  file_buf_guard = &guard;
+  lines_scan_lines(c);
+  file_buf_guard = outer;
+  return NULL;
+}
+
+
+// DESC: a fault at 'addr' another thread caught, for this thread's 
+// guard as if it had faulted itself; returns only without a guard
+void file_buf_fault_again(const char* addr)
+{
+  if (file_buf_guard == NULL) return;
+  file_buf_fault = addr;
+  siglongjmp(*file_buf_guard, 1);
+}
+
+
+// DESC: like lines_scan_from() on a piece-table that is still just the 
+// file, but the text from 'offset' on gets split into chunks ending 
+// at a '\n', one per thread; each one scans its lines on its own and 
+// they get copied in place by the prefix sum of their lines counts.
+bool lines_scan_file(FredEditor* fe, size_t offset)
+{
+  bool failed = 0;
+  FileBuf* fb = &fe->file_buf;
+  PieceTable* table = &fe->piece_table;
+  size_t threads = fe->index_threads;
+  if (!threads) threads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+  if (threads > LINES_MAX_THREADS) threads = LINES_MAX_THREADS;
+  // NOTE: the file or, while indexing, the part of it in the text
+  bool plain_file = table->len == 1 && !table->items[0].which_buf && table->items[0].offset == 0;
+  size_t text_len = plain_file ? table->items[0].len : 0;
+  if (threads < 2 || !plain_file || text_len - offset < LINES_PARALLEL_MIN_SIZE) {
+    return lines_scan_from(fe, offset);
+  }
+
+  LinesChunk chunks[LINES_MAX_THREADS] = {0};
+  pthread_t tids[LINES_MAX_THREADS];
+  bool started[LINES_MAX_THREADS] = {0};
+  size_t chunk_len = (text_len - offset) / threads;
+  for (size_t k = 0; k < threads; k++) {
+    LinesChunk* c = &chunks[k];
+    c->fe = fe;
+    c->text = fb->text;
+    c->size = text_len; // NOTE: the text is the file, or a part of it
+    c->is_ascii = table->items[0].is_ascii;
+    c->start = k ? chunks[k - 1].end : offset;
+    c->end = text_len + 1; // NOTE: the last one gets the empty line after a final '\n'
+    if (k + 1 < threads) {
+      size_t boundary = offset + (k + 1) * chunk_len;
+      if (boundary < c->start) boundary = c->start;
+      const char* nl = memchr(fb->text + boundary, '\n', text_len - boundary);
+      if (nl != NULL) c->end = nl - fb->text + 1;
+    }
+    // NOTE: no '\n' past its boundary, the chunk goes on to the end 
+    // and there's nothing left for the ones after it
+    if (c->end == text_len + 1) threads = k + 1;
+  }
+  // NOTE: the 1st chunk on this thread, or any chunk that didn't get one
+  for (size_t k = 1; k < threads; k++) {
+    started[k] = 0 == pthread_create(&tids[k], NULL, lines_scan_chunk, &chunks[k]);
+  }
+  lines_scan_chunk(&chunks[0]);
+  for (size_t k = 1; k < threads; k++) {
+    if (started[k]) pthread_join(tids[k], NULL);
+    else lines_scan_chunk(&chunks[k]);
+  }
+
+  LinesLen* ll = &fe->lines_len;
+  LinesWidth* lw = &fe->lines_width;
+  LineStarts* ls = &fe->line_starts;
+  size_t row = offset ? get_offset_row(fe, offset) : 0;
+  size_t lines = row;
+  for (size_t k = 0; k < threads; k++) {
+    if (chunks[k].fault == NULL) continue;
+    const char* fault = chunks[k].fault;
+    for (size_t j = 0; j < threads; j++) { // NOTE: no coming back to 'end' from the guard
+      DA_FREE(&chunks[j].lines_len, 0);
+      DA_FREE(&chunks[j].lines_width, 0);
+      DA_FREE(&chunks[j].line_starts, 0);
+    }
+    file_buf_fault_again(fault);
+    ERROR("the file got cut while its lines were being scanned.");
+  }
+  for (size_t k = 0; k < threads; k++) {
+    assert(!chunks[k].failed, "line-length overflow (max line-length is LINE_LEN_MAX, 4 GiB - 1), " 
+                              "length cannot be stored for later usage");
+    lines += chunks[k].lines_len.len;
+  }
+  ll->len = lw->len = ls->len = row;
+  line_starts_settle(ls);
+  while (ll->len + lines - row > ll->cap) DA_MAYBE_GROW(ll, lines - row, lines, LinesLen);
+  while (lw->len + lines - row > lw->cap) DA_MAYBE_GROW(lw, lines - row, lines, LinesWidth);
+  while (ls->len + lines - row > ls->cap) DA_MAYBE_GROW(ls, lines - row, lines, LineStarts);
+  for (size_t k = 0; k < threads; k++) {
+    LinesChunk* c = &chunks[k];
+    memcpy(ll->items + ll->len, c->lines_len.items, c->lines_len.len * sizeof(*ll->items));
+    memcpy(lw->items + lw->len, c->lines_width.items, c->lines_width.len * sizeof(*lw->items));
+    memcpy(ls->items + ls->len, c->line_starts.items, c->line_starts.len * sizeof(*ls->items));
+    ll->len += c->lines_len.len;
+    lw->len += c->lines_width.len;
+    ls->len += c->line_starts.len;
+  }
+  fe->disp_col_cache.valid = false;
+  fe->lines_version++;
+end:
+  for (size_t k = 0; k < threads; k++) {
+    DA_FREE(&chunks[k].lines_len, 1);
+    DA_FREE(&chunks[k].lines_width, 1);
+    DA_FREE(&chunks[k].line_starts, 1);
+  }
+  return failed;
+}
+
+
+// DESC: FNV-1a of LINES_CACHE_SAMPLES chunks spread evenly over 
+// the first 'len' bytes of 'text' (all of them if that few), cheap 
+// enough to check a cache of the lines of a file of any size
+uint64_t lines_cache_hash(const char* text, size_t len)
+{
+  uint64_t hash = 0xcbf29ce484222325;
+  size_t samples_len = LINES_CACHE_SAMPLES * LINES_CACHE_SAMPLE_LEN;
+  size_t step = len > samples_len ? len / LINES_CACHE_SAMPLES : LINES_CACHE_SAMPLE_LEN;
+  for (size_t start = 0; start < len; start += step) {
+    size_t end = start + LINES_CACHE_SAMPLE_LEN < len ? start + LINES_CACHE_SAMPLE_LEN : len;
+    for (size_t i = start; i < end; i++) {
+      hash ^= (unsigned char)text[i];
+      hash *= 0x100000001b3;
+    }
+  }
+  return hash;
+}
+
+
+// DESC: writes the lines of the file, as just built, next to it; 
+// to a temp file renamed over the old cache so a reader never 
+// sees half of it. Not being able to is no error, the cache is 
+// only there to speed up the next open.
+void lines_cache_write(FredEditor* fe, const char* path, struct stat* sb)
+{
+  size_t path_len = strlen(path) + sizeof(".tmp");
+  char* tmp_path = malloc(path_len);
+  if (tmp_path == NULL) return;
+  snprintf(tmp_path, path_len, "%s.tmp", path);
+
+  line_starts_settle(&fe->line_starts); // NOTE: written as they are
+  LinesCacheHeader header = {
+    .file_size = fe->file_buf.size,
+    .mtime_sec = sb->st_mtim.tv_sec,
+    .mtime_nsec = sb->st_mtim.tv_nsec,
+    .inode = sb->st_ino,
+    .dev = sb->st_dev,
+    .tab_width = fe->tab_width,
+    .hash = lines_cache_hash(fe->file_buf.text, fe->file_buf.size),
+    .lines = fe->lines_len.len,
+  };
+  memcpy(header.magic, LINES_CACHE_MAGIC, sizeof(header.magic));
+  size_t lines = header.lines;
+  struct iovec iov[] = {
+    { &header, sizeof(header) },
+    { fe->lines_len.items, lines * sizeof(*fe->lines_len.items) },
+    { fe->lines_width.items, lines * sizeof(*fe->lines_width.items) },
+    { fe->line_starts.items, lines * sizeof(*fe->line_starts.items) },
+  };
+  ssize_t total = 0;
+  for (size_t i = 0; i < sizeof(iov) / sizeof(*iov); i++) total += iov[i].iov_len;
+
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd != -1) {
+    bool written = writev(fd, iov, sizeof(iov) / sizeof(*iov)) == total;
+    close(fd);
+    if (!written || rename(tmp_path, path) == -1) unlink(tmp_path);
+  }
+  free(tmp_path);
+}
+
+
+// DESC: builds the lines of the file just loaded, from the cache 
+// next to it when it's still good: same inode, same size and 
+// mtime, and the same sampled hash. If the file only grew since 
+// (the hash of the old part still matches), only the lines from 
+// the last cached one on get scanned. Files of at least 
+// LINES_CACHE_MIN_SIZE get their cache written when it's missing 
+// or stale, unless read-only or 'fe->lines_cache' says otherwise. 
+// If 'progressive', what the cache doesn't have gets scanned by 
+// FRED_index_step(), only the first few lines here.
+bool lines_cache_load(FredEditor* fe, const char* file_path, bool progressive)
+{
+  bool failed = 0;
+  FileBuf* fb = &fe->file_buf;
+  if (fb->size < LINES_CACHE_MIN_SIZE) return FRED_get_lines_len(fe); // NOTE: too small for threads too
+  bool write_cache = fe->lines_cache == LINES_CACHE_ON || (fe->lines_cache == LINES_CACHE_AUTO && !fe->read_only);
+  line_starts_settle(&fe->line_starts); // NOTE: the tables get rewritten as a whole
+
+  char* path = sidecar_path(file_path, ".fred-lines");
+  if (path == NULL) ERROR("not enough memory for the lines-cache path.");
+  struct stat sb;
+  if (stat(file_path, &sb) == -1) ERROR("failed to retrieve any info about file '%s'. %s.", file_path, strerror(errno));
+
+  size_t from = 0; // NOTE: where the scan starts, past what the cache had
+  bool cache_is_current = false;
+  int fd = fe->lines_cache == LINES_CACHE_OFF ? -1 : open(path, O_RDONLY | O_CLOEXEC);
+  struct stat csb;
+  if (fd != -1 && fstat(fd, &csb) == 0 && (size_t)csb.st_size >= sizeof(LinesCacheHeader)) {
+    void* map = mmap(NULL, csb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      LinesCacheHeader* h = map;
+      size_t lines = h->lines;
+      size_t items_len = sizeof(*fe->lines_len.items) + sizeof(*fe->lines_width.items) + sizeof(*fe->line_starts.items);
+      bool valid = 0 == memcmp(h->magic, LINES_CACHE_MAGIC, sizeof(h->magic)) &&
+                   lines > 0 && lines <= (csb.st_size - sizeof(*h)) / items_len &&
+                   sizeof(*h) + lines * items_len == (size_t)csb.st_size &&
+                   h->inode == sb.st_ino && h->dev == sb.st_dev && h->tab_width == fe->tab_width &&
+                   h->file_size <= fb->size && h->hash == lines_cache_hash(fb->text, h->file_size);
+      cache_is_current = h->file_size == fb->size && h->mtime_sec == (uint64_t)sb.st_mtim.tv_sec && 
+                         h->mtime_nsec == (uint64_t)sb.st_mtim.tv_nsec;
+      valid = valid && (cache_is_current || h->file_size < fb->size); // NOTE: rewritten in place otherwise
+      if (valid) {
+        LinesLen* ll = &fe->lines_len;
+        LinesWidth* lw = &fe->lines_width;
+        LineStarts* ls = &fe->line_starts;
+        ll->len = lw->len = ls->len = 0;
+        DA_MAYBE_GROW(ll, lines, lines, LinesLen);
+        DA_MAYBE_GROW(lw, lines, lines, LinesWidth);
+        DA_MAYBE_GROW(ls, lines, lines, LineStarts);
+        const char* items = (const char*)(h + 1);
+        memcpy(ll->items, items, lines * sizeof(*ll->items));
+        items += lines * sizeof(*ll->items);
+        memcpy(lw->items, items, lines * sizeof(*lw->items));
+        items += lines * sizeof(*lw->items);
+        memcpy(ls->items, items, lines * sizeof(*ls->items));
+        ll->len = lw->len = ls->len = lines;
+        // NOTE: the last line may go on past the old end
+        from = ls->items[lines - 1];
+        valid = from <= h->file_size;
+      }
+      munmap(map, csb.st_size);
+      if (!valid) from = 0, cache_is_current = false;
+    }
+  }
+  if (fd != -1) close(fd);
+
+  LinesLen* ll = &fe->lines_len;
+  LinesWidth* lw = &fe->lines_width;
+  LineStarts* ls = &fe->line_starts;
+  if (!from) ll->len = lw->len = ls->len = 0;
+
+  if (progressive && !cache_is_current) {
+    // NOTE: the text starts as the lines the cache had, 
+    // with the empty line after their last '\n'
+    size_t row = from ? get_offset_row(fe, from) : 0;
+    ll->len = lw->len = ls->len = row;
+    DA_PUSH(ll, 0, 8, LinesLen);
+    DA_PUSH(lw, 0, 8, LinesWidth);
+    DA_PUSH(ls, from, 8, LineStarts);
+    PieceTable* table = &fe->piece_table;
+    table->len = from ? 1 : 0;
+    if (from) table->items[0] = (Piece){ .which_buf = 0, .is_ascii = lines_are_ascii(fe), .offset = 0, .len = from };
+    fe->disp_col_cache.valid = false;
+    fe->lines_version++;
+    fe->index = (LinesIndex){ .frontier = from, .cache_path = write_cache ? path : NULL, .file_stat = sb };
+    if (write_cache) path = NULL;
+    failed = FRED_index_step(fe, LINES_INDEX_FIRST);
+    if (failed) GOTO_END(1);
+  } else {
+    failed = lines_scan_file(fe, from);
+    if (failed) GOTO_END(1);
+    if (progressive) fe->piece_table.items[0].is_ascii = lines_are_ascii(fe);
+    if (!cache_is_current && write_cache) lines_cache_write(fe, path, &sb);
+  }
+end:
+  free(path);
+  return failed;
+}
+
+
+// DESC: whether no line has a non-ascii byte, as the lines know
+bool lines_are_ascii(FredEditor* fe)
+{
+  LinesWidth* lw = &fe->lines_width;
+  for (size_t i = 0; i < lw->len; i++) {
+    if (!LINE_IS_ASCII(lw->items[i])) return false;
+  }
+  return true;
+}
+
+
+// DESC: end of the slice of about 'len' bytes of the file from 
+// 'start', up to a '\n' or the end of the file
+size_t index_slice_end(FileBuf* fb, size_t start, size_t len)
+{
+  size_t end = fb->size - start > len ? start + len : fb->size;
+  if (end < fb->size) {
+    const char* nl = memchr(fb->text + end, '\n', fb->size - end);
+    end = nl != NULL ? (size_t)(nl - fb->text) + 1 : fb->size;
+  }
+  return end;
+}
+
+
+// DESC: appends the bytes [start, end) of the file to the text, 
+// start being the frontier
+bool index_append(FredEditor* fe, size_t start, size_t end, bool is_ascii)
+{
+  bool failed = 0;
+  LinesIndex* ix = &fe->index;
+  PieceTable* table = &fe->piece_table;
+  Piece* last = table->len ? &table->items[table->len - 1] : NULL;
+  if (last != NULL && !last->which_buf && last->offset + last->len == start) {
+    last->len += end - start;
+    last->is_ascii &= is_ascii;
+  } else {
+    PIECE_TABLE_PUSH(table, ((Piece){ .which_buf = 0, .is_ascii = is_ascii, .offset = start, .len = end - start }));
+  }
+  fe->last_edit.locus_valid = false;
+  ix->frontier = end;
+  ix->done = end == fe->file_buf.size;
+  if (ix->lines_version != fe->lines_version) ix->from_version = fe->lines_version;
+end:
+  return failed;
+}
+
+
+// DESC: after the lines of a slice from 'start' got in: lets go of its 
+// pages, and when the whole file is in, writes the lines-cache if the 
+// text is still just the file
+void index_stepped(FredEditor* fe, size_t start)
+{
+  LinesIndex* ix = &fe->index;
+  FileBuf* fb = &fe->file_buf;
+  PieceTable* table = &fe->piece_table;
+  LineStarts* ls = &fe->line_starts;
+  ix->lines_version = fe->lines_version;
+  file_buf_drop(fb, start, LINE_START(ls, ls->len - 1));
+  if (!ix->done) return;
+  Piece* p = table->items;
+  bool plain_file = table->len == 1 && !p->which_buf && p->offset == 0 && p->len == fb->size;
+  if (ix->cache_path != NULL && plain_file) lines_cache_write(fe, ix->cache_path, &ix->file_stat);
+  free(ix->cache_path);
+  ix->cache_path = NULL;
+}
+
+
+// DESC: appends the next 'len' bytes or so of the file to the text, up 
+// to a '\n', and scans their lines; when the whole file is in, writes 
+// the lines-cache if the text is still just the file
+bool FRED_index_step(FredEditor* fe, size_t len)
+{
+  bool failed = 0;
+  LinesIndex* ix = &fe->index;
+  FileBuf* fb = &fe->file_buf;
+  LineStarts* ls = &fe->line_starts;
+  if (ix->done) return failed;
+  index_stop(fe); // NOTE: its slice would start at the old frontier
+
+  size_t start = ix->frontier;
+  size_t end = index_slice_end(fb, start, len);
+  if (index_append(fe, start, end, FRED_is_ascii(fb->text + start, end - start))) GOTO_END(1);
+  // NOTE: the new text goes on from the start of the last line
+  if (lines_scan_file(fe, LINE_START(ls, ls->len - 1))) GOTO_END(1);
+  index_stepped(fe, start);
+end:
+  return failed;
+}
+
+
+// DESC: steps till line 'row' is in the text (and not just the empty 
+// line after it), or the whole file is; SIZE_MAX for the whole file
+bool FRED_index_until(FredEditor* fe, size_t row)
+{
+  bool failed = 0;
+  while (!fe->index.done && fe->lines_len.len - 1 <= row) {
+    if (FRED_index_step(fe, LINES_INDEX_SLICE)) GOTO_END(1);
+  }
+end:
+  return failed;
+}
+
+
+// DESC: the worker's scan of the slice from 'c->start', its end 
+// found like a step's; guarded like lines_scan_chunk()
+void index_scan_slice(LinesChunk* c, FileBuf* fb)
+{
+  sigjmp_buf guard;
+  if (sigsetjmp(guard, 1)) {
+    file_buf_guard = NULL;
+    c->fault = file_buf_fault;
+    return;
+  }
+  file_buf_guard = &guard;
+  size_t end = index_slice_end(fb, c->start, LINES_INDEX_SLICE);
+  c->end = end == fb->size ? end + 1 : end; // NOTE: the last one gets the empty line after a final '\n'
+  c->is_ascii = FRED_is_ascii(c->text + c->start, end - c->start);
+  lines_scan_lines(c);
+  file_buf_guard = NULL;
+}
+
+
+// DESC: thread body, scans the file from the frontier a slice at a time, 
+// each one waiting in 'ready' till the main loop took the one before
+void* index_worker(void* arg)
+{
+  FredEditor* fe = arg;
+  LinesIndex* ix = &fe->index;
+  FileBuf* fb = &fe->file_buf; // NOTE: left as it is till index_stop()
+  size_t start = ix->frontier;
+  while (start < fb->size) {
+    LinesChunk c = { .fe = fe, .text = fb->text, .size = fb->size, .start = start };
+    index_scan_slice(&c, fb);
+
+    pthread_mutex_lock(&ix->lock);
+    while (ix->has_ready && !ix->stopping) pthread_cond_wait(&ix->taken, &ix->lock);
+    bool stopping = ix->stopping;
+    if (!stopping) {
+      ix->ready = c;
+      ix->has_ready = true;
+    }
+    pthread_mutex_unlock(&ix->lock);
+    if (stopping) {
+      DA_FREE(&c.lines_len, 1);
+      DA_FREE(&c.lines_width, 1);
+      DA_FREE(&c.line_starts, 1);
+      break;
+    }
+    uint64_t one = 1;
+    if (write(ix->event_fd, &one, sizeof(one)) != sizeof(one)) {} // NOTE: can only fail with the count at its max, still readable
+    if (c.failed || c.fault != NULL) break; // NOTE: reported by FRED_index_take()
+    start = c.end;
+  }
+  return NULL;
+}
+
+
+// DESC: starts the worker scanning the rest of the file; if it can't 
+// be started, the main loop goes on with FRED_index_step()
+void FRED_index_start(FredEditor* fe)
+{
+  LinesIndex* ix = &fe->index;
+  if (ix->done || ix->worker_on) return;
+  ix->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (ix->event_fd == -1) return;
+  pthread_mutex_init(&ix->lock, NULL);
+  pthread_cond_init(&ix->taken, NULL);
+  ix->stopping = false;
+  ix->has_ready = false;
+  if (pthread_create(&ix->worker, NULL, index_worker, fe) != 0) {
+    pthread_cond_destroy(&ix->taken);
+    pthread_mutex_destroy(&ix->lock);
+    close(ix->event_fd);
+    return;
+  }
+  ix->worker_on = true;
+}
+
+
+// DESC: stops the worker, dropping the slice it had ready
+void index_stop(FredEditor* fe)
+{
+  LinesIndex* ix = &fe->index;
+  if (!ix->worker_on) return;
+  pthread_mutex_lock(&ix->lock);
+  ix->stopping = true;
+  pthread_cond_signal(&ix->taken);
+  pthread_mutex_unlock(&ix->lock);
+  pthread_join(ix->worker, NULL);
+  if (ix->has_ready) {
+    DA_FREE(&ix->ready.lines_len, 1);
+    DA_FREE(&ix->ready.lines_width, 1);
+    DA_FREE(&ix->ready.line_starts, 1);
+    ix->has_ready = false;
+  }
+  pthread_cond_destroy(&ix->taken);
+  pthread_mutex_destroy(&ix->lock);
+  close(ix->event_fd);
+  ix->worker_on = false;
+}
+
+
+// DESC: puts the slice the worker has ready in the text, like a step 
+// would. If the text still ends with the empty line after a '\n', 
+// the lines the worker scanned get appended as they are, moved to 
+// where the slice is in the text; else (something got typed on 
+// that line) they get scanned again from the start of the last line.
+bool FRED_index_take(FredEditor* fe)
+{
+  bool failed = 0;
+  LinesIndex* ix = &fe->index;
+  LinesLen* ll = &fe->lines_len;
+  LinesWidth* lw = &fe->lines_width;
+  LineStarts* ls = &fe->line_starts;
+  if (!ix->worker_on) return failed;
+  uint64_t count;
+  if (read(ix->event_fd, &count, sizeof(count)) != sizeof(count)) return failed; // NOTE: woken up for nothing
+
+  pthread_mutex_lock(&ix->lock);
+  LinesChunk c = ix->ready;
+  bool has_ready = ix->has_ready;
+  ix->has_ready = false;
+  pthread_cond_signal(&ix->taken);
+  pthread_mutex_unlock(&ix->lock);
+  if (!has_ready) return failed;
+  if (c.fault != NULL) {
+    failed = file_buf_cut_at(fe, c.fault);
+    GOTO_END(failed);
+  }
+  assert(!c.failed, "line-length overflow (max line-length is LINE_LEN_MAX, 4 GiB - 1), " 
+                    "length cannot be stored for later usage");
+  assert(c.start == ix->frontier, "slice at %zu, the frontier is at %zu", c.start, ix->frontier);
+
+  size_t end = c.end > c.size ? c.size : c.end;
+  size_t row = ll->len - 1;
+  size_t text_len = LINE_START(ls, row) + ll->items[row];
+  if (index_append(fe, c.start, end, c.is_ascii)) GOTO_END(1);
+  if (ll->items[row] == 0) {
+    size_t lines = row + c.lines_len.len + (end < c.size);
+    ll->len = lw->len = ls->len = row;
+    line_starts_settle(ls);
+    while (lines > ll->cap) DA_MAYBE_GROW(ll, lines - ll->len, lines, LinesLen);
+    while (lines > lw->cap) DA_MAYBE_GROW(lw, lines - lw->len, lines, LinesWidth);
+    while (lines > ls->cap) DA_MAYBE_GROW(ls, lines - ls->len, lines, LineStarts);
+    memcpy(ll->items + row, c.lines_len.items, c.lines_len.len * sizeof(*ll->items));
+    memcpy(lw->items + row, c.lines_width.items, c.lines_width.len * sizeof(*lw->items));
+    for (size_t i = 0; i < c.line_starts.len; i++) ls->items[row + i] = c.line_starts.items[i] - c.start + text_len;
+    ll->len = lw->len = ls->len = row + c.lines_len.len;
+    if (end < c.size) { // NOTE: the empty line after the slice's last '\n'
+      ll->items[ll->len++] = 0;
+      lw->items[lw->len++] = 0;
+      ls->items[ls->len++] = text_len + end - c.start;
+    }
+    fe->disp_col_cache.valid = false;
+    fe->lines_version++;
+  } else if (lines_scan_file(fe, LINE_START(ls, row))) GOTO_END(1);
+  index_stepped(fe, c.start);
+  if (ix->done) index_stop(fe);
+end:
+  DA_FREE(&c.lines_len, 1);
+  DA_FREE(&c.lines_width, 1);
+  DA_FREE(&c.line_starts, 1);
+  return failed;
+}
+
+
+// DESC: starts following the file of the editor, watched 
+// through 'notify_fd'; a file that can't be watched just isn't followed
+bool FRED_follow_start(FredEditor* fe, const char* file_path, int notify_fd)
+{
+  bool failed = 0;
+  FileFollow* ff = &fe->follow;
+  *ff = (FileFollow){ .fd = -1, .wd = -1 };
+  if (notify_fd == -1) return failed;
+  ff->fd = open(file_path, O_RDONLY | O_CLOEXEC);
+  if (ff->fd == -1) return failed;
+  ff->wd = inotify_add_watch(notify_fd, file_path, IN_MODIFY);
+  if (ff->wd == -1) FRED_follow_stop(fe);
+  ff->changed = true; // NOTE: it may have grown since it was read
+  return failed;
+}
+
+
+// DESC: drops from 'pieces' the bytes of a file-buffer cut to 'size' bytes
+void pieces_cut_file(PieceTable* pieces, size_t size)
+{
+  size_t kept = 0;
+  for (size_t i = 0; i < pieces->len; i++) {
+    Piece p = pieces->items[i];
+    if (!p.which_buf && p.offset >= size) continue;
+    if (!p.which_buf && p.offset + p.len > size) p.len = size - p.offset;
+    pieces->items[kept++] = p;
+  }
+  pieces->len = kept;
+}
+
+
+// DESC: the file under the text got cut to 'size' bytes: the pieces 
+// (and the register's) lose the bytes the file doesn't have any more, 
+// a block insert ends (its cursors hold rows and pieces), and the 
+// lines get scanned again
+bool text_cut_file(FredEditor* fe, size_t size)
+{
+  bool failed = 0;
+  LinesIndex* ix = &fe->index;
+  Cursor* cr = &fe->cursor;
+  pieces_cut_file(&fe->piece_table, size);
+  pieces_cut_file(&fe->reg.pieces, size); // NOTE: the register loses them too
+  if (ix->frontier > size) ix->frontier = size;
+  fe->multi.len = 0;
+  fe->last_edit.locus_valid = false;
+  fe->disp_col_cache.valid = false;
+  if (FRED_get_lines_len(fe)) GOTO_END(1);
+
+  if (cr->row >= fe->lines_len.len) cr->row = fe->lines_len.len - 1;
+  size_t line_len = fe->lines_len.items[cr->row];
+  if (cr->col > line_len) cr->col = line_len;
+  snap_to_char_start(fe);
+end:
+  return failed;
+}
+
+
+// DESC: the followed file got cut to 'size' bytes (a 'copytruncate' 
+// log rotation): the file-buffer is read (or mapped) again from 
+// nothing and the text gets cut like the file
+bool follow_cut(FredEditor* fe, size_t size)
+{
+  bool failed = 0;
+  FileBuf* fb = &fe->file_buf;
+  LinesIndex* ix = &fe->index;
+
+  index_stop(fe);
+  FRED_close_file(fb);
+  *fb = (FileBuf){0};
+  if (file_buf_grow(fb, fe->follow.fd, size)) GOTO_END(1);
+  if (text_cut_file(fe, fb->size)) GOTO_END(1);
+  ix->done = ix->frontier == fb->size;
+end:
+  return failed;
+}
+
+
+// DESC: a read at 'addr' of the mapped file-buffer faulted (see 
+// file_buf_sigbus()), the file got cut under it to at most the bytes 
+// before the page of 'addr'. A followed file gets cut to what fstat() 
+// says it has, like after an event. Any other file keeps its mapping 
+// but the text loses the file's bytes from that page on, the rest 
+// isn't indexed; "[file cut]" shows till the next key, and the reload 
+// that comes with the file's new size decides what the text becomes.
+// Nothing if 'addr' isn't in the file-buffer.
+bool file_buf_cut_at(FredEditor* fe, const char* addr)
+{
+  bool failed = 0;
+  FileBuf* fb = &fe->file_buf;
+  LinesIndex* ix = &fe->index;
+  if (!fb->mapped || addr < fb->text || addr >= fb->text + fb->size) return failed;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t size = (addr - fb->text) / page * page;
+
+  struct stat sb;
+  if (fe->follow.fd != -1 && fstat(fe->follow.fd, &sb) == 0) {
+    if ((size_t)sb.st_size < size) size = sb.st_size;
+    fe->follow.truncated = true;
+    failed = follow_cut(fe, size);
+    return failed;
+  }
+  index_stop(fe);
+  if (text_cut_file(fe, size)) GOTO_END(1);
+  if (!ix->done) {
+    ix->done = true;
+    free(ix->cache_path);
+    ix->cache_path = NULL;
+  }
+  fe->file_cut = true;
+end:
+  return failed;
+}
+
+
+// DESC: looks at the followed file after an event: what got appended 
+// gets into the file-buffer, FRED_index_step() then appends it to the 
+// text a slice at a time. A file that got cut is followed on from 
+// its new end, like 'tail -F'.
+bool FRED_follow_check(FredEditor* fe)
+{
+  bool failed = 0;
+  FileFollow* ff = &fe->follow;
+  FileBuf* fb = &fe->file_buf;
+  ff->changed = false;
+  if (ff->fd == -1) return failed;
+
+  struct stat sb;
+  if (fstat(ff->fd, &sb) == -1) {
+    FRED_follow_stop(fe);
+    return failed;
+  }
+  size_t size = sb.st_size;
+  if (size < fb->size) {
+    ff->truncated = true;
+    if (follow_cut(fe, size)) GOTO_END(1);
+    return failed;
+  }
+  if (size == fb->size) return failed;
+  index_stop(fe); // NOTE: the mapping may move
+  if (file_buf_grow(fb, ff->fd, size)) GOTO_END(1);
+  if (fb->size > fe->index.frontier) {
+    ff->at_end = fe->cursor.row + 1 >= fe->lines_len.len;
+    ff->truncated = false;
+    fe->index.done = false;
+  }
+end:
+  return failed;
+}
+
+
+void FRED_follow_stop(FredEditor* fe)
+{
+  FileFollow* ff = &fe->follow;
+  if (ff->fd != -1) close(ff->fd);
+  ff->fd = -1;
+  ff->wd = -1; // NOTE: the watch goes when the notify fd gets closed
+  ff->changed = false;
+  ff->at_end = false;
+}
+
+
+// DESC: length of the run of bytes 'a' and 'b' start with, at most 
+// 'n'; compared a block at a time, then byte by byte
+size_t common_prefix_len(const char* a, const char* b, size_t n)
+{
+  size_t i = 0;
+  while (n - i >= 4096 && memcmp(a + i, b + i, 4096) == 0) i += 4096;
+  while (i < n && a[i] == b[i]) i++;
+  return i;
+}
+
+
+// DESC: like common_prefix_len(), for the run of bytes 
+// right before 'a_end' and 'b_end'
+size_t common_suffix_len(const char* a_end, const char* b_end, size_t n)
+{
+  size_t i = 0;
+  while (n - i >= 4096 && memcmp(a_end - i - 4096, b_end - i - 4096, 4096) == 0) i += 4096;
+  while (i < n && *(a_end - i - 1) == *(b_end - i - 1)) i++;
+  return i;
+}
+
+
+// DESC: appends an op to the diff, merged into the last one 
+// if of the same kind; empty ones are left out
+bool diff_push(FileDiff* diff, bool equal, size_t old_offset, size_t old_len, size_t new_offset, size_t new_len)
+{
+  bool failed = 0;
+  if (!old_len && !new_len) return failed;
+  FileDiffOp* last = diff->len ? &diff->items[diff->len - 1] : NULL;
+  if (last != NULL && last->equal == equal) { // NOTE: the ops come in order, it's right after it
+    last->old_len += old_len;
+    last->new_len += new_len;
+    return failed;
+  }
+  DA_PUSH(diff, ((FileDiffOp){ .equal = equal, .old_offset = old_offset, .old_len = old_len, 
+                               .new_offset = new_offset, .new_len = new_len }), 64, FileDiff);
+end:
+  return failed;
+}
+
+
+// DESC: end of the chunk of 'text' starting at 'start', before 'end', 
+// with its hash in 'hash': a line on its own with 'lines', else lines up 
+// to one whose hash (FNV-1a, by words) has the RELOAD_CHUNK_MASK bits 0, 
+// so the same lines get cut in the same chunks wherever they are in the file
+size_t diff_chunk_end(const char* text, size_t start, size_t end, bool lines, uint64_t* hash)
+{
+  uint64_t chunk_hash = 14695981039346656037ULL;
+  size_t i = start;
+  while (i < end) {
+    const char* nl = memchr(text + i, '\n', end - i);
+    size_t line_end = nl != NULL ? (size_t)(nl - text) + 1 : end;
+    if (line_end - start > RELOAD_CHUNK_MAX) line_end = start + RELOAD_CHUNK_MAX;
+    uint64_t line_hash = 14695981039346656037ULL ^ (line_end - i);
+    size_t k = i;
+    for (; k + 8 <= line_end; k += 8) { // NOTE: a word at a time, like FRED_is_ascii()
+      uint64_t word;
+      memcpy(&word, text + k, sizeof(word));
+      line_hash = (line_hash ^ word) * 1099511628211ULL;
+    }
+    for (; k < line_end; k++) line_hash = (line_hash ^ (unsigned char)text[k]) * 1099511628211ULL;
+    line_hash ^= line_hash >> 32; // NOTE: the low bits of a product only depend on the low bits
+    chunk_hash = (chunk_hash ^ line_hash) * 1099511628211ULL;
+    i = line_end;
+    if (lines || !(line_hash & RELOAD_CHUNK_MASK) || i - start >= RELOAD_CHUNK_MAX) break;
+  }
+  *hash = chunk_hash;
+  return i;
+}
+
+
+bool diff_chunks(FileDiff* diff, const char* old, size_t a, size_t b, const char* new, size_t c, size_t d, int level);
+
+// DESC: diffs old [a, b) with new [c, d): the bytes both start and end 
+// with are equal runs, the ones in between get matched by chunks 
+// of lines (level 0), then by lines (level 1), and what's left 
+// (level 2) is new bytes replacing old ones
+bool diff_gap(FileDiff* diff, const char* old, size_t a, size_t b, const char* new, size_t c, size_t d, int level)
+{
+  bool failed = 0;
+  size_t n = b - a < d - c ? b - a : d - c;
+  size_t prefix = common_prefix_len(old + a, new + c, n);
+  size_t suffix = common_suffix_len(old + b, new + d, n - prefix);
+  if (diff_push(diff, true, a, prefix, c, prefix)) GOTO_END(1);
+  a += prefix;
+  c += prefix;
+  b -= suffix;
+  d -= suffix;
+  bool matchable = a < b && c < d && (level == 0 || (level == 1 && b - a <= RELOAD_LINES_MAX));
+  if (matchable) failed = diff_chunks(diff, old, a, b, new, c, d, level);
+  else failed = diff_push(diff, false, a, b - a, c, d - c);
+  if (failed) GOTO_END(1);
+  if (diff_push(diff, true, b, suffix, d, suffix)) GOTO_END(1);
+end:
+  return failed;
+}
+
+
+#define DIFF_SLOT(hash, bits) ((size_t)(((hash) * 0x9e3779b97f4a7c15ULL) >> (64 - (bits))))
+
+// DESC: matches the chunks of new [c, d) with the ones of old [a, b): 
+// a chunk that is only once in the old bytes, after the last one 
+// matched, and has the same bytes, is an equal run. The gaps 
+// between them get diffed a level down by diff_gap().
+bool diff_chunks(FileDiff* diff, const char* old, size_t a, size_t b, const char* new, size_t c, size_t d, int level)
+{
+  bool failed = 0;
+  bool lines = level > 0;
+  DiffChunks chunks = {0};
+  size_t* slots = NULL;
+
+  for (size_t i = a; i < b; ) {
+    DiffChunk chunk = { .offset = i };
+    i = diff_chunk_end(old, i, b, lines, &chunk.hash);
+    chunk.len = i - chunk.offset;
+    DA_PUSH(&chunks, chunk, 64, DiffChunks);
+  }
+  size_t bits = 1;
+  while (((size_t)1 << bits) < 2 * chunks.len) bits++;
+  size_t mask = ((size_t)1 << bits) - 1;
+  slots = malloc((mask + 1) * sizeof(*slots));
+  if (slots == NULL) ERROR("not enough memory to diff the reloaded file.");
+  memset(slots, 0xff, (mask + 1) * sizeof(*slots)); // NOTE: SIZE_MAX, a free slot
+  for (size_t k = 0; k < chunks.len; k++) {
+    size_t s = DIFF_SLOT(chunks.items[k].hash, bits);
+    while (slots[s] != SIZE_MAX && chunks.items[slots[s]].hash != chunks.items[k].hash) s = (s + 1) & mask;
+    if (slots[s] == SIZE_MAX) slots[s] = k;
+    else chunks.items[slots[s]].len = 0; // NOTE: no telling which one it'd be
+  }
+
+  size_t old_pos = a, new_pos = c;
+  for (size_t i = c; i < d; ) {
+    size_t start = i;
+    uint64_t hash = 0;
+    i = diff_chunk_end(new, i, d, lines, &hash);
+    size_t s = DIFF_SLOT(hash, bits);
+    while (slots[s] != SIZE_MAX && chunks.items[slots[s]].hash != hash) s = (s + 1) & mask;
+    if (slots[s] == SIZE_MAX) continue;
+    DiffChunk* chunk = &chunks.items[slots[s]];
+    if (chunk->len != i - start || chunk->offset < old_pos || memcmp(old + chunk->offset, new + start, chunk->len)) continue;
+    if (diff_gap(diff, old, old_pos, chunk->offset, new, new_pos, start, level + 1)) GOTO_END(1);
+    if (diff_push(diff, true, chunk->offset, chunk->len, start, chunk->len)) GOTO_END(1);
+    old_pos = chunk->offset + chunk->len;
+    new_pos = i;
+  }
+  if (diff_gap(diff, old, old_pos, b, new, new_pos, d, level + 1)) GOTO_END(1);
+end:
+  DA_FREE(&chunks, 1);
+  free(slots);
+  return failed;
+}
+
+#undef DIFF_SLOT
+
+
+// DESC: the ops turning the 'old' bytes into the 'new' ones. Reading both 
+// is the bulk of it: the diff is quick where they're the same, and 
+// a change costs about its length plus a chunk of lines around it.
+bool file_diff(FileDiff* diff, const char* old, size_t old_size, const char* new, size_t new_size)
+{
+  diff->len = 0;
+  return diff_gap(diff, old, 0, old_size, new, 0, new_size, 0);
+}
+
+
+// DESC: appends a piece to the table, merged into the 
+// last one if its bytes come right after the last one's
+bool reload_push_piece(PieceTable* table, Piece p)
+{
+  bool failed = 0;
+  Piece* last = table->len ? &table->items[table->len - 1] : NULL;
+  if (last != NULL && last->which_buf == p.which_buf && last->offset + last->len == p.offset) {
+    last->len += p.len;
+    last->is_ascii &= p.is_ascii;
+    return failed;
+  }
+  PIECE_TABLE_PUSH(table, p);
+end:
+  return failed;
+}
+
+
+// DESC: appends a change to the list, merged into the last 
+// one if right after it in both texts
+bool reload_push_change(TextChanges* changes, size_t old_offset, size_t old_len, size_t offset, size_t len)
+{
+  bool failed = 0;
+  TextChange* last = changes->len ? &changes->items[changes->len - 1] : NULL;
+  if (last != NULL && last->old_offset + last->old_len == old_offset && last->offset + last->len == offset) {
+    last->old_len += old_len;
+    last->len += len;
+    return failed;
+  }
+  DA_PUSH(changes, ((TextChange){ .old_offset = old_offset, .old_len = old_len, .offset = offset, .len = len }), 
+          64, TextChanges);
+end:
+  return failed;
+}
+
+
+// DESC: the pieces of the text with the file changed as in 'diff' 
+// into 'table', and the bytes of the text that changed into 'changes'. 
+// The file pieces get moved to where their bytes are in the new file, 
+// the edits' pieces stay as they are. The bytes replacing a run of the 
+// old file go where its first byte was, or right after the byte before 
+// them if they replace nothing; only if that byte is still in the text, 
+// so where the edits changed the same bytes the edits win.
+bool reload_pieces(FredEditor* fe, FileDiff* diff, FileBuf* new, PieceTable* table, TextChanges* changes)
+{
+  bool failed = 0;
+  PieceTable* old_table = &fe->piece_table;
+  size_t old_text = 0, text = 0; // NOTE: offsets in the text before and after
+
+  for (size_t i = 0; i < old_table->len; i++) {
+    Piece p = old_table->items[i];
+    if (p.which_buf) {
+      if (reload_push_piece(table, p)) GOTO_END(1);
+      old_text += p.len;
+      text += p.len;
+      continue;
+    }
+    size_t x = p.offset, y = p.offset + p.len;
+    size_t lo = 0, hi = diff->len; // NOTE: first op ending at or after 'x'
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (diff->items[mid].old_offset + diff->items[mid].old_len < x) lo = mid + 1;
+      else hi = mid;
+    }
+    for (size_t k = lo; k < diff->len; k++) {
+      FileDiffOp* op = &diff->items[k];
+      size_t o = op->old_offset, o_end = op->old_offset + op->old_len;
+      if (o > y || (o == y && op->old_len)) break;
+      size_t from = o > x ? o : x, to = o_end < y ? o_end : y;
+      size_t kept = from < to ? to - from : 0; // NOTE: old bytes of the piece in the op
+      if (op->equal) {
+        if (kept && reload_push_piece(table, (Piece){ .which_buf = 0, .is_ascii = p.is_ascii, 
+                                                      .offset = op->new_offset + (from - o), .len = kept })) GOTO_END(1);
+        old_text += kept;
+        text += kept;
+        continue;
+      }
+      bool here = op->old_len ? x <= o && o < y : (x < o && o <= y) || (o == 0 && x == 0);
+      size_t added = here ? op->new_len : 0;
+      if (added && reload_push_piece(table, (Piece){ .which_buf = 0, .is_ascii = FRED_is_ascii(new->text + op->new_offset, added), 
+                                                     .offset = op->new_offset, .len = added })) GOTO_END(1);
+      if ((kept || added) && reload_push_change(changes, old_text, kept, text, added)) GOTO_END(1);
+      old_text += kept;
+      text += added;
+    }
+  }
+  if (!fe->file_buf.size && new->size) { // NOTE: nothing of an empty file to go after, it goes at the end
+    if (reload_push_piece(table, (Piece){ .which_buf = 0, .is_ascii = FRED_is_ascii(new->text, new->size), 
+                                          .offset = 0, .len = new->size })) GOTO_END(1);
+    if (reload_push_change(changes, old_text, 0, text, new->size)) GOTO_END(1);
+  }
+end:
+  return failed;
+}
+
+
+// DESC: appends the lines [from, to) of the text before a reload to 
+// the tables, moved from 'old_start' in it to 'start' in the new one
+bool reload_copy_lines(FredEditor* fe, size_t from, size_t to, size_t old_start, size_t start, 
+                       LinesLen* ll, LinesWidth* lw, LineStarts* ls)
+{
+  bool failed = 0;
+  size_t count = to - from;
+  while (ll->len + count > ll->cap) DA_MAYBE_GROW(ll, count, count, LinesLen);
+  while (lw->len + count > lw->cap) DA_MAYBE_GROW(lw, count, count, LinesWidth);
+  while (ls->len + count > ls->cap) DA_MAYBE_GROW(ls, count, count, LineStarts);
+  memcpy(ll->items + ll->len, fe->lines_len.items + from, count * sizeof(*ll->items));
+  memcpy(lw->items + lw->len, fe->lines_width.items + from, count * sizeof(*lw->items));
+  for (size_t k = 0; k < count; k++) ls->items[ls->len + k] = fe->line_starts.items[from + k] - old_start + start;
+  ll->len += count;
+  lw->len += count;
+  ls->len += count;
+end:
+  return failed;
+}
+
+
+// DESC: the lines of the reloaded text (the one in 'fe' now) into the 
+// tables, from the lines of the text before it (still the ones in 'fe'): 
+// the lines no change touched get copied, moved by what the changes 
+// before them added or removed; only the ones with changes get scanned
+bool reload_lines(FredEditor* fe, TextChanges* changes, LinesLen* ll, LinesWidth* lw, LineStarts* ls)
+{
+  bool failed = 0;
+  LineStarts* old_ls = &fe->line_starts;
+  line_starts_settle(old_ls); // NOTE: copied as they are
+  size_t row = 0; // NOTE: first old line not in the tables yet, 
+  size_t old_start = 0, start = 0; // and where it starts in the old text and in the new one
+  size_t lines = fe->lines_len.len; // NOTE: about as many lines as before
+  DA_MAYBE_GROW(ll, lines, lines, LinesLen);
+  DA_MAYBE_GROW(lw, lines, lines, LinesWidth);
+  DA_MAYBE_GROW(ls, lines, lines, LineStarts);
+
+  size_t i = 0;
+  while (i < changes->len) {
+    TextChange* c = &changes->items[i++];
+    size_t change_row = get_offset_row(fe, c->old_offset);
+    if (reload_copy_lines(fe, row, change_row, old_start, start, ll, lw, ls)) GOTO_END(1);
+    size_t offset = old_ls->items[change_row] - old_start + start;
+    size_t until = c->offset + c->len;
+    size_t next = 0;
+    for (;;) {
+      if (lines_scan_range(fe, offset, until, &next, ll, lw, ls)) GOTO_END(1);
+      // NOTE: the changes starting in the lines just scanned go with them
+      while (next != SIZE_MAX && i < changes->len && changes->items[i].offset < next) {
+        until = changes->items[i].offset + changes->items[i].len;
+        i++;
+      }
+      if (next == SIZE_MAX || until < next) break;
+      offset = next;
+    }
+    if (next == SIZE_MAX) return failed; // NOTE: scanned to the end of the text
+    TextChange* last = &changes->items[i - 1];
+    start = next;
+    old_start = next - (last->offset + last->len) + (last->old_offset + last->old_len);
+    row = get_offset_row(fe, old_start);
+    assert(old_ls->items[row] == old_start, "old offset %zu is not the start of a line", old_start);
+  }
+  if (reload_copy_lines(fe, row, old_ls->len, old_start, start, ll, lw, ls)) GOTO_END(1);
+end:
+  return failed;
+}
+
+
+// DESC: where the byte at 'offset' of the text before a reload is in 
+// the one after it; a byte the reload replaced goes to the start 
+// of the bytes that replaced it
+size_t reload_map_offset(TextChanges* changes, size_t offset)
+{
+  size_t lo = 0, hi = changes->len; // NOTE: changes starting at or before 'offset'
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (changes->items[mid].old_offset <= offset) lo = mid + 1;
+    else hi = mid;
+  }
+  if (!lo) return offset;
+  TextChange* c = &changes->items[lo - 1];
+  if (offset < c->old_offset + c->old_len) return c->offset;
+  return offset - (c->old_offset + c->old_len) + (c->offset + c->len);
+}
+
+
+// DESC: merges in the changes another writer made to the file since it 
+// was read, 'sb' being how it is now: the edits stay, the lines 
+// get moved and only the ones around the changes get scanned again. 
+// If it fails the text stays as it was.
+bool FRED_reload_file(FredEditor* fe, const char* file_path, struct stat* sb)
+{
+#define SWAP(type, a, b) do { type tmp = (a); (a) = (b); (b) = tmp; } while (0)
+  bool failed = 0;
+  bool file_loaded = 0;
+  FileBuf fb = {0};
+  FileDiff diff = {0};
+  PieceTable table = {0};
+  TextChanges changes = {0};
+  LinesLen ll = {0};
+  LinesWidth lw = {0};
+  LineStarts ls = {0};
+  struct stat last = fe->reload.file_stat;
+  fe->reload.file_stat = *sb; // NOTE: tried once per change, merged in or not
+
+  if (FRED_index_until(fe, SIZE_MAX)) GOTO_END(1);
+  if (FRED_open_file(&fb, file_path)) GOTO_END(1);
+  file_loaded = 1;
+  FileBuf* old = &fe->file_buf;
+  // NOTE: a mapped file written over in place (not replaced by a new file) 
+  // shows the new bytes through the mapping already, the old ones are gone. 
+  // A text that is still the file becomes the new one, all the lines get 
+  // scanned again; but with edits the file pieces would show the new bytes 
+  // at the old offsets, spliced into the edits: there is nothing left to 
+  // merge them with, the text only loses what the file lost and conflicts
+  bool in_place = old->mapped && last.st_ino == sb->st_ino && last.st_dev == sb->st_dev;
+  if (in_place && !text_is_file(fe)) {
+    fe->reload.conflict = true;
+    if (text_cut_file(fe, old->size < fb.size ? old->size : fb.size)) GOTO_END(1);
+    GOTO_END(0);
+  }
+  if (in_place) {
+    size_t kept = old->size < fb.size ? old->size : fb.size;
+    if (diff_push(&diff, true, 0, kept, 0, kept)) GOTO_END(1);
+    if (diff_push(&diff, false, kept, old->size - kept, kept, fb.size - kept)) GOTO_END(1);
+  } else if (file_diff(&diff, old->text, old->size, fb.text, fb.size)) GOTO_END(1);
+  if (reload_pieces(fe, &diff, &fb, &table, &changes)) GOTO_END(1);
+
+  size_t old_text_len = FRED_text_len(fe);
+  size_t cursor_offset = get_line_offset(fe, fe->cursor.row) + fe->cursor.col;
+  size_t text_len = 0;
+  for (size_t i = 0; i < table.len; i++) text_len += table.items[i].len;
+  if (in_place) {
+    changes.len = 0;
+    if (reload_push_change(&changes, 0, old_text_len, 0, text_len)) GOTO_END(1);
+  }
+
+  if (register_detach(fe)) GOTO_END(1);
+  // NOTE: from here the new text is in 'fe' and the old one in the locals, freed at the end
+  SWAP(PieceTable, fe->piece_table, table);
+  SWAP(FileBuf, fe->file_buf, fb);
+  if (changes.len && reload_lines(fe, &changes, &ll, &lw, &ls)) {
+    SWAP(PieceTable, fe->piece_table, table);
+    SWAP(FileBuf, fe->file_buf, fb);
+    GOTO_END(1);
+  }
+  if (changes.len) {
+    SWAP(LinesLen, fe->lines_len, ll);
+    SWAP(LinesWidth, fe->lines_width, lw);
+    SWAP(LineStarts, fe->line_starts, ls);
+  }
+  fe->lines_version++;
+  fe->disp_col_cache.valid = false;
+  fe->last_edit.locus_valid = false;
+  fe->index.frontier = fe->file_buf.size;
+
+  size_t offset = in_place ? (cursor_offset < text_len ? cursor_offset : text_len) : reload_map_offset(&changes, cursor_offset);
+  fe->cursor.row = get_offset_row(fe, offset);
+  fe->cursor.col = offset - get_line_offset(fe, fe->cursor.row);
+  snap_to_char_start(fe);
+  fe->reload.reloaded = true;
+  if (journal_restart(fe, file_path, sb)) GOTO_END(1);
+end:
+  if (file_loaded) FRED_close_file(&fb);
+  DA_FREE(&diff, 1);
+  DA_FREE(&table, 1);
+  DA_FREE(&changes, 1);
+  DA_FREE(&ll, 1);
+  DA_FREE(&lw, 1);
+  DA_FREE(&ls, 1);
+  return failed;
+#undef SWAP
+}
+
+
+// DESC: merges in what another writer changed in the file since it was 
+// read (or saved), told by its inode, size and mtime like the lines-cache. 
+// A file that's gone is left to the text, saving it makes it again; 
+// a text in conflict with its file is left as it is.
+bool FRED_reload_check(FredEditor* fe, const char* file_path)
+{
+  bool failed = 0;
+  struct stat sb;
+  struct stat* last = &fe->reload.file_stat;
+  if (fe->reload.conflict) return failed;
+  if (stat(file_path, &sb) == -1 || (sb.st_mode & S_IFMT) != S_IFREG) return failed;
+  if (sb.st_ino == last->st_ino && sb.st_dev == last->st_dev && sb.st_size == last->st_size && 
+      sb.st_mtim.tv_sec == last->st_mtim.tv_sec && sb.st_mtim.tv_nsec == last->st_mtim.tv_nsec) return failed;
+  failed = FRED_reload_file(fe, file_path, &sb);
+  return failed;
+}
+
+
+// DESC: whether the text is still the file as read, or the start of 
+// it: its pieces are all the file's bytes in order from the first
+bool text_is_file(FredEditor* fe)
+{
+  PieceTable* table = &fe->piece_table;
+  size_t offset = 0;
+  for (size_t i = 0; i < table->len; i++) {
+    Piece p = table->items[i];
+    if (p.which_buf || p.offset != offset) return false;
+    offset += p.len;
+  }
+  return true;
+}
+
+
+// DESC: whether the lines changed since 'version' only by steps 
+// appending to the text, so a cache built for them can be extended 
+// from its last line instead of being built again
+bool lines_only_appended(FredEditor* fe, size_t version)
+{
+  LinesIndex* ix = &fe->index;
+  return ix->from_version && version >= ix->from_version && version != fe->lines_version &&
+         ix->lines_version == fe->lines_version;
+}
+
+
+// DESC: shifts by 'delta' (wrapping, to shift them back) the starts 
+// of the lines from 'from' on. Only the lines between the pending 
+// shift and 'from' get touched, the rest just adds to the pending 
+// shift, so edits on the same line don't touch the lines below it.
+void line_starts_shift(LineStarts* ls, size_t from, size_t delta)
+{
+  if (!ls->shift) {
+    ls->shift_from = from;
+  } else if (from > ls->shift_from) {
+    size_t to = from < ls->len ? from : ls->len;
+    for (size_t r = ls->shift_from; r < to; r++) ls->items[r] += ls->shift;
+    ls->shift_from = from;
+  } else {
+    size_t to = ls->shift_from < ls->len ? ls->shift_from : ls->len;
+    for (size_t r = from; r < to; r++) ls->items[r] += delta;
+  }
+  ls->shift += delta;
+}
+
+
+// DESC: applies the pending shift to all the lines, for the code 
+// reading or rewriting 'items' as a whole
+void line_starts_settle(LineStarts* ls)
+{
+  for (size_t r = ls->shift_from; ls->shift && r < ls->len; r++) ls->items[r] += ls->shift;
+  ls->shift_from = ls->shift = 0;
+}
+
+
+// DESC: offset of the first char of line 'row' in the fully built text
+size_t get_line_offset(FredEditor* fe, size_t row)
+{
+  LineStarts* ls = &fe->line_starts;
+  if (!ls->len) return 0;
+  if (row < ls->len) return LINE_START(ls, row);
+  return FRED_text_len(fe) + 1; // NOTE: as if every line ended with '\n' 
+}
+
+
+// DESC: line the byte at 'offset' belongs to, 
+// a '\n' belongs to the line it ends
+size_t get_offset_row(FredEditor* fe, size_t offset)
+{
+  LineStarts* ls = &fe->line_starts;
+  size_t lo = 0, hi = ls->len; // NOTE: last line starting at or before 'offset'
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (LINE_START(ls, mid) <= offset) lo = mid;
+    else hi = mid;
+  }
+  return lo;
+}
+
+
+size_t FRED_text_len(FredEditor* fe)
+{
+  LineStarts* ls = &fe->line_starts;
+  if (!ls->len || !fe->lines_len.len) return 0;
+  return LINE_START(ls, ls->len - 1) + fe->lines_len.items[fe->lines_len.len - 1];
+}
+
+
+// DESC: returns the char at 'offset' in the fully built text, 0 if past the end
+char FRED_char_at(FredEditor* fe, size_t offset)
+{
+  PieceIter it = piece_iter_at(fe, offset);
+  return piece_iter_char(&it);
+}
+
+
+// DESC: points the iterator to its piece's text, 
+// skipping empty pieces, if any
+void piece_iter_load(PieceIter* it)
+{
+  PieceTable* table = &it->fe->piece_table;
+  while (it->piece_idx < table->len && !table->items[it->piece_idx].len) it->piece_idx++;
+  if (it->piece_idx >= table->len) {
+    it->piece_idx = table->len;
+    it->piece_offset = 0;
+    it->piece_text = NULL;
+    return;
+  }
+  Piece* p = &table->items[it->piece_idx];
+  it->piece_text = (!p->which_buf ? it->fe->file_buf.text : it->fe->add_buf.items) + p->offset;
+}
+
+
+// DESC: iterator on the byte at 'offset', or past 
+// the last byte if 'offset' is past the end
+PieceIter piece_iter_at(FredEditor* fe, size_t offset)
+{
+  PieceIter it = { .fe = fe, .piece_text = NULL, .piece_idx = 0, .piece_offset = 0, .offset = 0 };
+  piece_iter_load(&it);
+  piece_iter_seek(&it, offset);
+  return it;
+}
+
+
+// DESC: iterator on the first byte of line 'row'
+PieceIter piece_iter_at_line(FredEditor* fe, size_t row)
+{
+  return piece_iter_at(fe, get_line_offset(fe, row));
+}
+
+
+// DESC: moves the iterator to 'offset' walking the pieces 
+// from the current one, so nearby seeks are cheap
+void piece_iter_seek(PieceIter* it, size_t offset)
+{
+  PieceTable* table = &it->fe->piece_table;
+  if (offset >= it->offset) {
+    piece_iter_skip(it, offset - it->offset);
+    return;
+  }
+  size_t piece_start = it->offset - it->piece_offset;
+  while (offset < piece_start) {
+    it->piece_idx--;
+    piece_start -= table->items[it->piece_idx].len;
+  }
+  it->piece_offset = offset - piece_start;
+  it->offset = offset;
+  piece_iter_load(it);
+}
+
+
+// DESC: bytes from the iterator to the end of its piece, 
+// so scanners can process them with memchr() and the like
+PieceSpan piece_iter_span(PieceIter* it)
+{
+  PieceTable* table = &it->fe->piece_table;
+  if (it->piece_text == NULL) return (PieceSpan){ .text = NULL, .len = 0, .is_ascii = true };
+  Piece* p = &table->items[it->piece_idx];
+  return (PieceSpan){ 
+    .text = it->piece_text + it->piece_offset, 
+    .len = p->len - it->piece_offset, 
+    .is_ascii = p->is_ascii,
+  };
+}
+
+
+// DESC: moves 'n' bytes forward, returns false if it went past the end
+bool piece_iter_skip(PieceIter* it, size_t n)
+{
+  PieceTable* table = &it->fe->piece_table;
+  while (it->piece_text != NULL) {
+    size_t left = table->items[it->piece_idx].len - it->piece_offset;
+    if (n < left) {
+      it->piece_offset += n;
+      it->offset += n;
+      return true;
+    }
+    n -= left;
+    it->offset += left;
+    it->piece_idx++;
+    it->piece_offset = 0;
+    // NOTE: the pieces skipped whole only need their length, the 
+    // text of the one landed on gets loaded once
+    while (it->piece_idx < table->len && n >= table->items[it->piece_idx].len) {
+      n -= table->items[it->piece_idx].len;
+      it->offset += table->items[it->piece_idx].len;
+      it->piece_idx++;
+    }
+    piece_iter_load(it);
+  }
+  return false;
+}
+
+
+// DESC: moves to the next byte, returns false if there's none
+bool piece_iter_next(PieceIter* it)
+{
+  if (it->piece_text == NULL) return false;
+  it->offset++;
+  if (++it->piece_offset < it->fe->piece_table.items[it->piece_idx].len) return true;
+  it->piece_idx++;
+  it->piece_offset = 0;
+  piece_iter_load(it);
+  return it->piece_text != NULL;
+}
+
+
+// DESC: moves to the previous byte, returns false if there's none
+bool piece_iter_prev(PieceIter* it)
+{
+  PieceTable* table = &it->fe->piece_table;
+  if (!it->offset) return false;
+  it->offset--;
+  if (it->piece_text != NULL && it->piece_offset) {
+    it->piece_offset--;
+    return true;
+  }
+  while (table->items[--it->piece_idx].len == 0);
+  it->piece_offset = table->items[it->piece_idx].len - 1;
+  piece_iter_load(it);
+  return true;
+}
+
+
+// DESC: byte the iterator is on, 0 if past the end
+char piece_iter_char(PieceIter* it)
+{
+  if (it->piece_text == NULL) return 0;
+  return it->piece_text[it->piece_offset];
+}
+
+
+// DESC: returns the display column of byte 'col' in line 'row'.
+// Ascii lines without tabs have the same display width as their 
+// length, so only lines with tabs or utf-8 get scanned, and the result 
+// for the cursor's position is cached until the cursor or the text changes.
+size_t FRED_get_disp_col(FredEditor* fe, size_t row, size_t col)
+{
+  LinesLen* ll = &fe->lines_len;
+  LinesWidth* lw = &fe->lines_width;
+  DispColCache* cache = &fe->disp_col_cache;
+
+  if (row >= ll->len || row >= lw->len) return col;
+  if (LINE_IS_ASCII(lw->items[row]) && ll->items[row] == lw->items[row]) return col;
+  if (cache->valid && cache->row == row && cache->col == col) return cache->disp_col;
+
+  Utf8Decoder decoder = {0};
+  size_t disp_col = 0;
+  size_t chars_left = col;
+  PieceIter it = piece_iter_at_line(fe, row);
+  PieceSpan span;
+  while (chars_left && (span = piece_iter_span(&it)).len) {
+    size_t n = span.len < chars_left ? span.len : chars_left;
+    for (size_t j = 0; j < n; j++) {
+      disp_col += utf8_cells(&decoder, span.text[j], disp_col, fe->tab_width);
+    }
+    chars_left -= n;
+    piece_iter_skip(&it, n);
+  }
+
+  *cache = (DispColCache){ .row = row, .col = col, .disp_col = disp_col, .valid = true };
+  return disp_col;
+}
+
+
+
+// DESC: the keyword id of 'word', 0 if it's not one
+KeywordId kw_match(const char* word, size_t word_len)
+{
+#define match(match)(0 == memcmp(word, (match), word_len))
+  switch (word_len) {
+    case 2: {
+      if (word[0] == 'i' && word[1] == 'f') return KW_IF;
+      break;
+    }
+    case 3: {
+      if (word[0] == 'f' && match("for")) return KW_FOR;
+      else if (word[0] == '#' && match("#if")) return KW_IF_PREPROC;
+      break;
+    }
+    case 4: {
+      if (word[0] == 'e' && match("else")) return KW_ELSE;
+      break;
+    }
+    case 5: {
+      if (word[0] == 'w' && match("while")) return KW_WHILE;
+      else if (word[0] == '#' && match("#else")) return KW_ELSE_PREPROC;
+      break;
+    }
+    case 6: {
+      if (word[0] == 'r' && match("return")) return KW_RETURN;
+      else if (word[0] == '#' && match("#ifdef")) return KW_IFDEF;
+      else if (match("#endif")) return KW_ENDIF;
+      break;
+    }
+    case 7: {
+      if (word[1] == 'd' && match("#define")) return KW_DEFINE;
+      else if (word[1] == 'i' && match( "#ifndef")) return KW_IFNDEF;
+      break;
+    }
+    case 8: {
+      if (word[0] == 'c' && match("continue")) return KW_CONTINUE;
+      else if (word[0] == '#' && match( "#include")) return KW_INCLUDE;
+    }
+  }
+  return 0;
+#undef match
+}
+
+
+// DESC: feeds 'c' to the keyword-matching; returns the id of the 
+// keyword (or comment) found, which starts 'kw_len' bytes before 
+// 'c', or 0 if none. A keyword is only found once the byte after 
+// it is read, a comment once the byte after the '//'.
+KeywordId kw_scan(KwScanner* ks, char c, size_t* kw_len)
+{
+  KeywordId kw_id = 0;
+
+  if (ks->word[0] == '/' && ks->word[1] == '/') {
+    kw_id = KW_COMMENT;
+    *kw_len = ks->word_len;
+    ks->is_comment = true;
+    ks->word_len = 0;
+    memset(ks->word, 0, KW_MAX_WORD_LEN);
+  }
+
+  if (!ks->is_comment) {
+    if (ks->word_len >= KW_MAX_WORD_LEN) {
+      memset(ks->word, 0, KW_MAX_WORD_LEN);
+      ks->word_len = 0;
+
+    } else if (!IS_KW_WORD_CH(c)) {
+      kw_id = kw_match(ks->word, ks->word_len);
+      *kw_len = ks->word_len;
+      memset(ks->word, 0, KW_MAX_WORD_LEN);
+      ks->word_len = 0;
+    } else {
+      ks->word[ks->word_len++] = c;
+    }
+  }
+
+  if (c == '\n') ks->is_comment = false;
+  return kw_id;
+}
+
+
+// DESC: whether a '//' comment starts in the first 'len' bytes 
+// from 'it', a line start; same rule as kw_scan(), the '//' has 
+// to start a word. Looks only at the '/' found by memchr().
+bool comment_starts_within(PieceIter it, size_t len)
+{
+  char prev = '\n'; // NOTE: byte before the span, a line start is a word start
+  bool slash_starts_word = false; // NOTE: the span before ended with a '/' starting a word
+  PieceSpan span;
+  while (len && (span = piece_iter_span(&it)).len) {
+    size_t n = span.len < len ? span.len : len;
+    const char* text = span.text;
+    if (slash_starts_word && text[0] == '/') return true;
+
+    const char* slash = text;
+    while ((slash = memchr(slash, '/', n - (slash - text))) != NULL) {
+      char before = slash > text ? slash[-1] : prev;
+      if (!IS_KW_WORD_CH(before) && slash + 1 < text + n && slash[1] == '/') return true;
+      slash++;
+    }
+    slash_starts_word = text[n - 1] == '/' && !IS_KW_WORD_CH(n > 1 ? text[n - 2] : prev);
+    prev = text[n - 1];
+    len -= n;
+    piece_iter_skip(&it, n);
+  }
+  return false;
+}
+
+
+// DESC: byte of line 'row' where the no-wrap layout starts: the first 
+// char not ending before display column 'left_col', with the column 
+// it starts at in 'start_col'. Ascii lines as wide as they're long 
+// map columns to bytes directly, the others get walked from the 
+// line start, jumping from tab to tab with memchr() on ascii spans.
+size_t nowrap_line_start(FredEditor* fe, PieceIter* it, size_t row, size_t left_col, size_t* start_col)
+{
+  size_t line_len = fe->lines_len.items[row];
+  uint32_t line_width = fe->lines_width.items[row];
+  if (LINE_IS_ASCII(line_width) && LINE_WIDTH(line_width) == line_len) {
+    *start_col = left_col < line_len ? left_col : line_len;
+    return *start_col;
+  }
+
+  piece_iter_seek(it, get_line_offset(fe, row));
+  Utf8Decoder decoder = {0};
+  size_t col = 0, pos = 0, char_start = 0;
+  PieceSpan span;
+  while (pos < line_len && (span = piece_iter_span(it)).len) {
+    size_t n = span.len < line_len - pos ? span.len : line_len - pos;
+    size_t j = 0;
+    if (span.is_ascii) {
+      decoder.left = 0;
+      while (j < n) {
+        const char* tab = memchr(span.text + j, '\t', n - j);
+        size_t run = (tab ? (size_t)(tab - span.text) : n) - j;
+        if (col + run > left_col) {
+          *start_col = left_col;
+          return pos + j + (left_col - col);
+        }
+        col += run;
+        j += run;
+        if (!tab) break;
+        size_t cells = fe->tab_width - col % fe->tab_width;
+        if (col + cells > left_col) {
+          *start_col = col;
+          return pos + j;
+        }
+        col += cells;
+        j++;
+      }
+      char_start = pos + n;
+    } else {
+      for (; j < n; j++) {
+        size_t cells = utf8_cells(&decoder, span.text[j], col, fe->tab_width);
+        if (decoder.left) continue;
+        if (col + cells > left_col) {
+          *start_col = col;
+          return char_start;
+        }
+        col += cells;
+        char_start = pos + j + 1;
+      }
+    }
+    pos += n;
+    piece_iter_skip(it, n);
+  }
+  *start_col = col;
+  return line_len;
+}
+
+
+// DESC: gives 'attr' to 'len' cells of text from 'idx', skipping 
+// the line-number columns of the rows they wrap into and stopping 
+// at the status-row; keywords are painted once they're matched, 
+// after their cells got written.
+void paint_cells(TermWin* tw, size_t idx, size_t len, CellAttr attr)
+{
+  size_t last_row_offset = tw->size - tw->width;
+  for (; len && idx < last_row_offset; idx++) {
+    if (idx % tw->width < (size_t)tw->linenum_width) continue;
+    tw->attrs[idx] = attr;
+    len--;
+  }
+  tw->has_attrs = true;
+}
+
+
+// DESC: no-wrap layout, each line takes one row cut to the display 
+// columns [hscroll, hscroll + row width). Only the bytes of each 
+// line up to the right edge get read, straight from the pieces, 
+// so long lines cost as much as short ones; keywords and comments 
+// are matched on the same bytes, starting from the word the left 
+// edge falls in, and painted where they're visible.
+bool get_text_to_render_nowrap(FredEditor* fe, TermWin* tw)
+{
+#define PAINT_COLS(row_offset, from_col, to_col, attr) do {                                       \
+  size_t vis_start = (from_col) > left_col ? (from_col) : left_col;                              \
+  size_t vis_end = (to_col) < right_col ? (to_col) : right_col;                                  \
+  if (vis_start < vis_end) {                                                                     \
+    paint_cells(tw, (row_offset) + tw->linenum_width + (vis_start - left_col), vis_end - vis_start, (attr)); \
+  }                                                                                              \
+} while (0)
+
+  bool failed = 0;
+  LinesLen* ll = &fe->lines_len;
+  size_t last_row_offset = tw->size - tw->width;
+  size_t left_col = tw->hscroll;
+  size_t right_col = tw->hscroll + (tw->width - tw->linenum_width);
+
+  PieceIter it = piece_iter_at_line(fe, tw->lines_to_scroll);
+  for (size_t tw_row = 0, line = tw->lines_to_scroll; line < ll->len; tw_row++, line++) {
+    size_t row_offset = tw_row * tw->width;
+    if (row_offset >= last_row_offset) break;
+    TW_WRITE_LINENUM_AT(tw, row_offset, line + 1);
+
+    size_t line_start = get_line_offset(fe, line);
+    size_t line_len = ll->items[line];
+    size_t start_col = 0;
+    size_t start = nowrap_line_start(fe, &it, line, left_col, &start_col);
+
+    // NOTE: back to the start of the word the left edge falls in, 
+    // those bytes are 1 column wide keyword chars
+    size_t word_start = start;
+    piece_iter_seek(&it, line_start + start);
+    while (word_start && start - word_start < KW_MAX_WORD_LEN && piece_iter_prev(&it) && IS_KW_WORD_CH(piece_iter_char(&it))) {
+      word_start--;
+    }
+    piece_iter_seek(&it, line_start);
+    KwScanner ks = { .is_comment = comment_starts_within(it, word_start) };
+
+    Utf8Decoder decoder = {0};
+    size_t col = start_col - (start - word_start);
+    bool in_comment = ks.is_comment;
+    size_t end = line_len + (line + 1 < ll->len); // NOTE: the '\n' ends the line's last word
+    bool past_edge = false, done = false;
+
+    piece_iter_seek(&it, line_start + word_start);
+    size_t pos = word_start;
+    PieceSpan span;
+    while (!done && pos < end && (span = piece_iter_span(&it)).len) {
+      size_t n = span.len < end - pos ? span.len : end - pos;
+      size_t j = 0;
+      for (; j < n && !done; j++) {
+        char c = span.text[j];
+        size_t kw_len = 0;
+        KeywordId kw_id = kw_scan(&ks, c, &kw_len);
+        if (kw_id == KW_COMMENT) {
+          PAINT_COLS(row_offset, col - kw_len, col, COMMENT_ATTR);
+          in_comment = true;
+        } else if (kw_id) {
+          PAINT_COLS(row_offset, col - kw_len, col, KW_ATTR);
+        }
+        // NOTE: past the right edge only to finish the word being matched
+        if (c == '\n' || (past_edge && !ks.word_len)) {
+          done = true;
+          continue;
+        }
+
+        size_t cells = utf8_cells(&decoder, c, col, fe->tab_width);
+        if (decoder.left) continue;
+        bool is_cp = (unsigned char)c >= 0x80;
+        if (is_cp && cells > 1 && col + cells > right_col) past_edge = true; // NOTE: wide chars are not cut at the right edge
+        for (size_t k = 0; k < cells && !past_edge; k++) {
+          size_t cell_col = col + k;
+          if (cell_col < left_col) continue;
+          size_t idx = row_offset + tw->linenum_width + (cell_col - left_col);
+          if (is_cp && col >= left_col) { // NOTE: a wide char cut at the left edge is left blank
+            tw->cps[idx] = k == 0 ? decoder.cp : CP_WIDE_CONT;
+            tw->has_utf8 = true;
+          }
+          tw->elems[idx] = (c == '\t' || is_cp) ? SPACE_CH : c;
+          if (in_comment) {
+            tw->attrs[idx] = COMMENT_ATTR;
+            tw->has_attrs = true;
+          }
+          if (cell_col + 1 >= right_col) break;
+        }
+        col += cells;
+        if (col >= right_col) past_edge = true;
+      }
+      pos += j;
+      piece_iter_skip(&it, j);
+    }
+  }
+
+  return failed;
+#undef PAINT_COLS
+}
+
+
+// DESC: wrapped layout, each line takes as many rows as it needs. 
+// Only the lines on the screen get read, straight from the pieces, 
+// and their keywords and comments matched on the same bytes; since 
+// the matching starts over at every line start, nothing about the 
+// lines above the screen is needed. Keywords get painted back from 
+// their first cell once matched, comments from the '//' on.
+bool get_text_to_render_wrap(FredEditor* fe, TermWin* tw)
+{
+  bool failed = 0;
+  LinesLen* ll = &fe->lines_len;
+  size_t last_row_offset = tw->size - tw->width;
+
+  size_t tw_elems_idx = tw->linenum_width;
+  size_t tw_col = tw->linenum_width;
+  PieceIter it = piece_iter_at_line(fe, tw->lines_to_scroll);
+  for (size_t line = tw->lines_to_scroll; line < ll->len && tw_elems_idx < last_row_offset; line++) {
+    if (line > tw->lines_to_scroll) TW_WRITE_LINENUM_AT(tw, tw_elems_idx - tw->linenum_width, line + 1);
+
+    KwScanner ks = {0};
+    Utf8Decoder decoder = {0};
+    size_t line_col = 0; // NOTE: display column inside the line, for tab-stops
+    size_t word_start = 0; // NOTE: cell of the first char of the word being matched
+    bool in_comment = false;
+    size_t end = ll->items[line] + (line + 1 < ll->len); // NOTE: the '\n' ends the line's last word
+    bool past_end = false, done = false;
+
+    piece_iter_seek(&it, get_line_offset(fe, line));
+    size_t pos = 0;
+    PieceSpan span;
+    while (!done && pos < end && (span = piece_iter_span(&it)).len) {
+      size_t n = span.len < end - pos ? span.len : end - pos;
+      size_t j = 0;
+      for (; j < n && !done; j++) {
+        char c = span.text[j];
+        size_t kw_len = 0;
+        KeywordId kw_id = kw_scan(&ks, c, &kw_len);
+        if (kw_id == KW_COMMENT) {
+          paint_cells(tw, word_start, kw_len, COMMENT_ATTR);
+          in_comment = true;
+        } else if (kw_id) {
+          paint_cells(tw, word_start, kw_len, KW_ATTR); // NOTE: cut by the status-row if it doesn't fit
+        }
+        // NOTE: past the end of the screen only to finish the word being matched
+        if (c == '\n' || (past_end && !ks.word_len)) {
+          done = true;
+          continue;
+        }
+        if (past_end) continue;
+
+        // NOTE: tabs are expanded into spaces up to the next tab-stop, 
+        // multi-byte chars take their cells once their last byte is read
+        size_t cells = utf8_cells(&decoder, c, line_col, fe->tab_width);
+        bool is_cp = (unsigned char)c >= 0x80;
+        line_col += cells;
+        if (is_cp && cells > 1 && tw_col + cells > tw->width) { // NOTE: wide chars are not split between rows
+          tw_elems_idx += (tw->width - tw_col) + tw->linenum_width;
+          tw_col = tw->linenum_width;
+        }
+        for (size_t k = 0; k < cells && tw_elems_idx < last_row_offset; k++) {
+          if (tw_col + 1 > tw->width) {
+            tw_elems_idx += tw->linenum_width;
+            tw_col = tw->linenum_width;
+            if (tw_elems_idx >= last_row_offset) break;
+          }
+          if (is_cp) {
+            tw->cps[tw_elems_idx] = k == 0 ? decoder.cp : CP_WIDE_CONT;
+            tw->has_utf8 = true;
+          }
+          if (ks.word_len == 1) word_start = tw_elems_idx; // NOTE: keyword chars are 1 cell wide
+          if (in_comment) tw->attrs[tw_elems_idx] = COMMENT_ATTR;
+          tw->elems[tw_elems_idx++] = (c == '\t' || is_cp) ? SPACE_CH : c;
+          tw_col++;
+        }
+        if (tw_elems_idx >= last_row_offset) past_end = true;
+      }
+      pos += j;
+      piece_iter_skip(&it, j);
+    }
+
+    tw_elems_idx += (tw->width - tw_col) + tw->linenum_width;
+    if (tw_col == tw->width) { // NOTE: a full last row is followed by the one the 
+      tw_elems_idx += tw->width; // cursor takes at end of line, like the RowIndex counts it
+    }
+    tw_col = tw->linenum_width;
+  }
+
+  return failed;
+}
+
+
+// DESC: places the editor's text char-by-char
+// into TermWin array, with the look of keywords 
+// and comments in the cells they take.
+bool FRED_get_text_to_render(FredEditor* fe, TermWin* tw, bool insert)
+{
+  bool failed = 0;
+
+  memset(tw->elems, SPACE_CH, tw->size);
+  if (tw->has_utf8) {
+    memset(tw->cps, 0, tw->size * sizeof(*tw->cps));
+    tw->has_utf8 = false;
+  }
+  if (tw->has_attrs) {
+    memset(tw->attrs, 0, tw->size * sizeof(*tw->attrs));
+    tw->has_attrs = false;
+  }
+
+  LinesLen* ll = &fe->lines_len;
+  Cursor* cr = &fe->cursor;
+
+  size_t last_row_offset = tw->size - tw->width;
+  {
+    size_t curs_offset = last_row_offset + tw->width - 1;
+    CmdLine* cl = &fe->cmdline;
+    tw->cmdline_col = 0;
+    if (cl->active) {
+      size_t cl_len = cl->len + 1 < tw->width / 2 ? cl->len : tw->width / 2 - 1;
+      tw->elems[last_row_offset] = cl->kind;
+      memcpy(tw->elems + last_row_offset + 1, cl->items + (cl->len - cl_len), cl_len);
+      tw->cmdline_col = cl_len + 1;
+    } else {
+      char* mode = insert ? "-- INSERT --" : fe->multi.selecting ? "-- VISUAL BLOCK --" : 
+                   fe->visual.kind == 'v' ? "-- VISUAL --" : fe->visual.kind == 'V' ? "-- VISUAL LINE --" : "-- NORMAL --";
+      memcpy(tw->elems + last_row_offset + 2, mode, strlen(mode));
+      size_t label_start = 2 + strlen(mode) + 2;
+      if (fe->read_only) {
+        char* read_only = "[read-only]";
+        if (tw->width > label_start + strlen(read_only) + 12) {
+          memcpy(tw->elems + last_row_offset + label_start, read_only, strlen(read_only));
+          label_start += strlen(read_only) + 1;
+        }
+      }
+      if (fe->follow.truncated) {
+        char* truncated = "[truncated]";
+        if (tw->width > label_start + strlen(truncated) + 12) {
+          memcpy(tw->elems + last_row_offset + label_start, truncated, strlen(truncated));
+          label_start += strlen(truncated) + 1;
+        }
+      }
+      if (fe->reload.conflict) { // NOTE: the file got written over in place under the edits
+        char* conflict = "[conflict]";
+        if (tw->width > label_start + strlen(conflict) + 12) {
+          memcpy(tw->elems + last_row_offset + label_start, conflict, strlen(conflict));
+          label_start += strlen(conflict) + 1;
+        }
+      }
+      if (fe->file_cut) { // NOTE: the text lost the bytes cut from the file under it
+        char* cut = "[file cut]";
+        if (tw->width > label_start + strlen(cut) + 12) {
+          memcpy(tw->elems + last_row_offset + label_start, cut, strlen(cut));
+          label_start += strlen(cut) + 1;
+        }
+      }
+      if (fe->reload.reloaded) { // NOTE: another writer's changes got merged in
+        char* reloaded = "[reloaded]";
+        if (tw->width > label_start + strlen(reloaded) + 12) {
+          memcpy(tw->elems + last_row_offset + label_start, reloaded, strlen(reloaded));
+          label_start += strlen(reloaded) + 1;
+        }
+      }
+      if (fe->journal.recovered) { // NOTE: the edits of a crashed session got replayed
+        char* recovered = "[recovered]";
+        if (tw->width > label_start + strlen(recovered) + 12) {
+          memcpy(tw->elems + last_row_offset + label_start, recovered, strlen(recovered));
+          label_start += strlen(recovered) + 1;
+        }
+      }
+      if (insert && fe->multi.len) { // NOTE: a block insert
+        char cursors[32];
+        size_t cursors_len = snprintf(cursors, sizeof(cursors), "[%zu cursors]", fe->multi.len);
+        if (tw->width > label_start + cursors_len + 12) {
+          memcpy(tw->elems + last_row_offset + label_start, cursors, cursors_len);
+          label_start += cursors_len + 1;
+        }
+      }
+      if (!fe->index.done) {
+        char indexing[32];
+        size_t indexing_len = snprintf(indexing, sizeof(indexing), "indexing %zu%%", 
+                                       fe->index.frontier * 100 / fe->file_buf.size);
+        if (tw->width > label_start + indexing_len + 12) {
+          memcpy(tw->elems + last_row_offset + label_start, indexing, indexing_len);
+          label_start += indexing_len + 1;
+        }
+      }
+      if (tw->bufs_count > 1 && tw->buf_name) {
+        char label[CMDLINE_MAX_LEN];
+        size_t label_len = snprintf(label, sizeof(label), "[%zu/%zu] %s", tw->buf_num, tw->bufs_count, tw->buf_name);
+        if (label_len >= sizeof(label)) label_len = sizeof(label) - 1;
+        size_t room = tw->width > label_start + 12 ? tw->width - (label_start + 12) : 0; // NOTE: the rest is for the cursor
+        memcpy(tw->elems + last_row_offset + label_start, label, label_len < room ? label_len : room);
+      }
+    }
+    TW_WRITE_NUM_AT(tw, curs_offset, "%-d:%-d", (int)cr->row + 1, (int)cr->col + 1); 
+    TW_WRITE_LINENUM_AT(tw, 0, tw->lines_to_scroll + 1);
+  }
+
+  if (ll->len == 0) return failed;
+  if (fe->nowrap) return get_text_to_render_nowrap(fe, tw);
+  failed = get_text_to_render_wrap(fe, tw);
+  return failed;
+}
+
+
+
+
+
+size_t utf8_encode(uint32_t cp, char* out)
+{
+  if (cp < 0x80) { out[0] = cp; return 1; }
+  if (cp < 0x800) {
+    out[0] = 0xc0 | (cp >> 6);
+    out[1] = 0x80 | (cp & 0x3f);
+    return 2;
+  }
+  if (cp < 0x10000) {
+    out[0] = 0xe0 | (cp >> 12);
+    out[1] = 0x80 | ((cp >> 6) & 0x3f);
+    out[2] = 0x80 | (cp & 0x3f);
+    return 3;
+  }
+  out[0] = 0xf0 | (cp >> 18);
+  out[1] = 0x80 | ((cp >> 12) & 0x3f);
+  out[2] = 0x80 | ((cp >> 6) & 0x3f);
+  out[3] = 0x80 | (cp & 0x3f);
+  return 4;
+}
+
+
+// DESC: writes 'len' cells of the TermWin starting from 'start',
+// encoding the code-points of the non-ascii cells back to utf-8.
+// The 2nd cell of a wide char is skipped since the terminal 
+// already moves 2 columns forward when printing it.
+void write_cells(TermWin* tw, size_t start, size_t len)
+{
+  if (!tw->has_utf8) {
+    fwrite(tw->elems + start, sizeof(*tw->elems), len, stdout);
+    return;
+  }
+
+  size_t run_start = start;
+  for (size_t i = start; i < start + len; i++) {
+    uint32_t cp = tw->cps[i];
+    if (!cp) continue;
+    fwrite(tw->elems + run_start, sizeof(*tw->elems), i - run_start, stdout);
+    run_start = i + 1;
+    if (cp == CP_WIDE_CONT) continue;
+    char utf8[4];
+    fwrite(utf8, sizeof(*utf8), utf8_encode(cp, utf8), stdout);
+  }
+  fwrite(tw->elems + run_start, sizeof(*tw->elems), start + len - run_start, stdout);
+}
+
+
+// DESC: the SGR parameters of 'color' for the foreground, or 
+// the background if 'bg'; 'out' needs room for 16 bytes
+size_t sgr_color(uint32_t color, bool bg, char* out)
+{
+  uint32_t n = color & 0xffffff;
+  switch (COLOR_KIND(color)) {
+    case 1:  return sprintf(out, "%u", (n < 8 ? 30 : 90 - 8) + n + bg * 10);
+    case 2:  return sprintf(out, "%u;5;%u", 38 + bg * 10, n);
+    case 3:  return sprintf(out, "%u;2;%u;%u;%u", 38 + bg * 10, n >> 16, (n >> 8) & 0xff, n & 0xff);
+    default: return sprintf(out, "%u", 39 + bg * 10);
+  }
+}
+
+
+// DESC: switches the terminal from the look 'from' to 'to' with 
+// one SGR, only with the parameters of what changes; back to the 
+// default it's a plain reset
+void sgr_write(CellAttr from, CellAttr to)
+{
+  if (CELL_ATTR_EQ(to, (CellAttr){0})) {
+    fputs("\x1b[0m", stdout);
+    return;
+  }
+  char sgr[64] = "\x1b[";
+  size_t len = 2;
+  if (from.bold != to.bold) len += sprintf(sgr + len, "%s;", to.bold ? "1" : "22");
+  if (from.fg != to.fg) {
+    len += sgr_color(to.fg, false, sgr + len);
+    sgr[len++] = ';';
+  }
+  if (from.bg != to.bg) {
+    len += sgr_color(to.bg, true, sgr + len);
+    sgr[len++] = ';';
+  }
+  sgr[len - 1] = 'm';
+  fwrite(sgr, sizeof(*sgr), len, stdout);
+}
+
+
+// DESC: writes all the cells in one go, from the top-left corner; 
+// the terminal's look changes only where the cells' one does, 
+// and goes back to the default at the end
+bool FRED_render_text(TermWin* tw, Cursor* cr)
+{
+  bool failed = 0;
+  fprintf(stdout, "\x1b[H");
+  if (!tw->has_attrs) {
+    write_cells(tw, 0, tw->size);
+  } else {
+    CellAttr curr = {0};
+    size_t run_start = 0;
+    for (size_t i = 0; i < tw->size; i++) {
+      if (CELL_ATTR_EQ(tw->attrs[i], curr)) continue;
+      write_cells(tw, run_start, i - run_start);
+      sgr_write(curr, tw->attrs[i]);
+      curr = tw->attrs[i];
+      run_start = i;
+    }
+    write_cells(tw, run_start, tw->size - run_start);
+    if (!CELL_ATTR_EQ(curr, (CellAttr){0})) fputs("\x1b[0m", stdout);
+  }
+
+  if (tw->cmdline_col) fprintf(stdout, "\x1b[%zu;%zuH", tw->height, tw->cmdline_col + 1);
+  else fprintf(stdout, "\x1b[%zu;%zuH", cr->win_row + 1, tw->linenum_width + cr->win_col + 1);
+  fflush(stdout);
+
+  GOTO_END(failed);
+end:
+  return failed;
+}
+
+
+
+// DESC: iterator on the byte right before the last edit 
+// point, without walking the pieces from the first one
+PieceIter piece_iter_at_last_edit(FredEditor* fe)
+{
+  LastEdit* le = &fe->last_edit;
+  if (!le->locus_valid || !le->offset || le->piece_idx >= fe->piece_table.len) return piece_iter_at(fe, 0);
+  PieceIter it = { 
+    .fe = fe, 
+    .piece_text = NULL,
+    .piece_idx = le->piece_idx, 
+    .piece_offset = fe->piece_table.items[le->piece_idx].len - 1, 
+    .offset = le->offset - 1,
+  };
+  piece_iter_load(&it);
+  return it;
+}
+
+
+// DESC: rescans line 'row' for its display width, 'it' can 
+// be anywhere close to the line since it only seeks from there
+void update_line_width(FredEditor* fe, PieceIter* it, size_t row)
+{
+  size_t left = fe->lines_len.items[row];
+  size_t line_width = 0;
+  bool line_is_ascii = true;
+  Utf8Decoder decoder = {0};
+
+  piece_iter_seek(it, get_line_offset(fe, row));
+  PieceSpan span;
+  while (left && (span = piece_iter_span(it)).len) {
+    size_t n = span.len < left ? span.len : left;
+    line_width = add_span_width(fe, span.text, n, span.is_ascii, line_width, &line_is_ascii, &decoder);
+    left -= n;
+    piece_iter_skip(it, n);
+  }
+  fe->lines_width.items[row] = LINE_WIDTH_ITEM(line_width, line_is_ascii);
+}
+
+
+// NOTE: at the end of an ascii line there's nothing after the edit 
+// to shift (like tabs), so any other char is 1 column wide
+#define IS_PLAIN_CHAR(c) ((unsigned char)(c) < 0x80 && (c) != '\t' && (c) != '\n')
+
+
+// DESC: updates LinesLen, LinesWidth and LineStarts after 'c' got 
+// inserted at 'row', 'col', instead of rescanning the whole text. 
+// Only the edited line gets rescanned (if at all), the lines 
+// below just get their start shifted (lazily, see line_starts_shift()).
+bool update_lines_after_insert(FredEditor* fe, size_t row, size_t col, char c)
+{
+  bool failed = 0;
+  LinesLen* ll = &fe->lines_len;
+  LinesWidth* lw = &fe->lines_width;
+  LineStarts* ls = &fe->line_starts;
+  RowIndex* ri = row_index_current(fe);
+  size_t line_len = ll->items[row];
+  size_t shift_from = row + 1;
+
+  if (c != '\n') {
+    assert(line_len + 1 <= LINE_LEN_MAX, "line-length overflow (max line-length is LINE_LEN_MAX, 4 GiB - 1), "
+                                         "length cannot be stored for later usage");
+    uint32_t old_width = lw->items[row];
+    bool at_plain_end = col == line_len && LINE_IS_ASCII(old_width) && old_width < LINE_WIDTH_MAX;
+    ll->items[row] = line_len + 1;
+    if (at_plain_end && IS_PLAIN_CHAR(c)) {
+      lw->items[row]++;
+    } else {
+      PieceIter it = piece_iter_at_last_edit(fe);
+      update_line_width(fe, &it, row);
+    }
+    if (ri != NULL) row_index_add(ri, row, LINE_ROWS(lw->items[row], ri->row_w) - LINE_ROWS(old_width, ri->row_w));
+  } else {
+    ri = NULL; // NOTE: a line more, it gets rebuilt
+    bool at_end = col == line_len;
+    DA_MAYBE_GROW(ll, 1, 8, LinesLen);
+    DA_MAYBE_GROW(lw, 1, 8, LinesWidth);
+    DA_MAYBE_GROW(ls, 1, 8, LineStarts);
+    memmove(ll->items + row + 2, ll->items + row + 1, (ll->len - (row + 1)) * sizeof(*ll->items));
+    memmove(lw->items + row + 2, lw->items + row + 1, (lw->len - (row + 1)) * sizeof(*lw->items));
+    memmove(ls->items + row + 2, ls->items + row + 1, (ls->len - (row + 1)) * sizeof(*ls->items));
+    ll->len++;
+    lw->len++;
+    ls->len++;
+    if (ls->shift_from > row) ls->shift_from++; // NOTE: the pending shift moves with its lines
+
+    ll->items[row] = col;
+    ll->items[row + 1] = line_len - col;
+    ls->items[row + 1] = LINE_START(ls, row) + col + 1 - (row + 1 >= ls->shift_from ? ls->shift : 0);
+    if (at_end) {
+      lw->items[row + 1] = 0; // NOTE: the line above keeps its width
+    } else {
+      PieceIter it = piece_iter_at_last_edit(fe);
+      update_line_width(fe, &it, row);
+      update_line_width(fe, &it, row + 1);
+    }
+    shift_from = row + 2;
+  }
+
+  line_starts_shift(ls, shift_from, 1);
+  fe->disp_col_cache.valid = false;
+  fe->lines_version++;
+  if (ri != NULL) ri->lines_version = fe->lines_version;
+end:
+  return failed;
+}
+
+
+// DESC: same as update_lines_after_insert(), after the 'n' bytes 
+// before 'row', 'col' (the cursor before deleting) got deleted; 'c' is one of them, if it's a 
+// '\n' (only deleted on its own) 'row' gets joined to the line above.
+bool update_lines_after_delete(FredEditor* fe, size_t row, size_t col, size_t n, char c)
+{
+  bool failed = 0;
+  LinesLen* ll = &fe->lines_len;
+  LinesWidth* lw = &fe->lines_width;
+  LineStarts* ls = &fe->line_starts;
+  RowIndex* ri = row_index_current(fe);
+  size_t line_len = ll->items[row];
+  size_t shift_from = row + 1;
+
+  if (c != '\n') {
+    uint32_t old_width = lw->items[row];
+    bool at_plain_end = col == line_len && LINE_IS_ASCII(old_width) && old_width < LINE_WIDTH_MAX;
+    ll->items[row] = line_len - n;
+    if (at_plain_end && n == 1 && IS_PLAIN_CHAR(c)) {
+      lw->items[row]--;
+    } else {
+      PieceIter it = piece_iter_at_last_edit(fe);
+      update_line_width(fe, &it, row);
+    }
+    if (ri != NULL) row_index_add(ri, row, LINE_ROWS(lw->items[row], ri->row_w) - LINE_ROWS(old_width, ri->row_w));
+  } else {
+    ri = NULL; // NOTE: a line less, it gets rebuilt
+    assert(row > 0, "deleted a '\\n' before the first line");
+    size_t prev_len = ll->items[row - 1];
+    assert(prev_len + line_len <= LINE_LEN_MAX, "line-length overflow (max line-length is LINE_LEN_MAX, 4 GiB - 1), "
+                                                "length cannot be stored for later usage");
+    bool joined_empty = line_len == 0;
+    memmove(ll->items + row, ll->items + row + 1, (ll->len - (row + 1)) * sizeof(*ll->items));
+    memmove(lw->items + row, lw->items + row + 1, (lw->len - (row + 1)) * sizeof(*lw->items));
+    memmove(ls->items + row, ls->items + row + 1, (ls->len - (row + 1)) * sizeof(*ls->items));
+    ll->len--;
+    lw->len--;
+    ls->len--;
+    if (ls->shift_from > row) ls->shift_from--; // NOTE: the pending shift moves with its lines
+
+    ll->items[row - 1] = prev_len + line_len;
+    if (!joined_empty) {
+      PieceIter it = piece_iter_at_last_edit(fe);
+      update_line_width(fe, &it, row - 1);
+    } // NOTE: otherwise the line above keeps its width
+    shift_from = row;
+  }
+
+  line_starts_shift(ls, shift_from, -n);
+  fe->disp_col_cache.valid = false;
+  fe->lines_version++;
+  if (ri != NULL) ri->lines_version = fe->lines_version;
+end:
+  return failed;
+}
+
+// DESC: same as update_lines_after_insert() (or '_delete()' if 
+// '!inserted'), after 'c' got inserted (or deleted) right before 
+// every cursor of a block insert; the line-starts get shifted in 
+// one pass over the rows of the block, the ones below it lazily.
+bool update_lines_after_multi(FredEditor* fe, bool inserted, char c)
+{
+  bool failed = 0;
+  LinesLen* ll = &fe->lines_len;
+  LinesWidth* lw = &fe->lines_width;
+  LineStarts* ls = &fe->line_starts;
+  MultiCursors* mc = &fe->multi;
+  RowIndex* ri = row_index_current(fe);
+
+  size_t last_row = mc->items[mc->len - 1].row;
+  line_starts_shift(ls, last_row + 1, inserted ? mc->len : -mc->len);
+  for (size_t r = mc->items[0].row + 1, k = 0; r <= last_row; r++) { // NOTE: none of them pending now
+    while (k < mc->len && mc->items[k].row < r) k++;
+    ls->items[r] = inserted ? ls->items[r] + k : ls->items[r] - k;
+  }
+
+  // NOTE: after the shift, the rescans seek from the right line-starts
+  PieceIter it = piece_iter_at_line(fe, mc->items[0].row);
+  for (size_t k = 0; k < mc->len; k++) {
+    size_t row = mc->items[k].row;
+    size_t line_len = ll->items[row];
+    assert(!inserted || line_len + 1 <= LINE_LEN_MAX, "line-length overflow (max line-length is LINE_LEN_MAX, 4 GiB - 1), "
+                                                      "length cannot be stored for later usage");
+    bool at_end = mc->items[k].col + mc->typed == line_len; // NOTE: 'typed' is still the one before
+    uint32_t old_width = lw->items[row];
+    bool plain = at_end && IS_PLAIN_CHAR(c) && LINE_IS_ASCII(old_width) && old_width < LINE_WIDTH_MAX;
+    ll->items[row] = inserted ? line_len + 1 : line_len - 1;
+    if (plain) lw->items[row] = inserted ? old_width + 1 : old_width - 1;
+    else update_line_width(fe, &it, row);
+    if (ri != NULL) row_index_add(ri, row, LINE_ROWS(lw->items[row], ri->row_w) - LINE_ROWS(old_width, ri->row_w));
+  }
+  fe->disp_col_cache.valid = false;
+  fe->lines_version++;
+  if (ri != NULL) ri->lines_version = fe->lines_version;
+end:
+  return failed;
+}
+
+#undef IS_PLAIN_CHAR
+
+
+bool insert_at_table_start(FredEditor* fe)
+{
+  bool failed = 0;
+  PieceTable* table = &fe->piece_table;
+  DA_MAYBE_GROW(table, 1, PIECE_TABLE_INIT_CAP, PieceTable);
+  memmove(table->items + 1, table->items, table->len * sizeof(*table->items));
+  table->items[0] = (Piece) {
+    .which_buf = 1,
+    .is_ascii = LAST_ADDED_IS_ASCII(fe),
+    .offset = fe->add_buf.len - 1,
+    .len = 1,
+  };
+  table->len++;
+  fe->last_edit.piece_idx = 0;
+end:
+  return failed;
+}
+
+
+// DESC: either grows the piece at 'piece_idx' or 
+// adds a new piece after it
+bool insert_after_piece(FredEditor* fe, size_t piece_idx)
+{
+#define AT_LAST_EDIT_POS (fe->cursor.row == fe->last_edit.cursor.row && fe->cursor.col == fe->last_edit.cursor.col)
+#define LAST_ACT_WAS_INSERT (fe->last_edit.action == ACT_INSERT)
+#define IS_ADD_BUF_PIECE (table->items[piece_idx].which_buf)
+// NOTE: the piece can only grow if the char just pushed in the add-buf 
+// comes right after it, e.g. 'i' + 'ESC' + 'i' keeps the last edit 
+// position but the piece might not be the last one written 
+#define ENDS_AT_ADD_BUF_END (table->items[piece_idx].offset + table->items[piece_idx].len == fe->add_buf.len - 1)
+
+  bool failed = 0;
+  PieceTable* table = &fe->piece_table;
+
+  if (AT_LAST_EDIT_POS && LAST_ACT_WAS_INSERT && IS_ADD_BUF_PIECE && ENDS_AT_ADD_BUF_END) {
+    table->items[piece_idx].len++;
+    table->items[piece_idx].is_ascii &= LAST_ADDED_IS_ASCII(fe);
+    fe->last_edit.piece_idx = piece_idx;
+  } else {
+    DA_MAYBE_GROW(table, 1, PIECE_TABLE_INIT_CAP, PieceTable);
+    size_t n = (table->len - (piece_idx + 1)) * sizeof(*table->items);
+    memmove(&table->items[piece_idx+2], &table->items[piece_idx+1], n);
+    table->items[piece_idx + 1] = (Piece) {
+      .which_buf = 1,
+      .is_ascii = LAST_ADDED_IS_ASCII(fe),
+      .offset = fe->add_buf.len - 1,
+      .len = 1,
+    };
+    table->len++;
+    fe->last_edit.piece_idx = piece_idx + 1;
+  }
+end:
+  return failed;
+
+#undef AT_LAST_EDIT_POS
+#undef LAST_ACT_WAS_INSERT
+#undef IS_ADD_BUF_PIECE
+#undef ENDS_AT_ADD_BUF_END
+}
+
+
+
+
+
+// DESC: splits the piece at 'piece_idx' 
+// into two and adds a new one in the middle 
+bool insert_inside_piece(FredEditor* fe, size_t piece_idx, size_t edit_offset) 
+{
+  bool failed = 0;
+
+  PieceTable* table = &fe->piece_table;
+  Piece curr_piece = table->items[piece_idx];
+  size_t piece_1_len = edit_offset; 
+  size_t piece_3_offset = curr_piece.offset + piece_1_len;
+  size_t piece_3_len = curr_piece.len - piece_1_len;
+ 
+  DA_MAYBE_GROW(table, 2, PIECE_TABLE_INIT_CAP, PieceTable);
+  size_t n = (table->len - (piece_idx + 1)) * sizeof(*table->items);
+  memmove(&table->items[piece_idx + 3], &table->items[piece_idx + 1], n);
+
+  table->items[piece_idx + 1] = (Piece){ 1, LAST_ADDED_IS_ASCII(fe), fe->add_buf.len - 1, 1};
+  table->items[piece_idx + 2] = (Piece){ curr_piece.which_buf, curr_piece.is_ascii, piece_3_offset, piece_3_len};
+  table->items[piece_idx].len = piece_1_len;
+  table->len += 2;
+  fe->last_edit.piece_idx = piece_idx + 1;
+end:
+  return failed;
+}
+
+
+
+
+
+bool FRED_insert_text(FredEditor* fe, char text_char)
+{
+#define LAST_ACT_WAS_INSERT (fe->last_edit.action == ACT_INSERT)
+#define AT_LAST_LINE_END (cr->row == ll->len - 1 && cr->col == (size_t)ll->items[cr->row])
+  bool failed = 0;
+
+  PieceTable* table = &fe->piece_table;
+  LinesLen* ll = &fe->lines_len;
+  Cursor* cr = &fe->cursor;
+  LastEdit* le = &fe->last_edit;
+  size_t row = cr->row, col = cr->col;
+
+  ADD_BUF_PUSH(&fe->add_buf, text_char);
+
+  // NOTE: typing at the same spot reuses the offset and piece of the 
+  // last edit, otherwise the cursor gets resolved into them
+  bool at_locus = LOCUS_AT_CURSOR(fe);
+  size_t place_to_edit_offset = at_locus ? le->offset : get_line_offset(fe, cr->row) + cr->col; // NOTE: offset in the fully built text
+
+  if (table->len == 0 || (!LAST_ACT_WAS_INSERT && AT_LAST_LINE_END)) {
+    PIECE_TABLE_PUSH(table, ((Piece){1, LAST_ADDED_IS_ASCII(fe), fe->add_buf.len - 1, 1}));
+    le->piece_idx = table->len - 1;
+  } else if (place_to_edit_offset == 0) {
+    failed = insert_at_table_start(fe);
+  } else if (at_locus) {
+    failed = insert_after_piece(fe, le->piece_idx);
+  } else {
+    for (size_t i = 0, pieces_len = 0; i < table->len; i++) {
+      pieces_len += table->items[i].len;
+      if (place_to_edit_offset == pieces_len) {
+        failed = insert_after_piece(fe, i);
+        break;
+      } else if (pieces_len > place_to_edit_offset) {
+        size_t edit_offset = table->items[i].len - (pieces_len - place_to_edit_offset);
+        failed = insert_inside_piece(fe, i, edit_offset);
+        break;
+      }
+    }
+  }
+  if (failed) GOTO_END(failed);
+
+  if (text_char == '\n'){
+    cr->row++;
+    cr->col = 0; 
+  } else {
+    cr->col++; 
+  }
+  le->cursor = *cr;
+  le->action = ACT_INSERT;
+  le->offset = place_to_edit_offset + 1;
+  le->locus_valid = true;
+  failed = update_lines_after_insert(fe, row, col, text_char);
+
+end:
+  if (failed) le->locus_valid = false;
+  return failed;
+#undef LAST_ACT_WAS_INSERT
+#undef AT_LAST_LINE_END
+}
+
+
+
+
+// DESC: either shrinks the piece at 'piece_idx'
+// or deletes it by moving all the next pieces on top of it  
+void delete_at_piece_end(PieceTable* table, size_t piece_idx)
+{
+  Piece* p = &table->items[piece_idx];
+  if (p->len - 1 > 0){
+    p->len--;
+  } else {
+    // NOTE: otherwise garbage might get copied over
+    if (table->len > 1) memmove(p, p + 1, (table->len - (piece_idx + 1)) * sizeof(*p));
+    if (table->len) table->len--;
+  }
+}
+
+bool delete_inside_piece(PieceTable* table, size_t piece_idx, size_t char_offset_in_piece)
+{
+  bool failed = 0;
+  if (char_offset_in_piece == 0) { 
+    // NOTE: splitting would leave an empty piece behind, 
+    // which breaks the last-char check in get_lines_len()
+    table->items[piece_idx].offset++;
+    table->items[piece_idx].len--;
+    return failed;
+  }
+  DA_MAYBE_GROW(table, 1, PIECE_TABLE_INIT_CAP, PieceTable);
+  Piece* p = &table->items[piece_idx];
+  memmove(p + 2, p + 1, (table->len - (piece_idx + 1)) * sizeof(*p));
+  p[1] = (Piece){
+    p->which_buf, 
+    p->is_ascii,
+    p->offset + char_offset_in_piece + 1,
+    p->len - (char_offset_in_piece + 1)
+  };
+  p->len = char_offset_in_piece;
+  table->len++;
+end:
+  return failed;
+}
+
+
+// DESC: deletes the byte at 'piece_offset' in the piece at 'piece_idx', 
+// storing it in 'del_char'; the piece left ending right before 
+// the deleted byte becomes the last edit's piece
+bool delete_char_in_piece(FredEditor* fe, size_t piece_idx, size_t piece_offset, char* del_char)
+{
+  bool failed = 0;
+  PieceTable* table = &fe->piece_table;
+  Piece* p = &table->items[piece_idx];
+  *del_char = (!p->which_buf ? fe->file_buf.text : fe->add_buf.items)[p->offset + piece_offset];
+
+  if (piece_offset == p->len - 1) {
+    bool removed = p->len == 1;
+    delete_at_piece_end(table, piece_idx);
+    fe->last_edit.piece_idx = removed && piece_idx ? piece_idx - 1 : piece_idx;
+    return failed;
+  }
+  failed = delete_inside_piece(table, piece_idx, piece_offset);
+  // NOTE: the piece's start got trimmed if 'piece_offset' is 0
+  fe->last_edit.piece_idx = piece_offset || !piece_idx ? piece_idx : piece_idx - 1;
+  return failed;
+}
+
+
+// DESC: how many bytes the utf-8 char before 'col' takes; 
+// 1 on ascii lines or if the bytes are not valid utf-8
+size_t utf8_len_before(FredEditor* fe, size_t row, size_t col)
+{
+  if (col == 0 || row >= fe->lines_width.len || LINE_IS_ASCII(fe->lines_width.items[row])) return 1;
+
+  size_t line_offset = get_line_offset(fe, row);
+  size_t start = col - 1;
+  while (start > 0 && col - start < 4 && IS_UTF8_CONT(FRED_char_at(fe, line_offset + start))) {
+    start--;
+  }
+  size_t len = col - start;
+  if (len > 1 && utf8_len(FRED_char_at(fe, line_offset + start)) != len) return 1;
+  return len;
+}
+
+
+bool FRED_delete_text(FredEditor* fe)
+{
+  bool failed = 0;
+
+  PieceTable* table = &fe->piece_table;
+  LinesLen* ll = &fe->lines_len;
+  Cursor* cr = &fe->cursor;
+  LastEdit* le = &fe->last_edit;
+  size_t row = cr->row, col = cr->col;
+
+  if (table->len == 0 || (cr->row == 0 && cr->col == 0)) {
+    return failed;
+  }
+  
+  char del_char = 0;
+  size_t del_len = utf8_len_before(fe, cr->row, cr->col); // NOTE: the whole utf-8 char gets deleted
+  bool at_locus = LOCUS_AT_CURSOR(fe);
+  size_t place_to_edit_offset = at_locus ? le->offset : get_line_offset(fe, cr->row) + cr->col; // NOTE: col is on the char after
+  
+  size_t deleted = 0;
+  for (; deleted < del_len && place_to_edit_offset; deleted++) {
+    size_t piece_idx = le->piece_idx;
+    size_t piece_offset = 0;
+    if (at_locus) {
+      piece_offset = table->items[piece_idx].len - 1;
+    } else {
+      PieceIter it = piece_iter_at(fe, place_to_edit_offset - 1);
+      if (it.piece_text == NULL) break;
+      piece_idx = it.piece_idx;
+      piece_offset = it.piece_offset;
+    }
+    failed = delete_char_in_piece(fe, piece_idx, piece_offset, &del_char);
+    if (failed) GOTO_END(failed);
+    place_to_edit_offset--;
+    at_locus = true; // NOTE: the next byte is at the end of the cached piece
+  }
+  if (!deleted) return failed;
+
+  if (del_char == '\n') {
+    if (cr->row) cr->row--;
+    cr->col = ll->items[cr->row];
+  } else {
+    cr->col = cr->col >= deleted ? cr->col - deleted : 0;
+  }
+  le->cursor = *cr;
+  le->action = ACT_DELETE;
+  le->offset = place_to_edit_offset;
+  le->locus_valid = true;
+  failed = update_lines_after_delete(fe, row, col, deleted, del_char);
+end:
+  if (failed) le->locus_valid = false;
+  return failed;
+}
+
+
+
+// DESC: merges neighbouring pieces that continue each other in the 
+// same buffer, like the ones left by typing at a spot, moving away 
+// and then typing right after it again. Run when idle since it moves 
+// the piece cached by the last edit, which has to be looked up again.
+bool FRED_compact_pieces(FredEditor* fe)
+{
+  PieceTable* table = &fe->piece_table;
+  if (table->len < 2 || fe->multi.len) return false; // NOTE: a block insert holds on to its pieces
+
+  size_t last = 0;
+  for (size_t i = 1; i < table->len; i++) {
+    Piece* lp = &table->items[last];
+    Piece p = table->items[i];
+    if (p.which_buf == lp->which_buf && lp->offset + lp->len == p.offset) {
+      lp->len += p.len;
+      lp->is_ascii &= p.is_ascii;
+    } else {
+      table->items[++last] = p;
+    }
+  }
+  bool merged = last + 1 < table->len;
+  table->len = last + 1;
+  if (merged) fe->last_edit.locus_valid = false;
+  return merged;
+}
+
+
+// DESC: column of the first char of line 'row' that isn't a 
+// space or a tab, the line's length if there's none
+size_t first_non_blank_col(FredEditor* fe, size_t row)
+{
+  size_t line_len = row < fe->lines_len.len ? fe->lines_len.items[row] : 0;
+  PieceIter it = piece_iter_at_line(fe, row);
+  size_t col = 0;
+  for (; col < line_len; col++, piece_iter_next(&it)) {
+    char c = piece_iter_char(&it);
+    if (c != SPACE_CH && c != '\t') break;
+  }
+  return col;
+}
+
+
+// DESC: 'I': with a block selected, puts a cursor at its left column 
+// on every line that reaches into it, the cursor going to the first 
+// one; otherwise moves to the first non-blank char of the line
+bool FRED_block_insert_start(FredEditor* fe)
+{
+  bool failed = 0;
+  MultiCursors* mc = &fe->multi;
+  Cursor* cr = &fe->cursor;
+  mc->len = 0;
+  mc->typed = 0;
+  mc->grows = false;
+  fe->last_edit.locus_valid = false; // NOTE: the cursor moves
+
+  if (!mc->selecting) {
+    cr->col = first_non_blank_col(fe, cr->row);
+    return failed;
+  }
+
+  mc->selecting = false;
+  size_t disp_col = FRED_get_disp_col(fe, cr->row, cr->col);
+  size_t left = disp_col < mc->anchor_disp_col ? disp_col : mc->anchor_disp_col;
+  size_t top = cr->row < mc->anchor_row ? cr->row : mc->anchor_row;
+  size_t bottom = cr->row < mc->anchor_row ? mc->anchor_row : cr->row;
+  PieceIter it = piece_iter_at_line(fe, top);
+  for (size_t row = top; row <= bottom && row < fe->lines_len.len; row++) {
+    if (LINE_WIDTH(fe->lines_width.items[row]) <= left) continue; // NOTE: short lines are left alone
+    size_t start_col = 0;
+    size_t col = nowrap_line_start(fe, &it, row, left, &start_col);
+    DA_PUSH(mc, ((MultiCursor){ .row = row, .col = col }), 8, MultiCursors);
+  }
+  if (mc->len) {
+    cr->row = mc->items[0].row;
+    cr->col = mc->items[0].col;
+  }
+  if (mc->len == 1) mc->len = 0; // NOTE: a plain insert
+end:
+  return failed;
+}
+
+
+// DESC: one ordered pass over the piece table for all the cursors of 
+// a block insert, into a new table: the pieces get cut at each cursor 
+// and a piece with the last add-buf byte goes there, or if '!insert' 
+// the byte right before each cursor gets dropped
+bool multi_splice_pieces(FredEditor* fe, bool insert)
+{
+#define CURSOR_OFFSET(k) (get_line_offset(fe, mc->items[(k)].row) + mc->items[(k)].col + mc->typed)
+#define PUSH_PIECE(piece) do { if ((piece).len) new.items[new.len++] = (piece); } while (0)
+  bool failed = 0;
+  PieceTable* table = &fe->piece_table;
+  MultiCursors* mc = &fe->multi;
+  PieceTable new = { .cap = table->len + 2 * mc->len };
+  new.items = malloc(new.cap * sizeof(*new.items));
+  if (new.items == NULL) ERROR("not enough memory for dynamic array \"PieceTable\".");
+  Piece typed = { 1, LAST_ADDED_IS_ASCII(fe), fe->add_buf.len - 1, 1 };
+
+  size_t start = 0, k = 0;
+  for (size_t i = 0; i < table->len; i++) {
+    Piece p = table->items[i];
+    size_t done = 0; // NOTE: bytes of 'p' already in the new table
+    for (; k < mc->len; k++) {
+      size_t at = CURSOR_OFFSET(k) - !insert; // NOTE: deleting, the byte before the cursor
+      if (at >= start + p.len) break;
+      PUSH_PIECE(((Piece){ p.which_buf, p.is_ascii, p.offset + done, at - start - done }));
+      done = at - start;
+      if (insert) {
+        new.items[new.len++] = typed;
+        mc->items[k].piece_idx = new.len - 1;
+      } else {
+        done++;
+      }
+    }
+    PUSH_PIECE(((Piece){ p.which_buf, p.is_ascii, p.offset + done, p.len - done }));
+    start += p.len;
+  }
+  for (; insert && k < mc->len; k++) { // NOTE: cursors at the end of the text
+    new.items[new.len++] = typed;
+    mc->items[k].piece_idx = new.len - 1;
+  }
+
+  free(table->items);
+  *table = new;
+end:
+  return failed;
+#undef CURSOR_OFFSET
+#undef PUSH_PIECE
+}
+
+
+// DESC: types 'c' at all the cursors of a block insert. The first 
+// byte (or the first after a delete) splices a piece in at every 
+// cursor, the next ones are pushed right after it in the add-buf 
+// so they just grow those pieces. Nothing changes if a line would 
+// get longer than LINE_LEN_MAX.
+bool FRED_multi_insert(FredEditor* fe, char c)
+{
+  bool failed = 0;
+  MultiCursors* mc = &fe->multi;
+  PieceTable* table = &fe->piece_table;
+
+  // NOTE: checked before the pieces change, like a put does
+  for (size_t k = 0; k < mc->len; k++) {
+    if (fe->lines_len.items[mc->items[k].row] >= LINE_LEN_MAX) return failed;
+  }
+  ADD_BUF_PUSH(&fe->add_buf, c);
+  if (mc->grows && mc->add_end == fe->add_buf.len - 1) {
+    for (size_t k = 0; k < mc->len; k++) {
+      Piece* p = &table->items[mc->items[k].piece_idx];
+      p->len++;
+      p->is_ascii &= LAST_ADDED_IS_ASCII(fe);
+    }
+  } else {
+    if (multi_splice_pieces(fe, true)) GOTO_END(1);
+    mc->grows = true;
+  }
+  mc->add_end = fe->add_buf.len;
+
+  if (update_lines_after_multi(fe, true, c)) GOTO_END(1);
+  mc->typed++;
+  fe->cursor.row = mc->items[0].row;
+  fe->cursor.col = mc->items[0].col + mc->typed;
+  fe->last_edit.locus_valid = false;
+end:
+  return failed;
+}
+
+
+// DESC: 'Backspace' in a block insert, deletes the last char typed 
+// at all the cursors in one pass (a whole utf-8 char, one byte a pass)
+bool FRED_multi_delete(FredEditor* fe)
+{
+  bool failed = 0;
+  MultiCursors* mc = &fe->multi;
+  assert(mc->typed, "deleting past the bytes typed at the cursors");
+
+  size_t del_len = utf8_len_before(fe, fe->cursor.row, fe->cursor.col);
+  for (size_t n = 0; n < del_len && mc->typed; n++) {
+    char c = FRED_char_at(fe, get_line_offset(fe, mc->items[0].row) + mc->items[0].col + mc->typed - 1);
+    if (multi_splice_pieces(fe, false)) GOTO_END(1);
+    if (update_lines_after_multi(fe, false, c)) GOTO_END(1);
+    mc->typed--;
+  }
+  mc->grows = false;
+  fe->cursor.row = mc->items[0].row;
+  fe->cursor.col = mc->items[0].col + mc->typed;
+  fe->last_edit.locus_valid = false;
+end:
+  return failed;
+}
+
+
+void dump_piece_table(FredEditor* fe, FILE* stream)
+{
+  // TODO: this shits ass make it better
+  fprintf(stream, "LINES-LENGHTS:\n");
+  fprintf(stream, "arr-len: %ld\n", fe->lines_len.len );
+  for (size_t i = 0; i < fe->lines_len.len; i++){
+    fprintf(stream, "[%ld] = %u,\n", i + 1, fe->lines_len.items[i]);
+  }
+
+#if 0
+  fprintf(stream, "TABLE (len: %ld, cap: %ld):\n", fe->piece_table.len, fe->piece_table.cap);
+  for (size_t i = 0; i < fe->piece_table.len; i++){
+    Piece piece = fe->piece_table.items[i];
+    char* buf = (!piece.which_buf ? fe->file_buf.text : fe->add_buf.items) + piece.offset;
+    fprintf(stream, "[%ld] => [buf = %d, offset = %ld, len = %ld]:\n", 
+            i, piece.which_buf, piece.offset, piece.len);
+
+    fprintf(stream, "%.*s\n", (int)piece.len, buf);
+    fprintf(stream, "----------------------------------------------------------------------\n");
+  }
+  fprintf(stream, "ADD-BUF:\n");
+  fprintf(stream, "%.*s\n", (int)fe->add_buf.len, fe->add_buf.items);
+  fprintf(stream, "----------------------------------------------------------------------\n");
+#endif
+}
+
+
+
+
+
+
+// DESC: moves the cursor back to the start of the utf-8 char 
+// it landed in, e.g. after 'j'/'k' clamped the column
+void snap_to_char_start(FredEditor* fe)
+{
+  Cursor* cr = &fe->cursor;
+  if (!cr->col || cr->row >= fe->lines_width.len || LINE_IS_ASCII(fe->lines_width.items[cr->row])) return;
+  size_t line_offset = get_line_offset(fe, cr->row);
+  size_t col = cr->col;
+  while (col > 0 && cr->col - col < 3 && IS_UTF8_CONT(FRED_char_at(fe, line_offset + col))) col--;
+  if (!IS_UTF8_CONT(FRED_char_at(fe, line_offset + col))) cr->col = col;
+}
+
+
+// DESC: 0 for blanks, 1 for punctuation, 2 for word chars; 
+// utf-8 bytes count as word chars, like letters
+int char_class(char c)
+{
+  if (c == SPACE_CH || c == '\t' || c == '\n' || c == '\0') return 0;
+  if ((unsigned char)c >= 0x80 || c == '_' || (c >= '0' && c <= '9') ||
+      (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) return 2;
+  return 1;
+}
+
+
+// DESC: 'w', moves to the start of the next word, or past 
+// the end of the text if there's none; an empty line counts as a word.
+void iter_next_word_start(PieceIter* it)
+{
+  bool more = it->piece_idx < it->fe->piece_table.len;
+  int cls = char_class(piece_iter_char(it));
+  if (cls) {
+    while ((more = piece_iter_next(it)) && char_class(piece_iter_char(it)) == cls);
+  }
+  while (more) {
+    char c = piece_iter_char(it);
+    if (char_class(c)) return;
+    more = piece_iter_next(it);
+    if (more && c == '\n' && piece_iter_char(it) == '\n') return;
+  }
+}
+
+
+// DESC: 'b', moves to the start of the previous 
+// word; an empty line counts as a word.
+void iter_prev_word_start(PieceIter* it)
+{
+  if (!piece_iter_prev(it)) return;
+  while (!char_class(piece_iter_char(it))) {
+    if (piece_iter_char(it) == '\n') {
+      PieceIter prev = *it;
+      if (!piece_iter_prev(&prev) || piece_iter_char(&prev) == '\n') return;
+    }
+    if (!piece_iter_prev(it)) return;
+  }
+  int cls = char_class(piece_iter_char(it));
+  PieceIter prev = *it;
+  while (piece_iter_prev(&prev) && char_class(piece_iter_char(&prev)) == cls) *it = prev;
+}
+
+
+// DESC: 'e', moves to the last byte of the next 
+// word end, doesn't move if there's none.
+void iter_next_word_end(PieceIter* it)
+{
+  PieceIter next = *it;
+  do {
+    if (!piece_iter_next(&next)) return;
+  } while (!char_class(piece_iter_char(&next)));
+  *it = next;
+  int cls = char_class(piece_iter_char(it));
+  while (piece_iter_next(&next) && char_class(piece_iter_char(&next)) == cls) *it = next;
+}
+
+
+// DESC: moves the cursor 'rows' lines up or down, 
+// clamping the column like 'j'/'k'
+void move_rows(FredEditor* fe, size_t rows, bool down)
+{
+  Cursor* cr = &fe->cursor;
+  size_t tot_lines = fe->lines_len.len;
+  if (down) cr->row = rows < tot_lines - 1 - cr->row ? cr->row + rows : tot_lines - 1;
+  else cr->row = rows < cr->row ? cr->row - rows : 0;
+  size_t line_len = fe->lines_len.items[cr->row];
+  if (cr->col > line_len) {
+    cr->col = line_len;
+  }
+  snap_to_char_start(fe);
+}
+
+
+// NOTE: 'count' is the count typed before the key, 
+// 0 if none; every motion costs O(distance) or O(log n).
+void FRED_move_cursor(FredEditor* fe, char key, size_t count) 
+{
+  Cursor* cr = &fe->cursor;
+  cr->prev_row = cr->row;
+  cr->prev_col = cr->col;
+  size_t tot_lines = fe->lines_len.len;
+  size_t n = count ? count : 1;
+  size_t half_page = fe->win_rows > 1 ? fe->win_rows / 2 : 1;
+  size_t page = fe->win_rows > 2 ? fe->win_rows - 2 : 1; // NOTE: keeps 2 lines of context
+
+  // TODO: store curr line length in cursor 
+
+  if (!tot_lines) return;
+
+  // NOTE: 'col' is a byte offset, so on non-ascii lines 
+  // 'h'/'l' move over whole utf-8 chars
+  switch (key){
+    case 'h': {
+      for (size_t i = 0; i < n && cr->col; i++) {
+        cr->col -= utf8_len_before(fe, cr->row, cr->col);
+      }
+      return;
+    } 
+    case 'l': {
+      size_t curr_line_len = fe->lines_len.items[cr->row];
+      bool is_ascii = cr->row >= fe->lines_width.len || LINE_IS_ASCII(fe->lines_width.items[cr->row]);
+      for (size_t i = 0; i < n && cr->col + 1 <= curr_line_len; i++) {
+        size_t char_len = is_ascii ? 1 : utf8_len(FRED_char_at(fe, get_line_offset(fe, cr->row) + cr->col));
+        cr->col = cr->col + char_len > curr_line_len ? curr_line_len : cr->col + char_len;
+      }
+      return;
+    }
+    case 'j': { move_rows(fe, n, true); return; }
+    case 'k': { move_rows(fe, n, false); return; }
+    case CTRL_KEY('d'): { move_rows(fe, count ? count : half_page, true); return; }
+    case CTRL_KEY('u'): { move_rows(fe, count ? count : half_page, false); return; }
+    case CTRL_KEY('f'): { move_rows(fe, n * page, true); return; }
+    case CTRL_KEY('b'): { move_rows(fe, n * page, false); return; }
+    case '0': { cr->col = 0; return; }
+    case '$': { cr->col = fe->lines_len.items[cr->row]; return; } // NOTE: past the last char, where 'l' stops too
+    case 'w': case 'b': case 'e': {
+      PieceIter it = piece_iter_at(fe, get_line_offset(fe, cr->row) + cr->col);
+      for (size_t i = 0; i < n; i++) {
+        size_t prev_offset = it.offset;
+        if (key == 'w') iter_next_word_start(&it);
+        else if (key == 'b') iter_prev_word_start(&it);
+        else iter_next_word_end(&it);
+        if (it.offset == prev_offset) break; // NOTE: reached either end of the text
+      }
+      cr->row = get_offset_row(fe, it.offset);
+      cr->col = it.offset - get_line_offset(fe, cr->row);
+      snap_to_char_start(fe);
+      return;
+    }
+  }
+}
+
+
+// DESC: offset of the first (or, if 'last', the last) match of 'pat' 
+// starting in [from, to), SIZE_MAX if none. The pieces are searched 
+// span by span with memmem(); the 'pat_len - 1' bytes before each 
+// span are carried over, for the matches across two pieces.
+size_t text_find(FredEditor* fe, size_t from, size_t to, const char* pat, size_t pat_len, bool last)
+{
+  size_t found = SIZE_MAX;
+  if (!pat_len || pat_len > CMDLINE_MAX_LEN || from >= to) return found;
+  size_t end = to + pat_len - 1; // NOTE: past the last byte of a match starting before 'to'
+  char carried[2 * CMDLINE_MAX_LEN];
+  size_t carried_len = 0;
+  size_t keep = pat_len - 1;
+
+  PieceIter it = piece_iter_at(fe, from);
+  PieceSpan span;
+  while ((span = piece_iter_span(&it)).len && it.offset < end) {
+    size_t n = span.len < end - it.offset ? span.len : end - it.offset;
+    if (carried_len) { // NOTE: only matches across the start of the span, the rest are shorter than 'pat'
+      size_t head = n < keep ? n : keep;
+      memcpy(carried + carried_len, span.text, head);
+      for (char* m = carried; (m = memmem(m, carried + carried_len + head - m, pat, pat_len)) != NULL; m++) {
+        found = it.offset - carried_len + (m - carried);
+        if (!last) return found;
+      }
+    }
+    for (const char* m = span.text; (m = memmem(m, span.text + n - m, pat, pat_len)) != NULL; m++) {
+      found = it.offset + (m - span.text);
+      if (!last) return found;
     }
+    Piece* p = &fe->piece_table.items[it.piece_idx];
+    if (!p->which_buf) file_buf_drop(&fe->file_buf, p->offset + it.piece_offset, p->offset + it.piece_offset + n);
+    if (n >= keep) {
+      memcpy(carried, span.text + n - keep, keep);
+      carried_len = keep;
+    } else {
+      size_t old = carried_len + n > keep ? keep - n : carried_len;
+      memmove(carried, carried + carried_len - old, old);
+      memcpy(carried + old, span.text, n);
+      carried_len = old + n;
+    }
+    piece_iter_skip(&it, n);
+  }
+  return found;
+}
+
+
+// DESC: offset of the last match of 'pat' starting in [from, to), 
+// SIZE_MAX if none; searched SEARCH_BACK_CHUNK bytes at a time 
+// from 'to' down, so a match near it doesn't cost the whole text
+size_t text_find_back(FredEditor* fe, size_t from, size_t to, const char* pat, size_t pat_len)
+{
+  while (to > from) {
+    size_t lo = to - from > SEARCH_BACK_CHUNK ? to - SEARCH_BACK_CHUNK : from;
+    size_t found = text_find(fe, lo, to, pat, pat_len, true);
+    if (found != SIZE_MAX) return found;
+    to = lo;
   }
+  return SIZE_MAX;
+}
 
+
+// DESC: moves the cursor to the 'count'th next (or previous) match 
+// of the last '/' pattern, wrapping around the text like vim; with 
+// no match it stays. A big file still being scanned gets scanned 
+// on till a match, or all of it for a backward search that wraps.
+bool FRED_search(FredEditor* fe, bool forward, size_t count)
+{
+  bool failed = 0;
+  SearchPattern* sp = &fe->search;
+  Cursor* cr = &fe->cursor;
+  if (!sp->len || !fe->lines_len.len) return failed;
+  size_t at = get_line_offset(fe, cr->row) + cr->col;
+
+  for (size_t k = 0; k < (count ? count : 1); k++) {
+    size_t found = SIZE_MAX;
+    if (forward) {
+      size_t from = at + 1;
+      for (;;) {
+        size_t text_len = FRED_text_len(fe);
+        found = text_find(fe, from, text_len, sp->items, sp->len, false);
+        if (found != SIZE_MAX || fe->index.done) break;
+        // NOTE: a match may go on past the part scanned so far
+        if (text_len >= from + sp->len) from = text_len - (sp->len - 1);
+        if (FRED_index_step(fe, LINES_INDEX_SLICE)) GOTO_END(1);
+      }
+      if (found == SIZE_MAX) found = text_find(fe, 0, at + 1, sp->items, sp->len, false);
+    } else {
+      found = text_find_back(fe, 0, at, sp->items, sp->len);
+      if (found == SIZE_MAX) {
+        if (FRED_index_until(fe, SIZE_MAX)) GOTO_END(1);
+        found = text_find_back(fe, at, FRED_text_len(fe), sp->items, sp->len);
+      }
+    }
+    if (found == SIZE_MAX) break; // NOTE: not in the text at all
+    at = found;
+  }
+  cr->row = get_offset_row(fe, at);
+  cr->col = at - get_line_offset(fe, cr->row);
 end:
-  // FIXME: end lable should only handle clean-up logic
-  if (!failed) {
-    if (text_char == '\n'){
-      cr->row++;
-      cr->col = 0; 
+  return failed;
+}
+
+
+
+
+// DESC: offsets of the matches of 'pat' in [from, to) for a ':s' 
+// command, in one scan: span by span like text_find(), the matches 
+// not overlapping and, if '!global', only the first of each line
+bool find_matches(FredEditor* fe, size_t from, size_t to, const char* pat, size_t pat_len, bool global, Matches* matches)
+{
+#define TAKE_MATCH(offset) do {                                      \
+    size_t at = (offset);                                             \
+    if (at < next) break;                                             \
+    while (row + 1 < ls->len && LINE_START(ls, row + 1) <= at) row++; \
+    if (!global && row == taken_row) break;                           \
+    DA_PUSH(matches, at, 64, Matches);                                \
+    next = at + pat_len;                                              \
+    taken_row = row;                                                  \
+  } while (0)
+  bool failed = 0;
+  LineStarts* ls = &fe->line_starts;
+  if (!pat_len || pat_len > CMDLINE_MAX_LEN || from >= to) return failed;
+  size_t next = from; // NOTE: where the next match can start
+  size_t row = get_offset_row(fe, from), taken_row = SIZE_MAX;
+  char carried[2 * CMDLINE_MAX_LEN];
+  size_t carried_len = 0;
+  size_t keep = pat_len - 1;
+
+  PieceIter it = piece_iter_at(fe, from);
+  PieceSpan span;
+  while ((span = piece_iter_span(&it)).len && it.offset < to) {
+    size_t n = span.len < to - it.offset ? span.len : to - it.offset;
+    if (carried_len) {
+      size_t head = n < keep ? n : keep;
+      memcpy(carried + carried_len, span.text, head);
+      for (char* m = carried; (m = memmem(m, carried + carried_len + head - m, pat, pat_len)) != NULL; m++) {
+        TAKE_MATCH(it.offset - carried_len + (m - carried));
+      }
+    }
+    for (const char* m = span.text; (m = memmem(m, span.text + n - m, pat, pat_len)) != NULL; m++) {
+      TAKE_MATCH(it.offset + (m - span.text));
+    }
+    Piece* p = &fe->piece_table.items[it.piece_idx];
+    if (!p->which_buf) file_buf_drop(&fe->file_buf, p->offset + it.piece_offset, p->offset + it.piece_offset + n);
+    if (n >= keep) {
+      memcpy(carried, span.text + n - keep, keep);
+      carried_len = keep;
     } else {
-      cr->col++; 
+      size_t old = carried_len + n > keep ? keep - n : carried_len;
+      memmove(carried, carried + carried_len - old, old);
+      memcpy(carried + old, span.text, n);
+      carried_len = old + n;
     }
-    fe->last_edit.cursor = *cr;
-    fe->last_edit.action = ACT_INSERT;
+    piece_iter_skip(&it, n);
   }
+end:
   return failed;
-#undef LAST_ACT_WAS_INSERT
-#undef AT_LAST_LINE_END
+#undef TAKE_MATCH
 }
 
 
+// DESC: one ordered pass over the piece table into a new one, every 
+// match cut out and the piece of the replacement (the same add-buf 
+// bytes for all of them) put in its place; the pieces between the 
+// matches keep pointing where they did
+bool substitute_pieces(FredEditor* fe, Matches* matches, size_t pat_len, Piece rep)
+{
+#define PUSH_PIECE(piece) do { if ((piece).len) new.items[new.len++] = (piece); } while (0)
+  bool failed = 0;
+  PieceTable* table = &fe->piece_table;
+  PieceTable new = { .cap = table->len + 2 * matches->len };
+  new.items = malloc(new.cap * sizeof(*new.items));
+  if (new.items == NULL) ERROR("not enough memory for dynamic array \"PieceTable\".");
 
+  size_t start = 0, k = 0, skip_to = 0; // NOTE: a match can go on in the next pieces
+  for (size_t i = 0; i < table->len; i++) {
+    Piece p = table->items[i];
+    size_t done = skip_to > start ? (skip_to - start < p.len ? skip_to - start : p.len) : 0;
+    for (; k < matches->len && matches->items[k] < start + p.len; k++) {
+      size_t at = matches->items[k] - start;
+      PUSH_PIECE(((Piece){ p.which_buf, p.is_ascii, p.offset + done, at - done }));
+      PUSH_PIECE(rep);
+      skip_to = matches->items[k] + pat_len;
+      done = skip_to - start < p.len ? skip_to - start : p.len;
+    }
+    PUSH_PIECE(((Piece){ p.which_buf, p.is_ascii, p.offset + done, p.len - done }));
+    start += p.len;
+  }
 
-// DESC: either shrinks the piece at 'piece_idx'
-// or deletes it by moving all the next pieces on top of it  
-void delete_at_piece_end(PieceTable* table, size_t piece_idx)
+  free(table->items);
+  *table = new;
+end:
+  return failed;
+#undef PUSH_PIECE
+}
+
+
+// DESC: replaces the matches of 'pat' on lines [top, bottom] with 
+// 'rep' (all of them if 'global', else the first of each line), the 
+// cursor going to the last line changed like vim. 'rep' goes in the 
+// add-buf once, the table gets rebuilt in one pass and only the lines 
+// changed get their length and width updated. Nothing changes if a 
+// line would get longer than LINE_LEN_MAX.
+bool FRED_substitute(FredEditor* fe, size_t top, size_t bottom, const char* pat, size_t pat_len, 
+                     const char* rep, size_t rep_len, bool global)
 {
-  Piece* p = &table->items[piece_idx];
-  if (p->len - 1 > 0){
-    p->len--;
-  } else {
-    // NOTE: otherwise garbage might get copied over
-    if (table->len > 1) memmove(p, p + 1, (table->len - (piece_idx + 1)) * sizeof(*p));
-    if (table->len) table->len--;
+  bool failed = 0;
+  LinesLen* ll = &fe->lines_len;
+  LineStarts* ls = &fe->line_starts;
+  Matches matches = {0};
+  if (fe->read_only || !ll->len || top > bottom || bottom >= ll->len) return failed;
+  line_starts_settle(ls); // NOTE: all the ones below get shifted here anyway
+
+  size_t to = ls->items[bottom] + ll->items[bottom];
+  if (find_matches(fe, ls->items[top], to, pat, pat_len, global, &matches)) GOTO_END(1);
+  if (!matches.len) GOTO_END(failed);
+
+  // NOTE: the sizes are unsigned, a replacement shorter than the 
+  // pattern makes 'delta' wrap around, and the sums with it too
+  size_t delta = rep_len - pat_len;
+  for (size_t k = 0, row = top; k < matches.len; row++) {
+    size_t count = 0;
+    for (; k < matches.len && (row + 1 == ls->len || matches.items[k] < ls->items[row + 1]); k++) count++;
+    if (ll->items[row] + count * delta > LINE_LEN_MAX) GOTO_END(failed); // NOTE: like in insert mode
+  }
+
+  Piece rep_piece = { 1, true, fe->add_buf.len, rep_len };
+  for (size_t i = 0; i < rep_len; i++) {
+    ADD_BUF_PUSH(&fe->add_buf, rep[i]);
+    rep_piece.is_ascii &= LAST_ADDED_IS_ASCII(fe);
+  }
+  if (substitute_pieces(fe, &matches, pat_len, rep_piece)) GOTO_END(1);
+
+  size_t row = get_offset_row(fe, matches.items[0]);
+  size_t last_row = row;
+  PieceIter it = piece_iter_at_line(fe, row);
+  for (size_t k = 0, shift = 0; row < ls->len; row++) {
+    size_t count = 0;
+    for (; k < matches.len && (row + 1 == ls->len || matches.items[k] < ls->items[row + 1]); k++) count++;
+    ls->items[row] += shift;
+    if (!count) continue;
+    ll->items[row] = ll->items[row] + count * delta;
+    update_line_width(fe, &it, row);
+    shift += count * delta;
+    last_row = row;
   }
+
+  fe->cursor.row = last_row;
+  fe->cursor.col = first_non_blank_col(fe, last_row);
+  fe->disp_col_cache.valid = false;
+  fe->last_edit.locus_valid = false;
+  fe->lines_version++;
+end:
+  DA_FREE(&matches, 1);
+  return failed;
 }
 
-bool delete_inside_piece(PieceTable* table, size_t piece_idx, size_t char_offset_in_piece)
+
+
+
+// DESC: cuts the piece 'offset' falls in, if it doesn't start there; 
+// 'piece_idx' gets the index of the piece starting at 'offset' (the 
+// table's length at the end of the text)
+bool table_split(FredEditor* fe, size_t offset, size_t* piece_idx)
 {
   bool failed = 0;
+  PieceTable* table = &fe->piece_table;
+  PieceIter it = piece_iter_at(fe, offset);
+  *piece_idx = it.piece_idx;
+  if (!it.piece_offset) return failed;
+
   DA_MAYBE_GROW(table, 1, PIECE_TABLE_INIT_CAP, PieceTable);
-  Piece* p = &table->items[piece_idx];
-  memmove(p + 2, p + 1, (table->len - (piece_idx + 1)) * sizeof(*p));
-  p[1] = (Piece){
-    p->which_buf, 
-    p->offset + char_offset_in_piece + 1,
-    p->len - (char_offset_in_piece + 1)
-  };
-  p->len = char_offset_in_piece;
+  Piece p = table->items[it.piece_idx];
+  memmove(&table->items[it.piece_idx + 2], &table->items[it.piece_idx + 1], 
+          (table->len - (it.piece_idx + 1)) * sizeof(*table->items));
+  table->items[it.piece_idx].len = it.piece_offset;
+  table->items[it.piece_idx + 1] = (Piece){ p.which_buf, p.is_ascii, p.offset + it.piece_offset, p.len - it.piece_offset };
   table->len++;
+  *piece_idx = it.piece_idx + 1;
+end:
+  return failed;
+}
+
+
+// DESC: the lines after the text changed like 'c' says (the table in 
+// 'fe' being the new one already), as after a reload: the lines around 
+// it get scanned again, the others only moved
+bool lines_after_change(FredEditor* fe, TextChange c)
+{
+#define SWAP(type, a, b) do { type tmp = (a); (a) = (b); (b) = tmp; } while (0)
+  bool failed = 0;
+  TextChanges changes = {0};
+  LinesLen ll = {0};
+  LinesWidth lw = {0};
+  LineStarts ls = {0};
+  DA_PUSH(&changes, c, 1, TextChanges);
+  if (reload_lines(fe, &changes, &ll, &lw, &ls)) GOTO_END(1);
+  SWAP(LinesLen, fe->lines_len, ll);
+  SWAP(LinesWidth, fe->lines_width, lw);
+  SWAP(LineStarts, fe->line_starts, ls);
+  fe->lines_version++;
+  fe->disp_col_cache.valid = false;
+  fe->last_edit.locus_valid = false;
+end:
+  DA_FREE(&changes, 1);
+  DA_FREE(&ll, 1);
+  DA_FREE(&lw, 1);
+  DA_FREE(&ls, 1);
+  return failed;
+#undef SWAP
+}
+
+
+// DESC: the pieces of [from, to) into the register, cut at its ends: 
+// no text gets copied, it takes the time of the pieces whatever its 
+// length.
+bool FRED_yank(FredEditor* fe, size_t from, size_t to, bool linewise)
+{
+  bool failed = 0;
+  Register* reg = &fe->reg;
+  PieceTable* table = &fe->piece_table;
+  reg->pieces.len = 0;
+  reg->linewise = linewise;
+  free(reg->text);
+  reg->text = NULL;
+  reg->text_len = 0;
+
+  PieceIter it = piece_iter_at(fe, from);
+  size_t left = to > from ? to - from : 0;
+  for (size_t i = it.piece_idx, skip = it.piece_offset; left && i < table->len; i++, skip = 0) {
+    Piece p = table->items[i];
+    size_t n = p.len - skip < left ? p.len - skip : left;
+    if (n) PIECE_TABLE_PUSH(&reg->pieces, ((Piece){ p.which_buf, p.is_ascii, p.offset + skip, n }));
+    left -= n;
+  }
+end:
+  return failed;
+}
+
+
+// DESC: copies the register's text out of the buffers, before a 
+// save or a reload lets go of them
+bool register_detach(FredEditor* fe)
+{
+  bool failed = 0;
+  Register* reg = &fe->reg;
+  if (!reg->pieces.len) return failed;
+  size_t len = 0;
+  for (size_t i = 0; i < reg->pieces.len; i++) len += reg->pieces.items[i].len;
+  char* text = malloc(len ? len : 1);
+  if (text == NULL) ERROR("not enough memory for the register's text.");
+  for (size_t i = 0, at = 0; i < reg->pieces.len; i++) {
+    Piece p = reg->pieces.items[i];
+    memcpy(text + at, (!p.which_buf ? fe->file_buf.text : fe->add_buf.items) + p.offset, p.len);
+    at += p.len;
+  }
+  free(reg->text);
+  reg->text = text;
+  reg->text_len = len;
+  reg->pieces.len = 0;
+end:
+  return failed;
+}
+
+
+// DESC: drops [from, to) from the text in one go: the pieces at its 
+// ends get cut and the ones in between dropped together, instead of 
+// a byte at a time; the lines get scanned again only around it
+bool FRED_delete_range(FredEditor* fe, size_t from, size_t to)
+{
+  bool failed = 0;
+  PieceTable* table = &fe->piece_table;
+  if (from >= to) return failed;
+  // NOTE: up to the line after the one 'to' is in, where the scan past 
+  // the change stops; the rest of a big file can stay unindexed
+  if (FRED_index_until(fe, get_offset_row(fe, to) + 1)) GOTO_END(1);
+
+  size_t first = 0, last = 0;
+  if (table_split(fe, from, &first) || table_split(fe, to, &last)) GOTO_END(1);
+  memmove(&table->items[first], &table->items[last], (table->len - last) * sizeof(*table->items));
+  table->len -= last - first;
+  failed = lines_after_change(fe, (TextChange){ .old_offset = from, .old_len = to - from, .offset = from, .len = 0 });
+end:
+  return failed;
+}
+
+
+// DESC: lengths of the register's first line (all of it without a 
+// '\n'), of its last one (after its last '\n') and of the longest one 
+// between them, so a put can tell before it changes anything whether 
+// a line would get longer than LINE_LEN_MAX
+void register_line_lens(FredEditor* fe, size_t* first, size_t* longest, size_t* last, bool* has_nl)
+{
+  Register* reg = &fe->reg;
+  size_t len = 0;
+  *first = *longest = *last = 0;
+  *has_nl = false;
+  for (size_t i = 0; i < reg->pieces.len; i++) {
+    Piece p = reg->pieces.items[i];
+    const char* text = (!p.which_buf ? fe->file_buf.text : fe->add_buf.items) + p.offset;
+    const char* nl;
+    size_t j = 0;
+    while ((nl = memchr(text + j, '\n', p.len - j)) != NULL) {
+      len += nl - (text + j);
+      if (!*has_nl) *first = len;
+      else if (len > *longest) *longest = len;
+      *has_nl = true;
+      len = 0;
+      j = nl - text + 1;
+    }
+    len += p.len - j;
+  }
+  *last = len;
+  if (!*has_nl) *first = len;
+}
+
+
+// DESC: 'p': the register's pieces spliced in 'count' times after the 
+// cursor's char, or under the cursor's line for whole lines; no byte 
+// of the text gets copied. A register copied out of the buffers goes 
+// back in the add-buf first, once. Nothing changes if a line would
+// get longer than LINE_LEN_MAX.
+bool FRED_put(FredEditor* fe, size_t count)
+{
+  bool failed = 0;
+  Register* reg = &fe->reg;
+  PieceTable* table = &fe->piece_table;
+  Cursor* cr = &fe->cursor;
+  PieceTable put = {0};
+  if (fe->read_only) return failed;
+  if (reg->text != NULL) {
+    Piece p = { 1, true, fe->add_buf.len, reg->text_len };
+    for (size_t i = 0; i < reg->text_len; i++) {
+      ADD_BUF_PUSH(&fe->add_buf, reg->text[i]);
+      p.is_ascii &= LAST_ADDED_IS_ASCII(fe);
+    }
+    reg->pieces.len = 0;
+    if (p.len) PIECE_TABLE_PUSH(&reg->pieces, p);
+    free(reg->text);
+    reg->text = NULL;
+    reg->text_len = 0;
+  }
+  if (!reg->pieces.len) return failed;
+  if (FRED_index_until(fe, SIZE_MAX)) GOTO_END(1);
+
+  // NOTE: lines put under the last one go after a '\n' of their own, 
+  // and without the one they end with
+  bool at_end = reg->linewise && cr->row + 1 >= fe->lines_len.len;
+  size_t at = 0;
+  if (reg->linewise) {
+    at = at_end ? FRED_text_len(fe) : get_line_offset(fe, cr->row + 1);
+  } else {
+    at = get_line_offset(fe, cr->row) + cr->col;
+    if (cr->col < fe->lines_len.items[cr->row]) at += utf8_len(FRED_char_at(fe, at));
+  }
+
+  // NOTE: nothing changes if a line would get longer than LINE_LEN_MAX, 
+  // like with ':s'. The line split at 'at' gets the register's first 
+  // line after its start and its last line before its end, and with 
+  // a count each copy's last line runs into the next one's first
+  size_t first, longest, last;
+  bool has_nl;
+  register_line_lens(fe, &first, &longest, &last, &has_nl);
+  size_t copies = count ? count : 1;
+  size_t row = at_end ? 0 : get_offset_row(fe, at);
+  size_t before = at_end ? 0 : at - get_line_offset(fe, row);
+  size_t after = at_end ? 0 : fe->lines_len.items[row] - before;
+  bool too_long = has_nl ? before + first > LINE_LEN_MAX || longest > LINE_LEN_MAX || last + after > LINE_LEN_MAX || 
+                           (copies > 1 && last + first > LINE_LEN_MAX)
+                         : first && copies > (LINE_LEN_MAX - before - after) / first;
+  if (too_long) GOTO_END(failed);
+
+  if (at_end) {
+    ADD_BUF_PUSH(&fe->add_buf, '\n');
+    PIECE_TABLE_PUSH(&put, ((Piece){ 1, true, fe->add_buf.len - 1, 1 }));
+  }
+  for (size_t k = 0; k < (count ? count : 1); k++) {
+    for (size_t i = 0; i < reg->pieces.len; i++) PIECE_TABLE_PUSH(&put, reg->pieces.items[i]);
+  }
+  if (at_end && !--put.items[put.len - 1].len) put.len--;
+  size_t put_len = 0;
+  for (size_t i = 0; i < put.len; i++) put_len += put.items[i].len;
+
+  size_t idx = 0;
+  if (table_split(fe, at, &idx)) GOTO_END(1);
+  while (table->len + put.len > table->cap) DA_MAYBE_GROW(table, put.len, PIECE_TABLE_INIT_CAP, PieceTable);
+  memmove(&table->items[idx + put.len], &table->items[idx], (table->len - idx) * sizeof(*table->items));
+  memcpy(&table->items[idx], put.items, put.len * sizeof(*put.items));
+  table->len += put.len;
+  if (lines_after_change(fe, (TextChange){ .old_offset = at, .old_len = 0, .offset = at, .len = put_len })) GOTO_END(1);
+
+  if (reg->linewise) {
+    cr->row++;
+    cr->col = first_non_blank_col(fe, cr->row);
+  } else { // NOTE: on the last char put
+    cr->row = get_offset_row(fe, at + put_len - 1);
+    cr->col = at + put_len - 1 - get_line_offset(fe, cr->row);
+    snap_to_char_start(fe);
+  }
+end:
+  DA_FREE(&put, 1);
+  return failed;
+}
+
+
+// DESC: 'd' or 'y' ('op') on lines [top, bottom]: into the register, 
+// and out of the text for 'd' (with the '\n' before them if they're 
+// the last ones), the cursor going to the first line left
+bool lines_op(FredEditor* fe, char op, size_t top, size_t bottom)
+{
+  bool failed = 0;
+  Cursor* cr = &fe->cursor;
+  if (op == 'd' && fe->read_only) return failed;
+  if (FRED_index_until(fe, bottom + 1)) GOTO_END(1);
+  size_t lines = fe->lines_len.len;
+  if (!lines || top >= lines) return failed;
+  if (bottom >= lines) bottom = lines - 1;
+
+  size_t from = get_line_offset(fe, top);
+  size_t to = bottom + 1 < lines ? get_line_offset(fe, bottom + 1) : FRED_text_len(fe);
+  if (FRED_yank(fe, from, to, true)) GOTO_END(1);
+  // NOTE: the last line gets the '\n' it doesn't have; only here, 
+  // the lines before an empty last one reach the end of the text too
+  if (bottom + 1 >= lines) {
+    ADD_BUF_PUSH(&fe->add_buf, '\n');
+    PIECE_TABLE_PUSH(&fe->reg.pieces, ((Piece){ 1, true, fe->add_buf.len - 1, 1 }));
+  }
+  if (op == 'y') {
+    if (cr->row > top) cr->row = top;
+    size_t line_len = fe->lines_len.items[cr->row];
+    if (cr->col > line_len) cr->col = line_len;
+    GOTO_END(failed);
+  }
+
+  if (bottom + 1 >= lines && top > 0) from--;
+  if (FRED_delete_range(fe, from, to)) GOTO_END(1);
+  cr->row = top < fe->lines_len.len ? top : fe->lines_len.len - 1;
+  cr->col = first_non_blank_col(fe, cr->row);
+end:
+  return failed;
+}
+
+
+// DESC: 'dd' and 'yy' ('op' 'd' or 'y'), for 'count' lines from the cursor's
+bool FRED_line_op(FredEditor* fe, char op, size_t count)
+{
+  size_t row = fe->cursor.row;
+  return lines_op(fe, op, row, row + (count ? count : 1) - 1);
+}
+
+
+// DESC: 'd' or 'y' ('op') from the cursor to where 'motion' takes it: 
+// 'j', 'k' and the page motions take whole lines, 'e' takes the char 
+// it stops on too, and a 'w' going on to the next line stops at the 
+// end of this one, like vim
+bool FRED_motion_op(FredEditor* fe, char op, char motion, size_t count)
+{
+  bool failed = 0;
+  Cursor* cr = &fe->cursor;
+  Cursor start = *cr;
+  if (op == 'd' && fe->read_only) return failed;
+  size_t rows = fe->win_rows ? fe->win_rows : 1;
+  if (FRED_index_until(fe, cr->row + (count ? count : 1) * rows + rows)) GOTO_END(1);
+  FRED_move_cursor(fe, motion, count);
+  Cursor target = *cr;
+  *cr = start;
+
+  if (strchr("jk\x04\x15\x06\x02", motion)) {
+    if (target.row == start.row) return failed; // NOTE: the motion couldn't move
+    size_t top = start.row < target.row ? start.row : target.row;
+    size_t bottom = start.row < target.row ? target.row : start.row;
+    failed = lines_op(fe, op, top, bottom);
+    GOTO_END(failed);
+  }
+
+  size_t from = get_line_offset(fe, start.row) + start.col;
+  size_t to = get_line_offset(fe, target.row) + target.col;
+  if (motion == 'w' && target.row > start.row) to = get_line_offset(fe, start.row) + fe->lines_len.items[start.row];
+  if (to < from) {
+    size_t tmp = to;
+    to = from;
+    from = tmp;
+  }
+  if (motion == 'e' && to < FRED_text_len(fe)) to += utf8_len(FRED_char_at(fe, to));
+  if (from == to) return failed;
+
+  if (FRED_yank(fe, from, to, false)) GOTO_END(1);
+  if (op == 'd' && FRED_delete_range(fe, from, to)) GOTO_END(1);
+  cr->row = get_offset_row(fe, from);
+  cr->col = from - get_line_offset(fe, cr->row);
 end:
   return failed;
 }
 
 
-bool FRED_delete_text(FredEditor* fe)
+// DESC: 'd' or 'y' ('op') on the visual selection, which ends: from 
+// the anchor to the cursor with both their chars, or all their lines 
+// for 'V'; the cursor goes to its start
+bool FRED_visual_op(FredEditor* fe, char op)
 {
-#define buf(p, offset)((!(p).which_buf ? fe->file_buf.text: fe->add_buf.items)[(offset)])
-#define AT_LAST_LINE_END (cr->row == ll->len - 1 && cr->col == (size_t)(ll->items[cr->row] & 0xffff))
-
   bool failed = 0;
-
-  PieceTable* table = &fe->piece_table;
-  LinesLen* ll = &fe->lines_len;
+  Visual* v = &fe->visual;
   Cursor* cr = &fe->cursor;
-
-  if (table->len == 0 || (cr->row == 0 && cr->col == 0)) {
-    return failed;
-  }
-  
-  char del_char = 0;
-  // NOTE+FIXME: this is not reached if you're editing 
-  // a file that ends with EOL since the EOL is 
-  // considered a proper line by get_lines_len()
-  if (AT_LAST_LINE_END) {
-    Piece p = table->items[table->len - 1];
-    del_char = buf(p, p.offset + (p.len - 1));
-    delete_at_piece_end(table, table->len - 1);
-    GOTO_END(0);
+  char kind = v->kind;
+  v->kind = 0;
+  if ((op == 'd' && fe->read_only) || !fe->lines_len.len) return failed;
+  // NOTE: a reload may have changed the lines since the anchor was set
+  size_t anchor_row = v->anchor_row < fe->lines_len.len ? v->anchor_row : fe->lines_len.len - 1;
+  size_t anchor_len = fe->lines_len.items[anchor_row];
+  size_t anchor_col = v->anchor_col < anchor_len ? v->anchor_col : anchor_len;
+
+  if (kind == 'V') {
+    size_t top = cr->row < anchor_row ? cr->row : anchor_row;
+    size_t bottom = cr->row < anchor_row ? anchor_row : cr->row;
+    failed = lines_op(fe, op, top, bottom);
+    GOTO_END(failed);
   }
 
-  size_t place_to_edit_offset = 0;
-  for (size_t i = 0; i < cr->row; i++) {
-    place_to_edit_offset += (ll->items[i] & 0xffff) + 1; 
+  size_t from = get_line_offset(fe, anchor_row) + anchor_col;
+  size_t to = get_line_offset(fe, cr->row) + cr->col;
+  if (to < from) {
+    size_t tmp = to;
+    to = from;
+    from = tmp;
   }
-  place_to_edit_offset += cr->col; // NOTE: col is on the char after
-  
-  for (size_t i = 0, tot_pieces_len = 0; i < table->len; i++) {
-    Piece p = table->items[i];
-    tot_pieces_len += p.len;
-
-    if (tot_pieces_len == place_to_edit_offset) {
-      del_char = buf(p, p.offset + p.len - 1);
-      delete_at_piece_end(table, i);
-      GOTO_END(0);
+  if (to < FRED_text_len(fe)) to += utf8_len(FRED_char_at(fe, to));
+  if (from == to) return failed;
 
-    } else if (tot_pieces_len > place_to_edit_offset){
-      size_t char_offset_in_piece =  p.len - 1 - (tot_pieces_len - place_to_edit_offset);
-      del_char = buf(p, p.offset + char_offset_in_piece);
-      failed = delete_inside_piece(table, i, char_offset_in_piece);
-      GOTO_END(failed);
-    }
-  }
+  if (FRED_yank(fe, from, to, false)) GOTO_END(1);
+  if (op == 'd' && FRED_delete_range(fe, from, to)) GOTO_END(1);
+  cr->row = get_offset_row(fe, from);
+  cr->col = from - get_line_offset(fe, cr->row);
 end:
-  if (!failed) {
-    if (del_char == '\n') {
-      if (cr->row) cr->row--;
-      cr->col = (ll->items[cr->row] & 0xffff);
-    } else {
-      if (cr->col) cr->col--;
-    }
-    fe->last_edit.cursor = *cr;
-    fe->last_edit.action = ACT_DELETE;
-  }
   return failed;
-#undef buf
-#undef AT_LAST_LINE_END
 }
 
 
 
-void dump_piece_table(FredEditor* fe, FILE* stream)
+
+// DESC: rebuilds the RowIndex if the lines or the 
+// width changed since the last time, in O(lines); the 
+// edits only changing the width of lines keep it up to 
+// date themselves, see row_index_current().
+bool row_index_update(FredEditor* fe, TermWin* tw)
 {
-  // TODO: this shits ass make it better
-  fprintf(stream, "LINES-LENGHTS:\n");
-  fprintf(stream, "arr-len: %ld\n", fe->lines_len.len );
-  for (size_t i = 0; i < fe->lines_len.len; i++){
-    fprintf(stream, "[%ld] = %d,\n", i + 1, (fe->lines_len.items[i] & 0xffff));
+  bool failed = 0;
+  RowIndex* ri = &tw->row_index;
+  LinesWidth* lw = &fe->lines_width;
+  size_t row_w = tw->width - tw->linenum_width;
+  fe->row_index = ri;
+
+  if (ri->valid && ri->row_w == row_w && ri->lines_version == fe->lines_version) return failed;
+  // NOTE: lines appended by a big file being scanned only add nodes 
+  // after the last line the tree had, which is rebuilt with them
+  size_t from = ri->valid && ri->row_w == row_w && ri->len && lines_only_appended(fe, ri->lines_version) ? ri->len - 1 : 0;
+
+  if (lw->len + 1 > ri->cap) {
+    size_t cap = ri->cap ? ri->cap : 8;
+    while (cap < lw->len + 1) cap *= 2;
+    void* temp = realloc(ri->items, cap * sizeof(*ri->items));
+    if (temp == NULL) ERROR("not enough memory for dynamic array \"RowIndex\".");
+    ri->items = temp;
+    ri->cap = cap;
   }
 
-#if 0
-  fprintf(stream, "TABLE (len: %ld, cap: %ld):\n", fe->piece_table.len, fe->piece_table.cap);
-  for (size_t i = 0; i < fe->piece_table.len; i++){
-    Piece piece = fe->piece_table.items[i];
-    char* buf = (!piece.which_buf ? fe->file_buf.text : fe->add_buf.items) + piece.offset;
-    fprintf(stream, "[%ld] => [buf = %d, offset = %ld, len = %ld]:\n", 
-            i, piece.which_buf, piece.offset, piece.len);
-
-    fprintf(stream, "%.*s\n", (int)piece.len, buf);
-    fprintf(stream, "----------------------------------------------------------------------\n");
+  if (from) {
+    // NOTE: the nodes up to 'from' cover lines before it, so they still hold; 
+    // a new node 'i' sums its line and the ones in (i - lowbit(i), i - 1]
+    ri->len = from;
+    for (size_t i = from + 1; i <= lw->len; i++) {
+      size_t below = row_index_prefix(ri, i - 1) - row_index_prefix(ri, i - (i & -i));
+      ri->items[i] = LINE_ROWS(lw->items[i - 1], row_w) + below;
+      ri->len = i;
+    }
+  } else {
+    ri->len = lw->len;
+    ri->items[0] = 0;
+    for (size_t i = 1; i <= ri->len; i++) ri->items[i] = LINE_ROWS(lw->items[i - 1], row_w);
+    for (size_t i = 1; i <= ri->len; i++) { // NOTE: linear-time Fenwick construction
+      size_t parent = i + (i & -i);
+      if (parent <= ri->len) ri->items[parent] += ri->items[i];
+    }
   }
-  fprintf(stream, "ADD-BUF:\n");
-  fprintf(stream, "%.*s\n", (int)fe->add_buf.len, fe->add_buf.items);
-  fprintf(stream, "----------------------------------------------------------------------\n");
-#endif
+
+  ri->row_w = row_w;
+  ri->lines_version = fe->lines_version;
+  ri->valid = true;
+end:
+  return failed;
 }
 
 
+// DESC: the row-index of the window showing the text if it's up to 
+// date with the lines, NULL otherwise; an edit only changing the 
+// width of some lines updates it with row_index_add() instead of 
+// it being rebuilt on the next render
+RowIndex* row_index_current(FredEditor* fe)
+{
+  RowIndex* ri = fe->row_index;
+  return ri != NULL && ri->valid && ri->lines_version == fe->lines_version ? ri : NULL;
+}
 
 
+// DESC: adds 'delta' (wrapping, to take rows away) 
+// to the visual rows of 'line', in O(log n)
+void row_index_add(RowIndex* ri, size_t line, size_t delta)
+{
+  for (size_t i = line + 1; i <= ri->len; i += i & -i) ri->items[i] += delta;
+}
 
 
-void FRED_move_cursor(FredEditor* fe, char key) 
+// DESC: visual rows taken by lines [0, lines)
+size_t row_index_prefix(RowIndex* ri, size_t lines)
 {
-  Cursor* cr = &fe->cursor;
-  cr->prev_row = cr->row;
-  cr->prev_col = cr->col;
-  size_t tot_lines = fe->lines_len.len;
-
-  // TODO: store curr line length in cursor 
+  size_t rows = 0;
+  for (size_t i = lines < ri->len ? lines : ri->len; i > 0; i -= i & -i) rows += ri->items[i];
+  return rows;
+}
 
-  if (!tot_lines) return;
 
-  switch (key){
-    case 'h': {
-      if ((int)cr->col - 1 < 0) return;
-      cr->col--;
-      return;
-    } 
-    case 'l': {
-      size_t curr_line_len = tot_lines == 0 ? 0 : (fe->lines_len.items[cr->row] & 0xffff);
-      if (cr->col + 1 > curr_line_len) return;
-      cr->col++;
-      return;
-    }
-    case 'j': {
-      if (cr->row >= tot_lines - 1) return;
-      cr->row++;
-      size_t line_len = fe->lines_len.items[cr->row] & 0xffff;
-      if (cr->col > line_len) {
-        cr->col = line_len;
-      }
-      return;
-    }
-    case 'k': {
-      if ((int64_t)cr->row - 1 < 0) return;
-      cr->row--;
-      size_t line_len = fe->lines_len.items[cr->row] & 0xffff;
-      if (cr->col > line_len) {
-        cr->col = line_len;
-      }
-      return;
+// DESC: line containing the visual row 'vrow', 
+// the last line if 'vrow' is past the text
+size_t row_index_find(RowIndex* ri, size_t vrow)
+{
+  if (!ri->len) return 0;
+  size_t step = 1;
+  while (step * 2 <= ri->len) step *= 2;
+
+  size_t line = 0; // NOTE: lines whose rows all come before 'vrow'
+  for (; step; step /= 2) {
+    if (line + step <= ri->len && ri->items[line + step] <= vrow) {
+      line += step;
+      vrow -= ri->items[line];
     }
   }
+  return line < ri->len ? line : ri->len - 1;
 }
 
 
-
-
-// FIXME: broken on small resized win + what the fuck 
+// DESC: keeps the cursor within 5 rows from the middle 
+// of the screen, scrolling by whole lines; rows and columns 
+// are in display cells, so lines with tabs wrap the same 
+// way they are rendered.
 void update_win_cursor(FredEditor* fe, TermWin* tw)
 {
-  LinesLen* ll = &fe->lines_len;
-  if (ll->items == NULL || !ll->len) return;
+  LinesWidth* lw = &fe->lines_width;
+  if (lw->items == NULL || !lw->len) return;
+  if (fe->nowrap) {
+    update_win_cursor_nowrap(fe, tw);
+    return;
+  }
+  tw->hscroll = 0;
+  if (row_index_update(fe, tw)) return;
 
+  RowIndex* ri = &tw->row_index;
   Cursor* cr = &fe->cursor;
   size_t tw_row_w = tw->width - tw->linenum_width;
+  if (tw->lines_to_scroll >= lw->len) tw->lines_to_scroll = lw->len - 1;
+
+  size_t disp_col = FRED_get_disp_col(fe, cr->row, cr->col);
+  cr->win_col = disp_col % tw_row_w;
+
+  size_t text_rows = tw->height > 1 ? tw->height - 1 : 1; // NOTE: last row is the status-line
+  size_t mid = text_rows / 2;
+  size_t lo = mid > 5 ? mid - 5 : 0;
+  size_t hi = mid + 5 < text_rows ? mid + 5 : text_rows - 1;
+
+  size_t curs_vrow = row_index_prefix(ri, cr->row) + disp_col / tw_row_w;
+  size_t top_vrow = row_index_prefix(ri, tw->lines_to_scroll);
+
+  if (curs_vrow > top_vrow + hi) { // NOTE: first line whose start keeps the cursor within 'hi'
+    size_t target = curs_vrow - hi;
+    size_t line = row_index_find(ri, target);
+    if (row_index_prefix(ri, line) < target) line++;
+    tw->lines_to_scroll = line < cr->row ? line : cr->row;
+  } else if (curs_vrow < top_vrow + lo) { // NOTE: last line whose start keeps the cursor past 'lo'
+    size_t target = curs_vrow > lo ? curs_vrow - lo : 0;
+    tw->lines_to_scroll = row_index_find(ri, target);
+  }
+  if (tw->lines_to_scroll > cr->row) tw->lines_to_scroll = cr->row;
 
-  size_t win_col = cr->col % tw_row_w;
-  cr->win_col = win_col;
+  cr->win_row = curs_vrow - row_index_prefix(ri, tw->lines_to_scroll);
+}
 
-  size_t mid = tw->height * 0.5;
 
-  if (cr->win_row > mid + 5) {
-    size_t curr_line_rows = (ll->items[cr->row] & 0xffff) / tw_row_w + 1;
-    size_t rows = (ll->items[tw->lines_to_scroll++] & 0xffff) / tw_row_w + 1; // first line on the screen 
-    // NOTE: the 2nd check will render the current line closer the center if it's wrapped
-    while (rows < curr_line_rows || (curr_line_rows > 1 && rows <= curr_line_rows)) {
-      rows += (ll->items[++tw->lines_to_scroll] & 0xffff) / tw_row_w + 1;
-    }
-  } else if (tw->lines_to_scroll && cr->win_row < mid - 5) {
-    size_t prev_line_rows = (ll->items[cr->prev_row] & 0xffff) / tw_row_w + 1;
-    size_t rows = (ll->items[--tw->lines_to_scroll] & 0xffff) / tw_row_w + 1;
-    while (tw->lines_to_scroll && rows < prev_line_rows) {
-      rows += (ll->items[--tw->lines_to_scroll] & 0xffff) / tw_row_w + 1;
+// DESC: same margins as update_win_cursor(), but every line takes 
+// one row; the screen also scrolls sideways just enough to 
+// keep the cursor's display column on it
+void update_win_cursor_nowrap(FredEditor* fe, TermWin* tw)
+{
+  Cursor* cr = &fe->cursor;
+  size_t tw_row_w = tw->width - tw->linenum_width;
+  size_t text_rows = tw->height > 1 ? tw->height - 1 : 1; // NOTE: last row is the status-line
+  size_t mid = text_rows / 2;
+  size_t lo = mid > 5 ? mid - 5 : 0;
+  size_t hi = mid + 5 < text_rows ? mid + 5 : text_rows - 1;
+
+  if (cr->row > tw->lines_to_scroll + hi) tw->lines_to_scroll = cr->row - hi;
+  else if (cr->row < tw->lines_to_scroll + lo) tw->lines_to_scroll = cr->row > lo ? cr->row - lo : 0;
+  cr->win_row = cr->row - tw->lines_to_scroll;
+
+  size_t disp_col = FRED_get_disp_col(fe, cr->row, cr->col);
+  if (disp_col < tw->hscroll) tw->hscroll = disp_col;
+  else if (disp_col >= tw->hscroll + tw_row_w) tw->hscroll = disp_col - tw_row_w + 1;
+  cr->win_col = disp_col - tw->hscroll;
+}
+
+
+// DESC: moves the cursor to the start of 'line' (1-based, 
+// clamped to the text), the screen follows in update_win_cursor().
+bool FRED_jump_to_line(FredEditor* fe, size_t line)
+{
+  bool failed = 0;
+  Cursor* cr = &fe->cursor;
+  // NOTE: a big file still being scanned gets scanned up to the line
+  if (FRED_index_until(fe, line ? line - 1 : 0)) GOTO_END(1);
+  size_t tot_lines = fe->lines_len.len;
+  if (!tot_lines) return failed;
+  cr->prev_row = cr->row;
+  cr->prev_col = cr->col;
+  if (line < 1) line = 1;
+  if (line > tot_lines) line = tot_lines;
+  cr->row = line - 1;
+  cr->col = 0;
+end:
+  return failed;
+}
+
+
+// DESC: ':s/pat/rep/' on the cursor's line, or ':%s/pat/rep/' on all 
+// of them, with a 'g' at the end for all the matches of a line. The 
+// pattern is plain text like for '/' ('\/' for a '/', '\\' for a 
+// '\'), an empty one is the last '/' pattern, and becomes it.
+bool exec_substitute(FredEditor* fe, const char* cmd)
+{
+  bool failed = 0;
+  bool whole_text = cmd[0] == '%';
+  const char* c = cmd + whole_text + 1;
+  char parts[2][CMDLINE_MAX_LEN];
+  size_t parts_len[2] = {0};
+  for (size_t i = 0; i < 2 && *c == '/'; i++) {
+    for (c++; *c && *c != '/'; c++) {
+      if (*c == '\\' && (c[1] == '/' || c[1] == '\\')) c++;
+      parts[i][parts_len[i]++] = *c;
     }
   }
-  
-  // NOTE: loops from the 1st line on the screen
-  size_t win_row = 0;
-  for (size_t i = tw->lines_to_scroll; i < cr->row; i++) {
-    size_t line_len = (ll->items[i] & 0xffff);
-    if (line_len < tw_row_w) win_row++;
-    else win_row += line_len / tw_row_w + 1;
+  if (*c == '/') c++;
+  bool global = KEY_IS(c, "g");
+  if (*c && !global) return failed; // NOTE: a flag it doesn't know
+
+  SearchPattern* sp = &fe->search;
+  if (parts_len[0]) {
+    memcpy(sp->items, parts[0], parts_len[0]);
+    sp->len = parts_len[0];
+  }
+  if (whole_text && FRED_index_until(fe, SIZE_MAX)) GOTO_END(1);
+  size_t top = whole_text ? 0 : fe->cursor.row;
+  size_t bottom = whole_text ? fe->lines_len.len - 1 : fe->cursor.row;
+  failed = FRED_substitute(fe, top, bottom, sp->items, sp->len, parts[1], parts_len[1], global);
+end:
+  return failed;
+}
+
+
+// DESC: runs the ':' command typed so far, or searches the '/' 
+// pattern (the last one if empty); unknown commands are ignored.
+bool exec_cmdline(FredEditor* fe, bool* running)
+{
+  bool failed = 0;
+  CmdLine* cl = &fe->cmdline;
+  char cmd[CMDLINE_MAX_LEN + 1] = {0};
+  memcpy(cmd, cl->items, cl->len);
+
+  if (cl->kind == '/') {
+    if (cl->len) {
+      memcpy(fe->search.items, cl->items, cl->len);
+      fe->search.len = cl->len;
+    }
+    failed = FRED_search(fe, true, 1);
+  } else if (KEY_IS(cmd, "q")) {
+    *running = false;
+  } else if (KEY_IS(cmd, "set wrap") || KEY_IS(cmd, "set nowrap")) {
+    fe->nowrap = cmd[4] == 'n';
+  } else if (KEY_IS(cmd, "bn") || KEY_IS(cmd, "bp")) {
+    fe->buf_switch = (BufferSwitch){ .kind = cmd[1] };
+  } else if (cmd[0] == 'b') {
+    char* num_start = cmd + 1;
+    while (*num_start == ' ') num_start++;
+    char* num_end = NULL;
+    unsigned long long num = strtoull(num_start, &num_end, 10);
+    if (num_end != num_start && *num_end == '\0') fe->buf_switch = (BufferSwitch){ .kind = 'b', .num = num };
+  } else if (cl->len && cmd[0] >= '0' && cmd[0] <= '9') {
+    char* num_end = NULL;
+    unsigned long long line = strtoull(cmd, &num_end, 10);
+    if (*num_end == '\0') failed = FRED_jump_to_line(fe, line);
+  } else if (strncmp(cmd, "s/", 2) == 0 || strncmp(cmd, "%s/", 3) == 0) {
+    failed = exec_substitute(fe, cmd);
   }
-  cr->win_row = win_row + cr->col / tw_row_w;
+  return failed;
 }
 
 
+bool handle_cmdline_input(FredEditor* fe, bool* running, char* key)
+{
+  bool failed = 0;
+  CmdLine* cl = &fe->cmdline;
+  if (KEY_IS(key, "\x1b") || KEY_IS(key, "\x1b ")) {
+    cl->active = false;
+  } else if (KEY_IS(key, "\r") || KEY_IS(key, "\n")) {
+    failed = exec_cmdline(fe, running);
+    cl->active = false;
+  } else if (KEY_IS(key, "\x7f")) {
+    if (!cl->len) cl->active = false;
+    else cl->len--;
+  } else if (key[0] >= SPACE_CH && key[0] < 0x7f && key[1] == '\0' && cl->len < CMDLINE_MAX_LEN) {
+    cl->items[cl->len++] = key[0];
+  }
+  return failed;
+}
+
 
 
 
@@ -869,84 +5002,556 @@ bool FRED_handle_input(FredEditor* fe, bool* running, bool* insert, char* key, s
   fe->cursor.prev_row = fe->cursor.row;
   fe->cursor.prev_col = fe->cursor.col;
 
+  MultiCursors* mc = &fe->multi;
+  if (*insert && mc->len) { // NOTE: a block insert, until a key that can't be applied at all its cursors
+    if (KEY_IS(key, "\x1b") || KEY_IS(key, "\x1b ") || KEY_IS(key, "\r") || 
+        (KEY_IS(key, "\x7f") && !mc->typed)) {
+      mc->len = 0;
+    } else if (KEY_IS(key, "\x7f")) {
+      if (FRED_multi_delete(fe)) GOTO_END(1);
+      GOTO_END(failed);
+    } else if (key[0] != '\n' && (bytes_read == 1 || (size_t)bytes_read == utf8_len(key[0]))) {
+      for (ssize_t i = 0; i < bytes_read; i++) {
+        if (FRED_multi_insert(fe, key[i])) GOTO_END(1);
+      }
+      GOTO_END(failed);
+    } else {
+      mc->len = 0;
+    }
+  }
+
   if (*insert){
     if (KEY_IS(key, "\x1b") || KEY_IS(key, "\x1b ")){ // escape
+      if (!LOCUS_AT_CURSOR(fe)) fe->last_edit.locus_valid = false; // NOTE: cached for the old cursor
       fe->last_edit.cursor = fe->cursor;
       *insert = false;
     } else if (KEY_IS(key, "\x7f")){
       if (FRED_delete_text(fe)) GOTO_END(1);
     } else if (bytes_read == 1) {
       if (FRED_insert_text(fe, key[0])) GOTO_END(1);
+    } else if ((size_t)bytes_read == utf8_len(key[0])) { // NOTE: a single utf-8 char
+      for (ssize_t i = 0; i < bytes_read; i++) {
+        if (FRED_insert_text(fe, key[i])) GOTO_END(1);
+      }
     }
-    if (FRED_get_lines_len(fe)) GOTO_END(1);
+  } else if (fe->cmdline.active) {
+    if (handle_cmdline_input(fe, running, key)) GOTO_END(1);
   } else {
-    if (KEY_IS(key, "h") || KEY_IS(key, "j") || KEY_IS(key, "k") || KEY_IS(key, "l"))  {
-      FRED_move_cursor(fe, key[0]);
+    PendingKeys* pk = &fe->pending;
+    char prefix = pk->prefix;
+    pk->prefix = 0;
+    if (bytes_read == 1 && key[0] >= '0' && key[0] <= '9' && (key[0] != '0' || pk->count)) {
+      if (pk->count < UINT32_MAX) pk->count = pk->count * 10 + (key[0] - '0');
+      if (prefix == 'd' || prefix == 'y') pk->prefix = prefix; // NOTE: the count of its motion, like 'd3w'
+      GOTO_END(failed);
+    }
+    size_t count = pk->count;
+    pk->count = 0;
+
+    if (prefix == 'g') {
+      if (KEY_IS(key, "g") && FRED_jump_to_line(fe, count ? count : 1)) GOTO_END(1);
+    } else if (prefix == 'd' || prefix == 'y') { // NOTE: any other key than these drops it
+      size_t n = pk->op_count || count ? (pk->op_count ? pk->op_count : 1) * (count ? count : 1) : 0;
+      pk->op_count = 0;
+      if (bytes_read == 1 && key[0] == prefix) {
+        if (FRED_line_op(fe, prefix, n)) GOTO_END(1);
+      } else if (bytes_read == 1 && key[0] && strchr(MOTION_KEYS, key[0])) {
+        if (FRED_motion_op(fe, prefix, key[0], n)) GOTO_END(1);
+      }
+    } else if (fe->visual.kind && (KEY_IS(key, "d") || KEY_IS(key, "y"))) {
+      if (FRED_visual_op(fe, key[0])) GOTO_END(1);
+    } else if (KEY_IS(key, "d") || KEY_IS(key, "y")) {
+      pk->prefix = key[0];
+      pk->op_count = count;
+    } else if (KEY_IS(key, "p")) {
+      if (FRED_put(fe, count)) GOTO_END(1);
+    } else if (KEY_IS(key, "v") || KEY_IS(key, "V")) {
+      fe->visual = (Visual){ .kind = fe->visual.kind == key[0] ? 0 : key[0], 
+                             .anchor_row = fe->cursor.row, .anchor_col = fe->cursor.col };
+      if (fe->visual.kind) mc->selecting = false;
+    } else if (KEY_IS(key, "g")) {
+      pk->prefix = 'g';
+      pk->count = count;
+    } else if (KEY_IS(key, "G")) {
+      if (!count && FRED_index_until(fe, SIZE_MAX)) GOTO_END(1); // NOTE: the last line of all
+      if (FRED_jump_to_line(fe, count ? count : fe->lines_len.len)) GOTO_END(1);
+    } else if (bytes_read == 1 && key[0] && strchr(MOTION_KEYS, key[0])) {
+      // NOTE: enough lines for the motion and the screen after it, 
+      // in case the file is still being scanned
+      size_t rows = fe->win_rows ? fe->win_rows : 1;
+      if (FRED_index_until(fe, fe->cursor.row + (count ? count : 1) * rows + rows)) GOTO_END(1);
+      FRED_move_cursor(fe, key[0], count);
+    } else if (KEY_IS(key, "n") || KEY_IS(key, "N")) {
+      if (FRED_search(fe, key[0] == 'n', count)) GOTO_END(1);
     } else if (KEY_IS(key, "q")) {
       *running = false;
     } else if (KEY_IS(key, "i")) {
-      *insert = true;
+      *insert = !fe->read_only;
+      mc->selecting = false;
+      fe->visual.kind = 0;
+    } else if (KEY_IS(key, "I")) {
+      fe->visual.kind = 0;
+      if (!fe->read_only && FRED_block_insert_start(fe)) GOTO_END(1);
+      *insert = !fe->read_only;
+    } else if (KEY_IS(key, "\x16")) { // NOTE: Ctrl-V
+      mc->selecting = !mc->selecting;
+      mc->anchor_row = fe->cursor.row;
+      mc->anchor_disp_col = FRED_get_disp_col(fe, fe->cursor.row, fe->cursor.col);
+      fe->visual.kind = 0;
+    } else if (KEY_IS(key, ":") || KEY_IS(key, "/")) {
+      fe->cmdline.active = true;
+      fe->cmdline.len = 0;
+      fe->cmdline.kind = key[0];
+      fe->visual.kind = 0;
     } else if (KEY_IS(key, "\x1b") || KEY_IS(key, "\x1b ")) {
       *insert = false;
+      mc->selecting = false;
+      fe->visual.kind = 0;
     }
   }
 end:
   return failed;
 }
 
-bool FRED_start_editor(FredEditor* fe, const char* file_path)
+// DESC: reads the buffer's file, the first time it gets shown, 
+// with the settings 'bl' has for new buffers
+bool buffer_load(Buffer* buf, BufferList* bl)
 {
   bool failed = 0;
-  bool running = true;
-  bool insert = false;
+  if (buf->loaded) return failed;
+  buf->fe.tab_width = bl->tab_width; // NOTE: so the lines get scanned once, with it
+  buf->fe.index_threads = bl->index_threads;
+  buf->fe.progressive = true; // NOTE: the rest of a big file gets scanned between keys
+  buf->fe.read_only = bl->read_only;
+  buf->fe.lines_cache = bl->lines_cache;
+  buf->fe.nowrap = bl->read_only; // NOTE: a pager cuts long lines, ':set wrap' wraps them
+  if (fred_editor_init(&buf->fe, buf->file_path)) GOTO_END(1);
+  buf->loaded = true;
+  if (bl->follow && FRED_follow_start(&buf->fe, buf->file_path, bl->notify_fd)) GOTO_END(1);
+end:
+  return failed;
+}
 
-  // TODO: make a term_win_init();
-  TermWin tw = {0};
-  tw.table_text = (TableText){0};
-  tw.ho = (HighlightOffsets){0};
-  tw.linenum_width = 8;
-  if (FRED_win_resize(&tw)) GOTO_END(1);
 
-  if (FRED_get_lines_len(fe)) GOTO_END(1);
-  if (build_table_text_for_render(fe, &tw)) GOTO_END(1);
-  if (FRED_get_text_to_render(fe, &tw, insert)) GOTO_END(1); 
-  
-#if 1
-  while (running) {
-    if (FRED_render_text(&tw, &fe->cursor)) GOTO_END(1);
+// DESC: exchanges the render caches in the TermWin with the 
+// ones parked in 'buf'; swapping out the buffer on the screen 
+// and then swapping in the next one leaves every buffer with 
+// its own caches and the TermWin with the ones on the screen
+void buffer_swap_render(Buffer* buf, TermWin* tw)
+{
+#define SWAP(type, a, b) do { type tmp = (a); (a) = (b); (b) = tmp; } while (0)
+  SWAP(RowIndex, buf->row_index, tw->row_index);
+  buf->fe.row_index = NULL; // NOTE: set again when it gets rendered
+  SWAP(size_t, buf->lines_to_scroll, tw->lines_to_scroll);
+  SWAP(size_t, buf->hscroll, tw->hscroll);
+#undef SWAP
+}
 
-    char key[MAX_KEY_LEN] = {0};
-    ssize_t bytes_read = read(STDIN_FILENO, key, MAX_KEY_LEN);
-    if (bytes_read == -1) {
-      if (errno == EINTR){
-        if (FRED_win_resize(&tw)) GOTO_END(1);
-        if (FRED_get_text_to_render(fe, &tw, insert)) GOTO_END(1); 
-        update_win_cursor(fe, &tw);
-        continue;
+
+// DESC: puts the buffer at 'idx' on the screen, loading it 
+// the first time; its row-index gets built when first rendered
+bool show_buffer(BufferList* bl, TermWin* tw, size_t idx)
+{
+  bool failed = 0;
+  Buffer* buf = &bl->items[idx];
+
+  if (buffer_load(buf, bl)) GOTO_END(1);
+  buffer_swap_render(&bl->items[bl->current], tw);
+  bl->current = idx;
+  buffer_swap_render(buf, tw);
+
+  FredEditor* fe = &buf->fe;
+  fe->win_rows = tw->height - 1;
+  update_win_cursor(fe, tw);
+
+  tw->buf_name = buf->file_path;
+  tw->buf_num = idx + 1;
+  tw->bufs_count = bl->len;
+end:
+  return failed;
+}
+
+
+// DESC: carries out the ':bn', ':bp' or ':b N' asked by the 
+// current buffer's last command; out of range numbers are ignored
+bool switch_buffer(BufferList* bl, TermWin* tw)
+{
+  bool failed = 0;
+  BufferSwitch* bs = &bl->items[bl->current].fe.buf_switch;
+  size_t idx = bl->current;
+  if      (bs->kind == 'n') idx = (bl->current + 1) % bl->len;
+  else if (bs->kind == 'p') idx = (bl->current + bl->len - 1) % bl->len;
+  else if (bs->kind == 'b' && bs->num >= 1 && bs->num <= bl->len) idx = bs->num - 1;
+  *bs = (BufferSwitch){0};
+
+  if (idx != bl->current) failed = show_buffer(bl, tw, idx);
+  return failed;
+}
+
+
+void FRED_free_buffers(BufferList* bl)
+{
+  for (size_t i = 0; i < bl->len; i++) {
+    Buffer* buf = &bl->items[i];
+    if (buf->loaded) fred_editor_free(&buf->fe);
+    free(buf->row_index.items);
+  }
+  DA_FREE(bl, 1);
+}
+
+
+// DESC: length of the first key in 'input': a whole escape sequence 
+// (ESC '[' or ESC 'O' up to its final byte), a whole utf-8 char or 
+// a single byte; 0 if the key got cut at the end of 'input'
+size_t next_key_len(const char* input, size_t len)
+{
+  unsigned char c = input[0];
+  if (c == ESC_CH) {
+    if (len < 2 || (input[1] != '[' && input[1] != 'O')) return 1; // NOTE: a lone escape
+    size_t i = 2;
+    if (input[1] == '[') {
+      while (i < len && !(input[i] >= 0x40 && input[i] <= 0x7e)) i++;
+    }
+    return i < len ? i + 1 : 0;
+  }
+  size_t n = utf8_len(c);
+  for (size_t i = 1; i < n; i++) {
+    if (i >= len) return 0;
+    if (!IS_UTF8_CONT(input[i])) return 1; // NOTE: invalid, the lead byte goes alone
+  }
+  return n;
+}
+
+
+// DESC: flushes the journals of the loaded buffers, and syncs them 
+// too if 'sync'. A journal that can't be written gets dropped, the 
+// editor goes on without it.
+void flush_journals(BufferList* bl, bool sync)
+{
+  for (size_t i = 0; i < bl->len; i++) {
+    FredEditor* fe = &bl->items[i].fe;
+    if (!bl->items[i].loaded || fe->journal.path == NULL) continue;
+    if (FRED_journal_flush(fe) || (sync && FRED_journal_sync(fe))) FRED_journal_close(fe, false);
+  }
+}
+
+
+// DESC: whether a followed file of a loaded buffer had an 
+// event not looked at yet
+bool follow_changed(BufferList* bl)
+{
+  for (size_t i = 0; i < bl->len; i++) {
+    if (bl->items[i].loaded && bl->items[i].fe.follow.changed) return true;
+  }
+  return false;
+}
+
+
+// DESC: marks the buffers whose followed file had an event, 
+// reading all the events queued on the inotify fd
+void read_follow_events(BufferList* bl)
+{
+  char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t n;
+  while ((n = read(bl->notify_fd, events, sizeof(events))) > 0) {
+    for (char* e = events; e < events + n; e += sizeof(struct inotify_event) + ((struct inotify_event*)e)->len) {
+      int wd = ((struct inotify_event*)e)->wd;
+      for (size_t i = 0; i < bl->len; i++) {
+        FredEditor* fe = &bl->items[i].fe;
+        if (bl->items[i].loaded && fe->follow.fd != -1 && fe->follow.wd == wd) fe->follow.changed = true;
+      }
+    }
+  }
+}
+
+
+// DESC: merges in what other writers changed in the files of the loaded 
+// buffers (a followed one only gets appended to, see FRED_follow_check()); 
+// a file that can't be merged in stays as it was till it changes again. 
+// Whether the screen needs a new frame: the text on it changed, or a 
+// failed reload left its error on it.
+bool reload_files(BufferList* bl)
+{
+  bool redraw = false;
+  for (size_t i = 0; i < bl->len; i++) {
+    Buffer* buf = &bl->items[i];
+    FredEditor* fe = &buf->fe;
+    // NOTE: not under a block insert, its cursors hold rows and pieces
+    if (!buf->loaded || fe->follow.fd != -1 || !fe->index.done || fe->multi.len) continue;
+    size_t version = fe->lines_version;
+    if (FRED_reload_check(fe, buf->file_path)) {
+      redraw = true;
+      continue;
+    }
+    if (fe->lines_version == version) continue;
+    if (i == bl->current) redraw = true;
+    // NOTE: the journal starts over with the reload, the edits 
+    // go in it now rather than with the next key
+    if (fe->journal.path != NULL && (FRED_journal_flush(fe) || FRED_journal_sync(fe))) FRED_journal_close(fe, false);
+  }
+  return redraw;
+}
+
+
+// DESC: work put off until no key has come in for IDLE_WORK_MS
+bool run_idle_work(BufferList* bl)
+{
+  bool failed = 0;
+  FRED_compact_pieces(&bl->items[bl->current].fe);
+  flush_journals(bl, true);
+  return failed;
+}
+
+
+// DESC: after a slice of a big file got in the text: a followed file's 
+// last line stays on the screen, like 'tail -f'; whether a new frame 
+// is due for the "indexing N%" status
+bool index_shown(FredEditor* fe, TermWin* tw, double* index_drawn_ms)
+{
+  if (fe->follow.at_end) {
+    fe->cursor.row = fe->lines_len.len - 1;
+    fe->cursor.col = 0;
+    update_win_cursor(fe, tw);
+    if (fe->index.done) fe->follow.at_end = false; // NOTE: till the next growth
+  }
+  if (fe->index.done || monotonic_ms() - *index_drawn_ms >= INDEX_REDRAW_MS) {
+    *index_drawn_ms = monotonic_ms();
+    return true;
+  }
+  return false;
+}
+
+
+// DESC: one pass of the editor's loop: waits for input, or for the next 
+// look at the files, then handles what came; a new frame once all the 
+// input ready got handled
+bool editor_pass(BufferList* bl, EditorLoop* el)
+{
+  bool failed = 0;
+  TermWin* tw = &el->tw;
+  struct pollfd* fds = el->fds;
+  FredEditor* fe = &bl->items[bl->current].fe;
+
+  if (el->fault != NULL) { // NOTE: the last pass read past the end of a file cut under it
+    const char* fault = el->fault;
+    el->fault = NULL;
+    for (size_t i = 0; i < bl->len; i++) {
+      if (bl->items[i].loaded && file_buf_cut_at(&bl->items[i].fe, fault)) GOTO_END(1);
+    }
+    update_win_cursor(fe, tw);
+  }
+  if (el->input_used) { // NOTE: and its keys, up to the one it was handling, are done
+    memmove(el->input, el->input + el->input_used, el->input_len - el->input_used);
+    el->input_len -= el->input_used;
+    el->input_used = 0;
+  }
+
+  // NOTE: a new frame only once the input ready is all handled, 
+  // so a burst of keys (a paste, key-repeat) costs one render; 
+  // a big file's slices come from the worker through fds[4], 
+  // polled like a key, only without one they get scanned here
+  fds[4].fd = fe->index.worker_on ? fe->index.event_fd : -1;
+  int timeout = el->dirty || (!fe->index.done && !fe->index.worker_on) ? 0 : -1;
+  if (timeout == -1) { // NOTE: woken up for the next look at the files
+    double wait = RELOAD_CHECK_MS - (monotonic_ms() - el->reload_checked_ms);
+    double follow_wait = FOLLOW_CHECK_MS - (monotonic_ms() - el->follow_checked_ms);
+    if (follow_changed(bl) && follow_wait < wait) wait = follow_wait;
+    timeout = wait > 0 ? (int)wait + 1 : 0;
+  }
+  int ready = poll(fds, 5, timeout);
+  if (ready == -1) {
+    if (errno == EINTR) return failed;
+    ERROR("failed to wait for input. %s.", strerror(errno));
+  }
+  if (ready == 0 && el->dirty) {
+    if (FRED_get_text_to_render(fe, tw, el->insert)) GOTO_END(1); 
+    if (FRED_render_text(tw, &fe->cursor)) GOTO_END(1);
+    el->dirty = false;
+    return failed;
+  }
+  if (ready == 0) { // NOTE: nothing else to do, a big file gets scanned on
+    bool follow_due = monotonic_ms() - el->follow_checked_ms >= FOLLOW_CHECK_MS;
+    if (follow_changed(bl) && (follow_due || !fe->index.done)) {
+      // NOTE: however many events, the followed files get looked at 
+      // every FOLLOW_CHECK_MS at most, what they grew by gets scanned 
+      // in steps like the rest of a big file; but a step never 
+      // reads a file that may have been cut since the last look
+      for (size_t i = 0; i < bl->len; i++) {
+        if (bl->items[i].loaded && bl->items[i].fe.follow.changed && FRED_follow_check(&bl->items[i].fe)) GOTO_END(1);
+      }
+      el->follow_checked_ms = monotonic_ms();
+      if (fe->follow.truncated) el->dirty = true;
+    }
+    if (monotonic_ms() - el->reload_checked_ms >= RELOAD_CHECK_MS) {
+      if (reload_files(bl)) {
+        update_win_cursor(fe, tw);
+        el->dirty = true;
       }
-      ERROR("failed to read from stdin");
+      el->reload_checked_ms = monotonic_ms();
+    }
+    if (fe->index.done || fe->index.worker_on) return failed;
+    FRED_index_start(fe);
+    if (fe->index.worker_on) return failed;
+    if (FRED_index_step(fe, LINES_INDEX_SLICE)) GOTO_END(1);
+    if (index_shown(fe, tw, &el->index_drawn_ms)) el->dirty = true;
+    return failed;
+  }
+
+  if (fds[3].revents & POLLIN) read_follow_events(bl);
+
+  if (fds[4].revents & POLLIN) {
+    size_t version = fe->lines_version;
+    if (FRED_index_take(fe)) GOTO_END(1);
+    if (fe->file_cut) el->dirty = true;
+    if (fe->lines_version != version && index_shown(fe, tw, &el->index_drawn_ms)) el->dirty = true;
+  }
+
+  if (fds[1].revents & POLLIN) {
+    struct signalfd_siginfo si;
+    while (read(el->sig_fd, &si, sizeof(si)) == sizeof(si)); // NOTE: many resizes, one new size
+    if (FRED_win_resize(tw)) GOTO_END(1);
+    fe->win_rows = tw->height - 1;
+    update_win_cursor(fe, tw);
+    el->dirty = true;
+  }
+
+  if (fds[2].revents & POLLIN) {
+    uint64_t expirations = 0;
+    if (read(el->timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+      if (run_idle_work(bl)) GOTO_END(1);
+      el->dirty = true; // NOTE: a dropped journal may have left an error on the screen
     }
+  }
 
-    if (bytes_read > 0) {
-      bool was_insert = insert;
-      if (FRED_handle_input(fe, &running, &insert, key, bytes_read)) GOTO_END(1);
-      update_win_cursor(fe, &tw);
-      if (was_insert) {
-        if (build_table_text_for_render(fe, &tw)) GOTO_END(1);
+  if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+    ssize_t bytes_read = read(STDIN_FILENO, el->input + el->input_len, sizeof(el->input) - el->input_len);
+    if (bytes_read == -1) {
+      if (errno == EINTR || errno == EAGAIN) return failed;
+      ERROR("failed to read from stdin. %s.", strerror(errno));
+    }
+    if (bytes_read == 0) { // NOTE: the terminal is gone
+      el->running = false;
+      return failed;
+    }
+    bool cut_by_read = el->input_len + bytes_read == sizeof(el->input);
+    el->input_len += bytes_read;
+
+    size_t i = 0;
+    while (i < el->input_len && el->running) {
+      size_t key_len = next_key_len(el->input + i, el->input_len - i);
+      if (!key_len) {
+        if (cut_by_read) break; // NOTE: the rest comes with the next read
+        key_len = el->input_len - i;
+      }
+      char key[MAX_KEY_LEN] = {0};
+      memcpy(key, el->input + i, key_len < MAX_KEY_LEN - 1 ? key_len : MAX_KEY_LEN - 1);
+      i += key_len;
+      el->input_used = i; // NOTE: a key that faults isn't handled again
+      if (FRED_handle_input(fe, &el->running, &el->insert, key, key_len)) GOTO_END(1);
+      if (fe->buf_switch.kind) {
+        if (switch_buffer(bl, tw)) GOTO_END(1);
+        fe = &bl->items[bl->current].fe;
       }
-      if (FRED_get_text_to_render(fe, &tw, insert)) GOTO_END(1); 
     }
+    memmove(el->input, el->input + i, el->input_len - i);
+    el->input_len -= i;
+    el->input_used = 0;
+    fe->follow.at_end = false; // NOTE: the cursor goes where the keys take it
+    fe->reload.reloaded = false;
+    fe->file_cut = false;
+
+    update_win_cursor(fe, tw);
+    el->dirty = true;
+    // NOTE: steady typing never lets the idle timer fire, 
+    // the journal still gets flushed (not synced) this often
+    if (monotonic_ms() - fe->journal.last_flush_ms >= JOURNAL_MAX_DELAY_MS) flush_journals(bl, false);
+    if (-1 == timerfd_settime(el->timer_fd, 0, &el->idle_timer, NULL)) {
+      ERROR("failed to set the idle timer. %s.", strerror(errno));
+    }
+  }
+end:
+  return failed;
+}
+
+
+// DESC: editor_pass() under a guard: a read past the end of a mapped 
+// file someone else cut (see file_buf_sigbus()) lands back here, the 
+// pass is dropped where it was and the next one cuts the text to what's 
+// left of the file. Nothing the pass left half done is relied on: the 
+// piece-table is whole between any two of its writes, and the lines, 
+// cursors and screen get made again from it.
+bool editor_pass_guarded(BufferList* bl, EditorLoop* el)
+{
+  sigjmp_buf guard;
+  if (sigsetjmp(guard, 1)) {
+    file_buf_guard = NULL;
+    el->fault = file_buf_fault;
+    el->dirty = true;
+    return 0;
+  }
+  file_buf_guard = &guard;
+  bool failed = editor_pass(bl, el);
+  file_buf_guard = NULL;
+  return failed;
+}
+
+
+bool FRED_start_editor(BufferList* bl)
+{
+  bool failed = 0;
+  EditorLoop loop = { .running = true, .sig_fd = -1, .timer_fd = -1, .dirty = true };
+  EditorLoop* el = &loop;
+
+  // TODO: make a term_win_init();
+  TermWin* tw = &el->tw;
+  tw->linenum_width = 8;
+  if (FRED_win_resize(tw)) GOTO_END(1);
+
+  if (bl->follow) { // NOTE: before the first buffer gets loaded, which starts watching its file
+    bl->notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (bl->notify_fd == -1) ERROR("failed to set up the editor to follow the files. %s.", strerror(errno));
+  }
+  if (show_buffer(bl, tw, 0)) GOTO_END(1);
+
+  // NOTE: SIGWINCH is blocked by the caller and read from 
+  // 'sig_fd' instead, like any other input
+  sigset_t winch;
+  sigemptyset(&winch);
+  sigaddset(&winch, SIGWINCH);
+  el->sig_fd = signalfd(-1, &winch, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (el->sig_fd == -1) ERROR("failed to set up the editor to detect window changes. %s.", strerror(errno));
+  el->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (el->timer_fd == -1) ERROR("failed to create the idle timer. %s.", strerror(errno));
+  el->idle_timer = (struct itimerspec){ .it_value = { .tv_sec = IDLE_WORK_MS / 1000, .tv_nsec = (IDLE_WORK_MS % 1000) * 1000000 } };
+
+  el->fds[0] = (struct pollfd){ .fd = STDIN_FILENO, .events = POLLIN };
+  el->fds[1] = (struct pollfd){ .fd = el->sig_fd, .events = POLLIN };
+  el->fds[2] = (struct pollfd){ .fd = el->timer_fd, .events = POLLIN };
+  el->fds[3] = (struct pollfd){ .fd = bl->notify_fd, .events = POLLIN }; // NOTE: -1 without '--follow', poll() skips it
+  el->fds[4] = (struct pollfd){ .fd = -1, .events = POLLIN }; // NOTE: the indexing worker of the buffer on the screen, if any
+  el->reload_checked_ms = monotonic_ms();
+  
+  while (el->running) {
+    if (editor_pass_guarded(bl, el)) GOTO_END(1);
   }
-#endif 
 end:
   if (!failed) { // NOTE: else the ERROR() macro has already cleared the screen
     fprintf(stdout, "\x1b[2J\x1b[H");
+    for (size_t i = 0; i < bl->len; i++) {
+      if (bl->items[i].loaded) FRED_journal_close(&bl->items[i].fe, true);
+    }
+  } else {
+    flush_journals(bl, true); // NOTE: kept for the next start to recover
   }
-  // dump_piece_table(fe, stdout);
-  fred_editor_free(fe);
-  free(tw.elems);
-  free(tw.table_text.items);
-  free(tw.ho.items);
+  free(tw->elems);
+  free(tw->cps);
+  free(tw->attrs);
+  free(tw->row_index.items); // NOTE: the caches of the buffer on the screen, 
+                             // it has nothing parked
+  if (el->sig_fd != -1) close(el->sig_fd);
+  if (el->timer_fd != -1) close(el->timer_fd);
+  if (bl->notify_fd != -1) close(bl->notify_fd);
+  bl->notify_fd = -1;
   return failed;
 }
 
@@ -9,11 +9,65 @@
 
 #define ADD_BUF_INIT_CAP 512
 #define PIECE_TABLE_INIT_CAP 8 
-#define TABLE_TEXT_INIT_CAP 512
+#define TAB_WIDTH_DEFAULT 8
 
 #define SPACE_CH 32
 #define ESC_CH 27
 #define MAX_KEY_LEN 32
+#define INPUT_BUF_LEN 4096 // NOTE: a burst of keys (like a paste) gets read at once
+#define IDLE_WORK_MS 500 // NOTE: idle time before the deferred work runs
+#define JOURNAL_MAX_DELAY_MS 2000 // NOTE: longest the journal lags behind while typing nonstop
+#define JOURNAL_MAGIC "FREDJRN1"
+#define JOURNAL_QUEUE_MAX (8 << 20) // NOTE: bytes of records waiting for the writer before a flush waits for it
+#define LINES_CACHE_MAGIC "FREDLIX1"
+#define LINES_CACHE_MIN_SIZE (4 << 20) // NOTE: smaller files get scanned faster than the cache gets checked
+#define LINES_CACHE_SAMPLES 64
+#define LINES_CACHE_SAMPLE_LEN 256
+#define LINES_PARALLEL_MIN_SIZE (8 << 20) // NOTE: less than this gets scanned faster by one thread
+#define LINES_MAX_THREADS 64
+#define LINES_INDEX_FIRST (256 << 10) // NOTE: file bytes scanned before the first frame of a big file
+#define LINES_INDEX_SLICE (32 << 20) // NOTE: file bytes scanned per step after it, see LinesIndex
+#define INDEX_REDRAW_MS 250 // NOTE: how often the "indexing N%" status gets redrawn
+#define FILE_MMAP_MIN_SIZE (4 << 20)
+#define SAVE_COPY_LEN (1 << 20) // NOTE: bytes copied at a time by a save written in place
+#define FOLLOW_CHECK_MS 100 // NOTE: a followed file is looked at no more often, however fast it grows
+#define RELOAD_CHECK_MS 1000 // NOTE: how often the files get looked at for changes by other writers
+#define RELOAD_CHUNK_MASK 31 // NOTE: a line whose hash has these bits 0 ends a chunk, ~32 lines per chunk
+#define RELOAD_CHUNK_MAX (64 << 10) // NOTE: longest chunk, for text with few '\n'
+#define RELOAD_LINES_MAX (4 << 20) // NOTE: a bigger gap between matched chunks isn't matched line by line
+#define CMDLINE_MAX_LEN 64
+#define SEARCH_BACK_CHUNK (1 << 20) // NOTE: bytes searched at a time going backwards
+
+// NOTE: in the TermWin code-points array, marks the 
+// 2nd cell of a wide char, which must not be printed
+#define CP_WIDE_CONT UINT32_MAX
+
+// NOTE: a CellAttr color, 0 is the terminal's default; the top byte 
+// tells one of the 16 basic colors, of the 256-color palette or a 
+// 24-bit one, the low bytes its index or its red, green and blue
+#define COLOR_DEFAULT 0
+#define COLOR_16(n) ((1u << 24) | (n))
+#define COLOR_256(n) ((2u << 24) | (n))
+#define COLOR_RGB(r, g, b) ((3u << 24) | ((uint32_t)(r) << 16) | ((uint32_t)(g) << 8) | (b))
+#define COLOR_KIND(color) ((color) >> 24)
+
+#define KW_ATTR ((CellAttr){ .fg = COLOR_16(1) }) // NOTE: red
+#define COMMENT_ATTR ((CellAttr){ .fg = COLOR_16(3) }) // NOTE: yellow
+#define CELL_ATTR_EQ(a, b) ((a).fg == (b).fg && (a).bg == (b).bg && (a).bold == (b).bold)
+
+#define IS_UTF8_CONT(c) (((unsigned char)(c) & 0xc0) == 0x80)
+
+// NOTE: LinesWidth item, MSB is set if the line has non-ascii bytes
+#define LINE_NON_ASCII_BIT (1u << 31)
+#define LINE_WIDTH(item) ((item) & ~LINE_NON_ASCII_BIT)
+#define LINE_IS_ASCII(item) (!((item) & LINE_NON_ASCII_BIT))
+// NOTE: a width past it gets stored as it, only lines of tens of MB 
+// of tabs or wide chars get there
+#define LINE_WIDTH_MAX (LINE_NON_ASCII_BIT - 1)
+#define LINE_WIDTH_ITEM(width, is_ascii) \
+  ((uint32_t)((width) < LINE_WIDTH_MAX ? (width) : LINE_WIDTH_MAX) | ((is_ascii) ? 0 : LINE_NON_ASCII_BIT))
+#define LINE_LEN_MAX UINT32_MAX // NOTE: longest line a LinesLen item holds
+#define LINE_ROWS(item, row_w) (LINE_WIDTH(item) / (row_w) + 1) // NOTE: '+1' for the cursor at end of line 
 
 
 
@@ -109,8 +163,21 @@
   DA_PUSH((da), (item), ADD_BUF_INIT_CAP, AddBuf);  \
 } while (0)
 
+// NOTE: for the 'is_ascii' flag of the piece the last add-buf char goes in
+#define LAST_ADDED_IS_ASCII(fe) ((unsigned char)(fe)->add_buf.items[(fe)->add_buf.len - 1] < 0x80)
+
+
+// NOTE: the offset and piece cached by the last edit can be reused
+#define LOCUS_AT_CURSOR(fe) ((fe)->last_edit.locus_valid &&                   \
+                             (fe)->cursor.row == (fe)->last_edit.cursor.row && \
+                             (fe)->cursor.col == (fe)->last_edit.cursor.col)
 
 #define KEY_IS(key, what) (strcmp((key), (what)) == 0)
+#define CTRL_KEY(k) ((k) & 0x1f)
+
+// NOTE: normal-mode keys handled by FRED_move_cursor(), 
+// Ctrl-D, Ctrl-U, Ctrl-F and Ctrl-B included
+#define MOTION_KEYS "hjklwbe0$\x04\x15\x06\x02"
 
 
 #define TW_WRITE_NUM_AT(tw, offset, format, ...) do {                 \
@@ -120,15 +187,32 @@
   memcpy((tw)->elems + ((offset) - num_digits), num_str, num_digits);  \
 } while (0)
 
+// NOTE: right-aligned in the gutter; a number too long for it first eats the gap
+// before the text, then keeps only its low digits, never spilling to the row before
+#define TW_WRITE_LINENUM_AT(tw, row_offset, num) do {                          \
+  char num_str[24];                                                            \
+  size_t num_digits = snprintf(num_str, sizeof(num_str), "%zu", (size_t)(num)); \
+  size_t gutter = (tw)->linenum_width;                                         \
+  size_t num_end = gutter - gutter / 3;                                        \
+  if (num_digits > num_end) num_end = num_digits < gutter ? num_digits : gutter; \
+  size_t num_shown = num_digits < num_end ? num_digits : num_end;              \
+  memcpy((tw)->elems + (row_offset) + num_end - num_shown, num_str + num_digits - num_shown, num_shown); \
+} while (0)
+
 
 typedef struct termios termios;
 
 
 
 
+// NOTE: 16 bytes, the two flags folded into the word of the offset 
+// (files up to 2^62 bytes), so the walks adding up the lengths of the 
+// pieces and the edits moving the table touch 2/3 of the memory of 
+// a plain struct of them
 typedef struct {
-  bool which_buf;
-  size_t offset;
+  uint64_t which_buf : 1;
+  uint64_t is_ascii : 1; // NOTE: no bytes >= 0x80
+  uint64_t offset : 62;
   size_t len;
 } Piece;
 
@@ -140,13 +224,43 @@ typedef struct {
 
 
 typedef struct {
-  uint32_t* items; // NOTE: LSB order, 
-                   // 1st 2 bytes -> actual line length; 
-                   // 2nd 2 bytes -> keywords in line count, used only for highlight rendering
+  uint32_t* items; // NOTE: length of each line, without its '\n', 
+                   // up to LINE_LEN_MAX
   size_t len; // total lines in piece-table
   size_t cap;
 } LinesLen;
 
+typedef struct {
+  uint32_t* items; // NOTE: display width of each line, with tabs expanded 
+                   // and wide chars counted as 2 cells, plus the non-ascii 
+                   // flag (see LINE_WIDTH()); same length as LinesLen, used 
+                   // for wrapping and mapping the cursor to the screen
+  size_t len;
+  size_t cap;
+} LinesWidth;
+
+typedef struct {
+  size_t* items; // NOTE: offset of the first char of each line in the fully built 
+                 // text, same length as LinesLen; for O(1) row -> offset and 
+                 // O(log n) offset -> row; read them with LINE_START()
+  size_t len;
+  size_t cap;
+  size_t shift_from; // NOTE: the lines from it on still have to be shifted by 
+  size_t shift;      // 'shift' bytes, applied lazily (see line_starts_shift()) 
+                     // so an edit doesn't touch every line below it
+} LineStarts;
+
+#define LINE_START(ls, row) ((ls)->items[row] + ((row) >= (ls)->shift_from ? (ls)->shift : 0))
+
+// NOTE: display column of the cursor, only recomputed 
+// when the cursor or the text changes
+typedef struct {
+  size_t row;
+  size_t col;
+  size_t disp_col;
+  bool valid;
+} DispColCache;
+
 typedef struct {
   size_t row; 
   size_t col; 
@@ -157,15 +271,13 @@ typedef struct {
 } Cursor;
 
 
-// NOTE: an item contains the row, col in the 
-// term-win and length of the keyword (present
-// in the screen) that needs to be highlighted.
-// All three of them are stored into 2 bytes, LSB order. 
+// NOTE: how a TermWin cell looks, all 0 is the terminal's 
+// default; see COLOR_16() and the like for the colors
 typedef struct {
-  size_t* items;
-  size_t len;
-  size_t cap;
-} HighlightOffsets;
+  uint32_t fg;
+  uint32_t bg;
+  bool bold;
+} CellAttr;
 
 // NOTE: id are negative so it's safer and easier 
 // to detect them in the TermWin char array.
@@ -187,26 +299,54 @@ typedef enum {
   KW_COUNT,
 } KeywordId;
 
+#define KW_MAX_WORD_LEN 32
+#define IS_KW_WORD_CH(c) (((c) >= 'a' && (c) <= 'z') || (c) == '#' || (c) == '/')
+
+// NOTE: keyword-matching state for highlighting, fed one byte at 
+// a time; since words and comments end at '\n' it can be started 
+// at any line start or right after a non-word byte
+typedef struct {
+  char word[KW_MAX_WORD_LEN];
+  size_t word_len;
+  bool is_comment;
+} KwScanner;
+
 
 
 
+// NOTE: Fenwick tree over the visual rows (for the current 
+// width) taken by each line, so the visual row of a line 
+// and the line at a visual row are both O(log n); 
+// 1-based, 'items[0]' is unused
 typedef struct {
-  signed char* items; // negative char represents start of keyword, for highlighting 
-  size_t len;
+  size_t* items;
+  size_t len; // total lines indexed
   size_t cap;
-} TableText;  // NOTE: stores the fully built and highlighted 
-              // text, only used for rendering
+  size_t row_w; // width of a text row it was built for
+  size_t lines_version; // FredEditor 'lines_version' it was built for
+  bool valid;
+} RowIndex;
 
 
 // TODO: only size and lines_to_scroll need to be size_t
 typedef struct {
   char* elems; // stores the text put in the right place, ready to be rendered
-  TableText table_text;
-  HighlightOffsets ho;
+  uint32_t* cps; // NOTE: code-point of each non-ascii cell, 0 for the 
+                 // ascii ones, whose char is in 'elems'
+  bool has_utf8; // NOTE: if false 'cps' is all 0 and 'elems' can be written as is
+  CellAttr* attrs; // NOTE: look of each cell, filled in by the layout
+  bool has_attrs; // NOTE: if false 'attrs' is all default
+  RowIndex row_index;
   size_t size;
   size_t width;
   size_t height;
   size_t lines_to_scroll;
+  size_t hscroll; // NOTE: first display column on the screen, only in no-wrap mode
+  size_t cmdline_col; // NOTE: where the cursor goes in the status-row while 
+                      // typing a ':' command, 0 if it's in the text
+  const char* buf_name; // NOTE: file shown in the status-row with 
+  size_t buf_num;       // its buffer number, when more than
+  size_t bufs_count;    // one buffer is open
   short linenum_width; // NOTE: the max width between the left side of the screen 
                        // and the start of the text; for displaying line-nums
 } TermWin;
@@ -215,6 +355,7 @@ typedef struct {
 typedef struct {
   char* text;
   size_t size;
+  bool mapped; // NOTE: big files are mmap()ed instead of read, see FRED_open_file()
 } FileBuf;
 
 
@@ -231,35 +372,504 @@ typedef enum {
   ACT_DELETE,
 } Action;
 
+// NOTE: 'offset' and 'piece_idx' cache where the last edit left the text, 
+// so typing or deleting at the same spot skips resolving the cursor into 
+// an offset and a piece. They are only used while the cursor is on 
+// 'cursor'; any other edit must clear 'locus_valid'.
 typedef struct {
   Action action;
   Cursor cursor;
+  size_t offset; // NOTE: offset of 'cursor' in the fully built text
+  size_t piece_idx; // NOTE: piece whose last byte is right before 'offset'
+  bool locus_valid;
 } LastEdit;
 
 
+// NOTE: state for decoding utf-8 one byte at a time, 
+// so multi-byte chars can be split between pieces
+typedef struct {
+  uint32_t cp; // NOTE: the last decoded code-point, U+FFFD for invalid bytes
+  uint8_t left; // NOTE: continuation bytes still expected
+} Utf8Decoder;
+
+
+// NOTE: count and first key of a normal-mode 
+// command still being typed, like '25' or 'g' 
+typedef struct {
+  size_t count; // NOTE: 0 if none was typed
+  char prefix;
+  size_t op_count; // NOTE: the count typed before an operator, like the '2' of '2d3w'
+} PendingKeys;
+
+
+// NOTE: one of the cursors of a block insert
+typedef struct {
+  size_t row;
+  size_t col; // NOTE: where the typing started, the bytes typed go after it
+  size_t piece_idx; // NOTE: piece whose last byte is the last one typed, while 'grows'
+} MultiCursor;
+
+// NOTE: 'Ctrl-V' selects a block from the anchor to the cursor, 'I' 
+// then types at its left column on every line reaching into it (one 
+// cursor per line, in order). Each key is applied at all the cursors 
+// in one pass: the byte goes once in the add-buf, shared by the pieces 
+// of all of them, and the lines get updated once.
+typedef struct {
+  MultiCursor* items; // NOTE: none outside a block insert
+  size_t len;
+  size_t cap;
+  bool selecting; // NOTE: after 'Ctrl-V', until 'I' or 'Esc'
+  size_t anchor_row;
+  size_t anchor_disp_col;
+  size_t typed; // NOTE: bytes typed after every cursor
+  bool grows; // NOTE: the cursors' pieces end at 'add_end', the next byte can grow them
+  size_t add_end;
+} MultiCursors;
+
+
+// NOTE: 'v' (or 'V' for whole lines) selects from the anchor to the cursor
+typedef struct {
+  char kind; // NOTE: 0 if none, otherwise 'v' or 'V'
+  size_t anchor_row;
+  size_t anchor_col;
+} Visual;
+
+
+// NOTE: what 'dd', 'yy', 'd{motion}', 'y{motion}' and a visual 'd' or 'y' 
+// leave for 'p': pieces of the text pointing in the file-buf and the 
+// add-buf like the table's, not a copy of it. A save or a reload lets 
+// go of the buffers, the text gets copied in 'text' then, and is put 
+// back in the add-buf by the next 'p'.
+typedef struct {
+  PieceTable pieces;
+  bool linewise; // NOTE: whole lines, each with its '\n', 'p' puts them under the cursor's line
+  char* text; // NOTE: NULL unless the pieces got copied out
+  size_t text_len;
+} Register;
+
+
+// NOTE: the ':' command or '/' pattern being typed in normal mode
+typedef struct {
+  char items[CMDLINE_MAX_LEN];
+  size_t len;
+  bool active;
+  char kind; // NOTE: ':' or '/'
+} CmdLine;
+
+
+// NOTE: the last '/' pattern, for 'n' and 'N'
+typedef struct {
+  char items[CMDLINE_MAX_LEN];
+  size_t len;
+} SearchPattern;
+
+
+// NOTE: offsets of the matches a ':s' command replaces, in order
+typedef struct {
+  size_t* items;
+  size_t len;
+  size_t cap;
+} Matches;
+
+
+// NOTE: a ':bn', ':bp' or ':b N' still to be carried 
+// out by the editor loop, which owns the buffers
+typedef struct {
+  char kind; // NOTE: 0 if none, otherwise 'n', 'p' or 'b'
+  size_t num; // NOTE: 1-based buffer number for 'b'
+} BufferSwitch;
+
+
+// NOTE: whether the lines-cache of a big file gets used, see lines_cache_load()
+typedef enum {
+  LINES_CACHE_AUTO, // NOTE: read, and written unless read-only
+  LINES_CACHE_OFF, // NOTE: '-C', neither read nor written
+  LINES_CACHE_ON, // NOTE: '--line-cache', written even when read-only
+} LinesCacheMode;
+
+
+// NOTE: header of the lines-cache next to a big file, followed by the 
+// file's LinesLen, LinesWidth and LineStarts items, 'lines' of each
+typedef struct {
+  char magic[8];
+  uint64_t file_size;
+  uint64_t mtime_sec;
+  uint64_t mtime_nsec;
+  uint64_t inode;
+  uint64_t dev;
+  uint64_t tab_width; // NOTE: the widths depend on it
+  uint64_t hash; // NOTE: sampled, see lines_cache_hash()
+  uint64_t lines;
+} LinesCacheHeader;
+
+
+// NOTE: crash-recovery journal next to the edited file. Since the add-buf 
+// only grows, it only needs the add-buf bytes appended since the last 
+// flush and what changed in the (small) piece-table, never the text. 
+// Layout: JOURNAL_MAGIC, file size, mtime sec and nsec of the file 
+// it applies to and a reserved one (u64 each), then records:
+//   'A' u64 len, bytes                       -> appended to the add-buf
+//   'P' u64 keep_front, u64 keep_back,       -> the pieces between the first 
+//       u64 count, u64 row, u64 col, pieces     'keep_front' and the last 'keep_back' 
+//                                               get replaced by 'count' pieces
+// each piece is 1 byte (which_buf | is_ascii << 1), u64 offset, u64 len. 
+// While a big file is still being indexed, the records are for the text 
+// with the rest of the file after it, as it will be once indexed.
+typedef struct {
+  char* items;
+  size_t len;
+  size_t cap;
+} JournalQueue;
+
+typedef struct {
+  char* path;
+  int fd; // NOTE: -1 until the first flush with changes
+  // NOTE: a flush only queues its records, a thread of the journal's 
+  // own writes them (and syncs them when asked), so a slow disk 
+  // never holds up the keys; see journal_writer()
+  JournalQueue queue;
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t wake; // NOTE: records queued, a sync asked or the writer told to stop
+  pthread_cond_t idle; // NOTE: the writer took the queue or wrote it out
+  bool writer_on;
+  bool writing; // NOTE: the writer has records out of the queue not written yet
+  bool sync_asked;
+  bool stopping;
+  int write_errno; // NOTE: of the writer's last failed write or sync, 0 if none
+  size_t file_size; // NOTE: size and mtime of the file when loaded,
+  struct timespec file_mtime; // the journal only applies to it
+  size_t add_buf_flushed; // NOTE: add-buf bytes already in the journal
+  PieceTable table_flushed; // NOTE: piece-table as the journal has it
+  Cursor cursor_flushed;
+  size_t bytes_written;
+  double last_flush_ms;
+  bool needs_sync; // NOTE: written since the last fdatasync()
+  bool recovered; // NOTE: the edits of a crashed session got replayed
+} Journal;
+
+
+// NOTE: the lines starting in [start, end) of the file-buffer 'text', 
+// scanned by one thread when loading a big file or by the indexing 
+// worker (see LinesIndex)
+typedef struct {
+  struct FredEditor* fe;
+  const char* text;
+  size_t size;
+  bool is_ascii; // NOTE: of all the bytes the chunk looks at
+  size_t start;
+  size_t end;
+  LinesLen lines_len;
+  LinesWidth lines_width;
+  LineStarts line_starts;
+  bool failed;
+  const char* fault; // NOTE: a read past the end of a file cut under the scan, see file_buf_sigbus()
+} LinesChunk;
+
+
+// NOTE: lines of a big file scanned a step at a time, so its first 
+// screen doesn't wait for all of them. Till 'done', the text is only the 
+// part of the file scanned so far, which ends after a '\n', and each 
+// step appends the next part to it, as if typed at the end.
+// In the editor the slices get scanned by a worker thread, which hands 
+// them over one at a time through 'ready' and wakes the main loop with 
+// 'event_fd'; FRED_index_take() puts them in the text and moves the 
+// frontier. Anything that changes the file-buffer or the frontier 
+// stops the worker first, see index_stop().
+typedef struct {
+  bool done;
+  size_t frontier; // NOTE: bytes of the file in the text so far
+  size_t from_version; // NOTE: lines_version since which only steps changed the lines
+  size_t lines_version; // NOTE: lines_version right after the last step
+  char* cache_path; // NOTE: lines-cache written when done, if the text is still just the file
+  struct stat file_stat;
+  pthread_t worker;
+  pthread_mutex_t lock;
+  pthread_cond_t taken; // NOTE: 'ready' got taken, or the worker told to stop
+  bool worker_on;
+  bool stopping;
+  bool has_ready;
+  LinesChunk ready; // NOTE: scanned slice, starting at the frontier
+  int event_fd; // NOTE: only while 'worker_on'
+} LinesIndex;
+
+
+// NOTE: '--follow', the file is watched with inotify and what gets 
+// appended to it is appended to the text, like the rest of a big 
+// file being scanned (see LinesIndex)
+typedef struct {
+  int fd; // NOTE: kept open, a renamed (rotated) file is still followed, like 'tail -f'
+  int wd; // NOTE: inotify watch of the file, -1 if none
+  bool changed; // NOTE: an event came since the last look
+  bool at_end; // NOTE: the cursor was on the last line, it stays on it as the text grows
+  bool truncated; // NOTE: the file got cut, till it grows again
+} FileFollow;
+
+
+// NOTE: the file as it was last read (or saved), to notice 
+// when another writer changes it, see FRED_reload_check()
+typedef struct {
+  struct stat file_stat;
+  bool reloaded; // NOTE: for the status-row, till the next key
+  bool conflict; // NOTE: the mapped file got written over in place under edits not 
+                 // saved, its old bytes are gone: nothing gets merged in or saved 
+                 // any more, "[conflict]" stays in the status-row
+} FileReload;
+
+
+// NOTE: a run of bytes both files have ('equal') or the bytes of the 
+// new file that replace a run of the old one; the ops of a diff 
+// cover both files, in order
+typedef struct {
+  bool equal;
+  size_t old_offset;
+  size_t old_len;
+  size_t new_offset;
+  size_t new_len;
+} FileDiffOp;
+
+typedef struct {
+  FileDiffOp* items;
+  size_t len;
+  size_t cap;
+} FileDiff;
+
+// NOTE: chunk of the old file, found by its hash through an 
+// open-addressing table of indexes; 'len' 0 if more chunks have that hash
+typedef struct {
+  uint64_t hash;
+  size_t offset;
+  size_t len;
+} DiffChunk;
+
+typedef struct {
+  DiffChunk* items;
+  size_t len;
+  size_t cap;
+} DiffChunks;
+
+// NOTE: bytes of the text a reload replaced, at 'old_offset' 
+// in the text before it and 'offset' in the one after
+typedef struct {
+  size_t old_offset;
+  size_t old_len;
+  size_t offset;
+  size_t len;
+} TextChange;
+
 typedef struct {
+  TextChange* items;
+  size_t len;
+  size_t cap;
+} TextChanges;
+
+
+typedef struct FredEditor {
   PieceTable piece_table;
   AddBuf add_buf;
   FileBuf file_buf;
   LinesLen lines_len;
+  LinesWidth lines_width;
+  LineStarts line_starts;
+  DispColCache disp_col_cache;
+  size_t lines_version; // NOTE: bumped every time the lines are recomputed
+  RowIndex* row_index; // NOTE: the one of the window showing the text, set by 
+                       // row_index_update(); see row_index_current()
+  size_t tab_width;
+  size_t index_threads; // NOTE: threads scanning the lines of the file when 
+                        // loaded, set before fred_editor_init(); 0 for one per core
+  bool progressive; // NOTE: set before fred_editor_init(), see LinesIndex
+  bool read_only; // NOTE: '-R', set before fred_editor_init(); no edits, no journal
+  LinesCacheMode lines_cache; // NOTE: set before fred_editor_init()
+  LinesIndex index;
+  size_t win_rows; // NOTE: text rows on the screen, for page motions
+  bool nowrap; // NOTE: ':set nowrap', long lines get cut at the screen's 
+               // edge and the screen scrolls sideways to the cursor
   Cursor cursor;
   LastEdit last_edit;
+  CmdLine cmdline;
+  SearchPattern search;
+  PendingKeys pending;
+  MultiCursors multi;
+  Visual visual;
+  Register reg;
+  BufferSwitch buf_switch;
+  Journal journal;
+  FileFollow follow;
+  FileReload reload;
+  bool file_cut; // NOTE: the mapped file got cut under the text, see 
+                 // file_buf_cut_at(); for the status-row, till the next key
 } FredEditor;
 
 
+// NOTE: an open file with its own editor; the render caches built 
+// from it are parked here while another buffer is on the screen, 
+// so switching back needs no rescan
+typedef struct {
+  const char* file_path;
+  bool loaded; // NOTE: the file is only read when first shown
+  FredEditor fe;
+  RowIndex row_index;
+  size_t lines_to_scroll;
+  size_t hscroll;
+} Buffer;
+
+typedef struct {
+  Buffer* items;
+  size_t len;
+  size_t cap;
+  size_t current;
+  size_t tab_width; // NOTE: for the buffers still to be loaded
+  size_t index_threads;
+  bool read_only;
+  LinesCacheMode lines_cache;
+  bool follow;
+  int notify_fd; // NOTE: inotify of the followed files, -1 if none
+} BufferList;
+
+
+// NOTE: what the editor's loop keeps from one pass to the next; 
+// a pass can be cut short by a read past the end of a mapped file, 
+// see editor_pass_guarded()
+typedef struct {
+  TermWin tw;
+  struct pollfd fds[5];
+  int sig_fd;
+  int timer_fd;
+  struct itimerspec idle_timer;
+  char input[INPUT_BUF_LEN];
+  size_t input_len; // NOTE: bytes of a key cut by the last read, kept for the next one
+  size_t input_used; // NOTE: bytes of keys handled by a pass that got cut short
+  bool running;
+  bool insert;
+  bool dirty; // NOTE: the screen needs a new frame
+  double index_drawn_ms;
+  double follow_checked_ms;
+  double reload_checked_ms;
+  const char* fault; // NOTE: where the last pass faulted, for the next one to cut the text
+} EditorLoop;
+
+
+// NOTE: position in the piece-table, so walking the text 
+// doesn't look up the piece (and its buffer) for every byte; 
+// past the last byte 'piece_idx' is the table length 
+// and 'piece_text' is NULL
+typedef struct {
+  FredEditor* fe;
+  const char* piece_text; // NOTE: first byte of the current piece in its buffer
+  size_t piece_idx;
+  size_t piece_offset; // NOTE: offset of the byte inside the piece
+  size_t offset; // NOTE: offset of the byte in the fully built text
+} PieceIter;
+
+// NOTE: contiguous bytes from the iterator to the end of its piece
+typedef struct {
+  const char* text;
+  size_t len; // NOTE: 0 past the end of the text
+  bool is_ascii;
+} PieceSpan;
+
+
 bool FRED_open_file(FileBuf* file_buf, const char* file_path);
 bool FRED_setup_terminal();
 bool FRED_render_text(TermWin* tw, Cursor* cursor);
 bool fred_editor_init(FredEditor* fe, const char* file_path);
 void fred_editor_free(FredEditor* fe);
-bool FRED_start_editor(FredEditor* fe, const char* file_path);
+bool FRED_start_editor(BufferList* bl);
+void FRED_free_buffers(BufferList* bl);
 bool FRED_win_resize(TermWin* term_win);
+bool FRED_get_lines_len(FredEditor* fe);
+bool lines_scan_from(FredEditor* fe, size_t offset);
+bool lines_scan_range(FredEditor* fe, size_t offset, size_t until, size_t* next, 
+                      LinesLen* ll, LinesWidth* lw, LineStarts* ls);
+bool lines_cache_load(FredEditor* fe, const char* file_path, bool progressive);
+bool lines_are_ascii(FredEditor* fe);
+bool lines_scan_file(FredEditor* fe, size_t offset);
+bool FRED_index_step(FredEditor* fe, size_t len);
+bool FRED_index_until(FredEditor* fe, size_t row);
+void FRED_index_start(FredEditor* fe);
+bool FRED_index_take(FredEditor* fe);
+void index_stop(FredEditor* fe);
+bool lines_only_appended(FredEditor* fe, size_t version);
+void file_buf_drop(FileBuf* file_buf, size_t from, size_t to);
+bool file_buf_grow(FileBuf* file_buf, int fd, size_t size);
+bool FRED_follow_start(FredEditor* fe, const char* file_path, int notify_fd);
+bool text_cut_file(FredEditor* fe, size_t size);
+bool follow_cut(FredEditor* fe, size_t size);
+bool file_buf_cut_at(FredEditor* fe, const char* addr);
+void file_buf_fault_again(const char* addr);
+bool FRED_follow_check(FredEditor* fe);
+void FRED_follow_stop(FredEditor* fe);
+bool file_diff(FileDiff* diff, const char* old, size_t old_size, const char* new, size_t new_size);
+bool FRED_reload_file(FredEditor* fe, const char* file_path, struct stat* sb);
+bool FRED_reload_check(FredEditor* fe, const char* file_path);
+bool text_is_file(FredEditor* fe);
+bool FRED_save_file(FredEditor* fe, const char* file_path);
+extern __thread sigjmp_buf* file_buf_guard;
+extern __thread const char* file_buf_fault;
+void file_buf_sigbus(int sig, siginfo_t* si, void* ctx);
+void FRED_close_file(FileBuf* file_buf);
+size_t FRED_get_disp_col(FredEditor* fe, size_t row, size_t col);
+void line_starts_shift(LineStarts* ls, size_t from, size_t delta);
+void line_starts_settle(LineStarts* ls);
+size_t get_line_offset(FredEditor* fe, size_t row);
+size_t get_offset_row(FredEditor* fe, size_t offset);
+size_t FRED_text_len(FredEditor* fe);
+PieceIter piece_iter_at(FredEditor* fe, size_t offset);
+PieceIter piece_iter_at_line(FredEditor* fe, size_t row);
+void piece_iter_seek(PieceIter* it, size_t offset);
+PieceSpan piece_iter_span(PieceIter* it);
+bool piece_iter_skip(PieceIter* it, size_t n);
+bool piece_iter_next(PieceIter* it);
+bool piece_iter_prev(PieceIter* it);
+char piece_iter_char(PieceIter* it);
+char FRED_char_at(FredEditor* fe, size_t offset);
+bool FRED_is_ascii(const char* text, size_t len);
+size_t utf8_len(unsigned char c);
+size_t utf8_cp_width(uint32_t cp);
+size_t utf8_cells(Utf8Decoder* d, unsigned char c, size_t disp_col, size_t tab_width);
+bool row_index_update(FredEditor* fe, TermWin* tw);
+RowIndex* row_index_current(FredEditor* fe);
+void row_index_add(RowIndex* ri, size_t line, size_t delta);
+size_t row_index_prefix(RowIndex* ri, size_t lines);
+size_t row_index_find(RowIndex* ri, size_t vrow);
+bool FRED_jump_to_line(FredEditor* fe, size_t line);
+KeywordId kw_scan(KwScanner* ks, char c, size_t* kw_len);
+bool get_text_to_render_wrap(FredEditor* fe, TermWin* tw);
 bool FRED_get_text_to_render(FredEditor* fe, TermWin* term_win, bool insert);
 bool FRED_insert_text(FredEditor* fe, char c);
 void dump_piece_table(FredEditor* fe, FILE* stream);
-void FRED_move_cursor(FredEditor* fe, char key);
+bool FRED_compact_pieces(FredEditor* fe);
+bool FRED_block_insert_start(FredEditor* fe);
+bool FRED_multi_insert(FredEditor* fe, char c);
+bool FRED_multi_delete(FredEditor* fe);
+bool FRED_yank(FredEditor* fe, size_t from, size_t to, bool linewise);
+bool FRED_delete_range(FredEditor* fe, size_t from, size_t to);
+bool FRED_put(FredEditor* fe, size_t count);
+bool FRED_line_op(FredEditor* fe, char op, size_t count);
+bool FRED_motion_op(FredEditor* fe, char op, char motion, size_t count);
+bool FRED_visual_op(FredEditor* fe, char op);
+bool register_detach(FredEditor* fe);
+void pieces_cut_file(PieceTable* pieces, size_t size);
+bool FRED_journal_flush(FredEditor* fe);
+bool FRED_journal_sync(FredEditor* fe);
+bool FRED_journal_wait(FredEditor* fe);
+void FRED_journal_close(FredEditor* fe, bool remove_file);
+bool journal_restart(FredEditor* fe, const char* file_path, struct stat* sb);
+char* sidecar_path(const char* file_path, const char* suffix);
+double monotonic_ms();
+size_t next_key_len(const char* input, size_t len);
+void snap_to_char_start(FredEditor* fe);
+void FRED_move_cursor(FredEditor* fe, char key, size_t count);
+size_t text_find(FredEditor* fe, size_t from, size_t to, const char* pat, size_t pat_len, bool last);
+size_t text_find_back(FredEditor* fe, size_t from, size_t to, const char* pat, size_t pat_len);
+bool FRED_search(FredEditor* fe, bool forward, size_t count);
+bool FRED_substitute(FredEditor* fe, size_t top, size_t bottom, const char* pat, size_t pat_len, 
+                     const char* rep, size_t rep_len, bool global);
 bool FRED_delete_text(FredEditor* fe);
 bool FRED_handle_input(FredEditor* fe, bool* running, bool* insert, char* key, ssize_t bytes_read);
+void update_win_cursor(FredEditor* fe, TermWin* tw);
+void update_win_cursor_nowrap(FredEditor* fe, TermWin* tw);
 
 
 
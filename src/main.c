@@ -3,14 +3,7 @@
 
 
 termios term_orig = {0};
-struct sigaction act = {0};
-struct sigaction old = {0};
-
-
-void handle_win_resize_sig(int sig)
-{
-  (void)sig;
-}
+sigset_t sig_orig;
 
 bool setup_terminal()
 {
@@ -35,12 +28,23 @@ bool setup_terminal()
   if (-1 == tcsetattr(STDIN_FILENO, TCSAFLUSH, &term_raw)){
     ERROR("failed to set terminal options. %s.", strerror(errno));
   }
-
-  act.sa_handler = handle_win_resize_sig;
-  if (-1 == sigaction(SIGWINCH, &act, &old)){
+  term_set = 1;
+
+  // NOTE: the editor reads SIGWINCH from a signalfd, 
+  // so it must not be delivered the usual way
+  sigset_t winch;
+  sigemptyset(&winch);
+  sigaddset(&winch, SIGWINCH);
+  if (-1 == sigprocmask(SIG_BLOCK, &winch, &sig_orig)){
     ERROR("failed to set up the editor to detect window changes. %s.", strerror(errno));
   }
 
+  struct sigaction bus = { .sa_sigaction = file_buf_sigbus, .sa_flags = SA_SIGINFO };
+  sigemptyset(&bus.sa_mask);
+  if (-1 == sigaction(SIGBUS, &bus, NULL)){
+    ERROR("failed to set up the editor to survive a mapped file getting cut. %s.", strerror(errno));
+  }
+
   GOTO_END(failed);
 end:
   if (failed && term_set) {
@@ -56,37 +60,56 @@ int main(int argc, char** argv)
   // REMEMBER: JUST MAKE SOMETHING THAT WORKS FIRST!!!!!!!!
   bool failed = 0;
 
-  if (argc < 2) ERROR("no file-path provided.");
-  if (argc > 2) ERROR("too many arguments; can only handle one file right now.");
-
-  char* file_path = argv[1];
+  BufferList bl = {0};
+  bl.tab_width = TAB_WIDTH_DEFAULT;
+  bl.notify_fd = -1;
+
+  for (int i = 1; i < argc; i++) {
+    if (KEY_IS(argv[i], "-t")) {
+      if (i + 1 >= argc) ERROR("missing tab-width after '-t'.");
+      long n = strtol(argv[++i], NULL, 10);
+      if (n < 1 || n > 32) ERROR("invalid tab-width '%s', expected a number between 1 and 32.", argv[i]);
+      bl.tab_width = n;
+    } else if (KEY_IS(argv[i], "-j")) {
+      if (i + 1 >= argc) ERROR("missing threads count after '-j'.");
+      long n = strtol(argv[++i], NULL, 10);
+      if (n < 1 || n > LINES_MAX_THREADS) ERROR("invalid threads count '%s', expected a number between 1 and %d.", argv[i], LINES_MAX_THREADS);
+      bl.index_threads = n;
+    } else if (KEY_IS(argv[i], "-R")) {
+      bl.read_only = true;
+    } else if (KEY_IS(argv[i], "-C") || KEY_IS(argv[i], "--no-line-cache")) {
+      bl.lines_cache = LINES_CACHE_OFF;
+    } else if (KEY_IS(argv[i], "--line-cache")) {
+      bl.lines_cache = LINES_CACHE_ON;
+    } else if (KEY_IS(argv[i], "--follow")) {
+      bl.follow = true;
+    } else {
+      DA_PUSH(&bl, ((Buffer){ .file_path = argv[i] }), 8, BufferList); // NOTE: loaded when first shown
+    }
+  }
+  if (bl.len == 0) ERROR("no file-path provided.");
 
   bool term_and_sig_set = 0;
   failed = setup_terminal();
   if (failed) GOTO_END(1);
   term_and_sig_set = 1;
 
-  FredEditor fe = {0};
-  failed = fred_editor_init(&fe, file_path);
-  if (failed) GOTO_END(1);
-  
-  failed = FRED_start_editor(&fe, file_path);
+  failed = FRED_start_editor(&bl);
   if (failed) GOTO_END(1);
 
   GOTO_END(failed);
 end:
   if (term_and_sig_set) {
     tcsetattr(STDIN_FILENO, TCSANOW, &term_orig);
-    sigaction(SIGWINCH, &old, NULL);
+    sigprocmask(SIG_SETMASK, &sig_orig, NULL);
   }
+  FRED_free_buffers(&bl);
   return failed;
 }
 
-// FIXME: '\t' is not rendered properly
 // FIXME: SIGWINCH doesn't handle resizing on zooming in/out when
 // the terminal is not full screen?
 // FIXME: fred sometimes crashes with empty file even though that should already be handled
-// TODO: utf-8 support.
 // TODO: handle ftruncate error
 // TODO: have a separate buffer to report error messages in the 
 // bottom line of the screen
@@ -0,0 +1,835 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "./../src/fred.h"
+
+
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// Benchmark for the piece-table scanners: a generated text is loaded
+// and then split into small pieces alternating between the file-buffer
+// and the add-buffer, like a heavily edited file.
+// The same text is then walked:
+//   - byte by byte with the old 'buf()' macro, branching on 'which_buf'
+//     for every byte;
+//   - byte by byte with piece_iter_next();
+//   - one span at a time with memchr();
+// and the scanners built on the iterator get timed as well.
+// Opening the file gets timed with and without the lines-cache next 
+// to it, and the scan of its lines with more and more threads (try 
+// '-m 1000' to '-m 8000' for 1 to 8 GB), the merge of a few lines 
+// changed by another writer and the frames drawn while typing. 
+// A prefix gets typed on thousands of lines, with a block insert and 
+// with a cursor moved line by line, and ':%s' replaces a pattern 
+// found all over the text.
+// Last, keys get typed into the text with the journal flushed every 
+// few keys, to see how many bytes it writes per byte typed, and how 
+// long fred_editor_init() takes to recover from it.
+//
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+
+#define ERR(...) do { \
+  fprintf(stderr, "ERROR: "); \
+  fprintf(stderr, __VA_ARGS__); \
+  fprintf(stderr, "\n"); \
+  exit(1); \
+} while (0)
+
+#define DEFAULT_TEXT_MB 32
+#define DEFAULT_PIECE_LEN 64
+#define DEFAULT_RUNS 5
+#define JOURNAL_KEYS 200000
+#define JOURNAL_KEYS_PER_FLUSH 64 // NOTE: about what a fast typist does in JOURNAL_MAX_DELAY_MS
+#define JOURNAL_KEYS_PER_LINE 80
+#define PIECES_COUNT (1 << 20)
+#define PIECES_SEEKS 200
+#define PIECES_EDITS 200
+#define FRAMES_KEYS 20
+#define MULTI_LINES 5000
+#define MULTI_PREFIX "// TODO: "
+
+
+char text_file_path[] = "/tmp/fred_bench_XXXXXX";
+char lines_cache_path[sizeof(text_file_path) + sizeof("/..fred-lines")];
+volatile size_t bench_sink; // NOTE: keeps the compiler from dropping unused results
+
+
+// DESC: writes lines of random length to a temp file, 1 in 8 has tabs
+size_t make_text_file(size_t text_len)
+{
+  int fd = mkstemp(text_file_path);
+  if (fd == -1) ERR("failed to create temp file, %s.", strerror(errno));
+  FILE* f = fdopen(fd, "w");
+  if (f == NULL) ERR("failed to open temp file, %s.", strerror(errno));
+
+  srand(1);
+  size_t written = 0;
+  while (written < text_len) {
+    size_t line_len = rand() % 100;
+    bool has_tabs = rand() % 8 == 0;
+    for (size_t i = 0; i < line_len && written < text_len; i++, written++) {
+      fputc(has_tabs && rand() % 16 == 0 ? '\t' : 'a' + rand() % 26, f);
+    }
+    if (written < text_len) {
+      fputc('\n', f);
+      written++;
+    }
+  }
+  fclose(f);
+  return written;
+}
+
+
+// DESC: same text, but in pieces of 'piece_len' bytes
+// alternating between the file-buffer and the add-buffer
+void fragment_table(FredEditor* fe, size_t piece_len)
+{
+  FileBuf* fb = &fe->file_buf;
+  AddBuf* ab = &fe->add_buf;
+  PieceTable* table = &fe->piece_table;
+
+  free(ab->items);
+  ab->items = malloc(fb->size ? fb->size : 1);
+  if (ab->items == NULL) ERR("not enough memory.");
+  memcpy(ab->items, fb->text, fb->size);
+  ab->len = ab->cap = fb->size;
+
+  table->len = 0;
+  for (size_t offset = 0; offset < fb->size; offset += piece_len) {
+    size_t len = offset + piece_len < fb->size ? piece_len : fb->size - offset;
+    Piece p = {
+      .which_buf = table->len % 2,
+      .is_ascii = FRED_is_ascii(fb->text + offset, len),
+      .offset = offset,
+      .len = len
+    };
+    if (table->len + 1 > table->cap) {
+      table->cap = table->cap ? table->cap * 2 : PIECE_TABLE_INIT_CAP;
+      table->items = realloc(table->items, table->cap * sizeof(*table->items));
+      if (table->items == NULL) ERR("not enough memory.");
+    }
+    table->items[table->len++] = p;
+  }
+}
+
+
+size_t count_lines_buf_macro(FredEditor* fe)
+{
+#define buf(p, offset)((!(p).which_buf ? fe->file_buf.text: fe->add_buf.items)[(offset)])
+  PieceTable* table = &fe->piece_table;
+  size_t lines = 1;
+  for (size_t i = 0; i < table->len; i++) {
+    Piece p = table->items[i];
+    for (size_t j = 0; j < p.len; j++) {
+      lines += buf(p, p.offset + j) == '\n';
+    }
+  }
+  return lines;
+#undef buf
+}
+
+
+size_t count_lines_iter_next(FredEditor* fe)
+{
+  size_t lines = 1;
+  PieceIter it = piece_iter_at(fe, 0);
+  if (it.piece_text == NULL) return lines;
+  do {
+    lines += piece_iter_char(&it) == '\n';
+  } while (piece_iter_next(&it));
+  return lines;
+}
+
+
+size_t count_lines_iter_spans(FredEditor* fe)
+{
+  size_t lines = 1;
+  PieceIter it = piece_iter_at(fe, 0);
+  PieceSpan span;
+  while ((span = piece_iter_span(&it)).len) {
+    const char* nl = span.text;
+    const char* span_end = span.text + span.len;
+    while ((nl = memchr(nl, '\n', span_end - nl)) != NULL) {
+      lines++;
+      nl++;
+    }
+    piece_iter_skip(&it, span.len);
+  }
+  return lines;
+}
+
+
+// DESC: lines length and width the way FRED_get_lines_len() 
+// computed them before the iterator, for comparison
+size_t lines_len_buf_macro(FredEditor* fe)
+{
+#define buf(p, offset)((!(p).which_buf ? fe->file_buf.text: fe->add_buf.items)[(offset)])
+  PieceTable* table = &fe->piece_table;
+  size_t lines = 1;
+  size_t line_start = 0, line_width = 0, tot_text_len = 0, checksum = 0;
+  for (size_t i = 0; i < table->len; i++) {
+    Piece p = table->items[i];
+    for (size_t j = 0; j < p.len; j++) {
+      char c = buf(p, p.offset + j);
+      if (c == '\t') line_width += fe->tab_width - line_width % fe->tab_width;
+      else if (c != '\n') line_width++;
+      if (c == '\n') {
+        checksum += (tot_text_len + j - line_start) ^ line_width;
+        line_start = tot_text_len + j + 1;
+        line_width = 0;
+        lines++;
+      }
+    }
+    tot_text_len += p.len;
+  }
+  bench_sink = checksum;
+  return lines;
+#undef buf
+}
+
+
+size_t lines_len_iter(FredEditor* fe)
+{
+  if (FRED_get_lines_len(fe)) ERR("failed to get lines-length.");
+  return fe->lines_len.len;
+}
+
+
+// DESC: best time of fred_editor_init(), dropping the lines-cache 
+// before each run if not 'cached'
+double bench_open(size_t runs, bool cached)
+{
+  double best = -1;
+  for (size_t r = 0; r < runs; r++) {
+    if (!cached) unlink(lines_cache_path);
+    FredEditor fe = {0};
+    double start = monotonic_ms();
+    if (fred_editor_init(&fe, text_file_path)) ERR("failed to initialize fred.");
+    double elapsed = monotonic_ms() - start;
+    if (best < 0 || elapsed < best) best = elapsed;
+    fred_editor_free(&fe);
+  }
+  return best;
+}
+
+
+// DESC: from a file with no lines-cache to the first frame of an 
+// 80x24 window, indexing it all first or only its start
+double bench_first_frame(size_t runs, bool progressive)
+{
+  double best = -1;
+  for (size_t r = 0; r < runs; r++) {
+    unlink(lines_cache_path);
+    FredEditor fe = {0};
+    fe.progressive = progressive;
+    TermWin tw = {0};
+    tw.width = 80;
+    tw.height = 24;
+    tw.size = tw.width * tw.height;
+    tw.linenum_width = 8;
+    tw.elems = malloc(tw.size);
+    tw.cps = calloc(tw.size, sizeof(*tw.cps));
+    tw.attrs = calloc(tw.size, sizeof(*tw.attrs));
+    if (!tw.elems || !tw.cps || !tw.attrs) ERR("not enough memory for the window.");
+    double start = monotonic_ms();
+    if (fred_editor_init(&fe, text_file_path)) ERR("failed to initialize fred.");
+    fe.win_rows = tw.height - 1;
+    if (FRED_get_text_to_render(&fe, &tw, false)) ERR("failed to get the text to render.");
+    double elapsed = monotonic_ms() - start;
+    if (best < 0 || elapsed < best) best = elapsed;
+    free(tw.elems);
+    free(tw.cps);
+    free(tw.attrs);
+    free(tw.row_index.items);
+    fred_editor_free(&fe);
+  }
+  return best;
+}
+
+
+// DESC: keys typed in the middle of the text, each followed by 
+// the frame of an 80x24 window like the editor draws after it
+void bench_typing_frames(size_t runs)
+{
+  double best = -1;
+  for (size_t r = 0; r < runs; r++) {
+    FredEditor fe = {0};
+    TermWin tw = {0};
+    tw.width = 80;
+    tw.height = 24;
+    tw.size = tw.width * tw.height;
+    tw.linenum_width = 8;
+    tw.elems = malloc(tw.size);
+    tw.cps = calloc(tw.size, sizeof(*tw.cps));
+    tw.attrs = calloc(tw.size, sizeof(*tw.attrs));
+    if (!tw.elems || !tw.cps || !tw.attrs) ERR("not enough memory for the window.");
+    if (fred_editor_init(&fe, text_file_path)) ERR("failed to initialize fred.");
+    fe.win_rows = tw.height - 1;
+    fe.cursor = (Cursor){ .row = fe.lines_len.len / 2 };
+    tw.lines_to_scroll = fe.cursor.row;
+    if (FRED_get_text_to_render(&fe, &tw, true)) ERR("failed to get the text to render.");
+
+    double start = monotonic_ms();
+    for (size_t k = 0; k < FRAMES_KEYS; k++) {
+      if (FRED_insert_text(&fe, 'x')) ERR("failed to insert text.");
+      if (FRED_get_text_to_render(&fe, &tw, true)) ERR("failed to get the text to render.");
+    }
+    double elapsed = (monotonic_ms() - start) / FRAMES_KEYS;
+    if (best < 0 || elapsed < best) best = elapsed;
+    free(tw.elems);
+    free(tw.cps);
+    free(tw.attrs);
+    free(tw.row_index.items);
+    fred_editor_free(&fe);
+  }
+  printf("  %-28s %9.3f ms\n", "frame after each key", best);
+}
+
+
+// DESC: the text file appended to a followed file 'append_len' bytes 
+// at a time, each append looked at and scanned into the text like the 
+// editor does; only the editor's side is timed
+void bench_follow(size_t runs, size_t append_len)
+{
+  FileBuf text = {0};
+  if (FRED_open_file(&text, text_file_path)) ERR("failed to read the text.");
+  double best = -1;
+  size_t lines = 0;
+  for (size_t r = 0; r < runs; r++) {
+    char follow_path[] = "/tmp/fred_bench_follow_XXXXXX";
+    int fd = mkstemp(follow_path);
+    if (fd == -1) ERR("failed to create temp file, %s.", strerror(errno));
+    int notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    FredEditor fe = {0};
+    fe.progressive = true;
+    if (fred_editor_init(&fe, follow_path)) ERR("failed to initialize fred.");
+    if (FRED_follow_start(&fe, follow_path, notify_fd)) ERR("failed to follow the file.");
+
+    double elapsed = 0;
+    for (size_t off = 0; off < text.size; off += append_len) {
+      size_t len = text.size - off < append_len ? text.size - off : append_len;
+      if (write(fd, text.text + off, len) != (ssize_t)len) ERR("failed to append to the followed file.");
+      double start = monotonic_ms();
+      if (FRED_follow_check(&fe) || FRED_index_until(&fe, SIZE_MAX)) ERR("failed to follow the file.");
+      elapsed += monotonic_ms() - start;
+    }
+    if (best < 0 || elapsed < best) best = elapsed;
+    lines = fe.lines_len.len;
+    fred_editor_free(&fe);
+    close(notify_fd);
+    close(fd);
+    unlink(follow_path);
+  }
+  size_t text_size = text.size;
+  FRED_close_file(&text);
+  char name[48];
+  snprintf(name, sizeof(name), "following, %zu KB appends", append_len >> 10);
+  printf("  %-28s %9.2f ms  %8.1f MB/s  (%zu lines)\n", name, best, text_size / 1e6 / (best / 1e3), lines);
+}
+
+
+// DESC: the text file edited in the middle, then 'changed_lines' of its 
+// lines, spread over it, changed by another writer and merged in with 
+// FRED_reload_check(); opening it again is the "scanning the lines" above
+void bench_reload(size_t runs, size_t changed_lines)
+{
+  FileBuf text = {0};
+  if (FRED_open_file(&text, text_file_path)) ERR("failed to read the text.");
+  char* changed = malloc(text.size);
+  if (changed == NULL) ERR("not enough memory for the changed text.");
+  memcpy(changed, text.text, text.size);
+  size_t step = text.size / (changed_lines + 1);
+  for (size_t k = 1; k <= changed_lines; k++) {
+    const char* nl = memchr(changed + k * step, '\n', text.size - k * step);
+    if (nl != NULL && nl + 1 < changed + text.size && nl[1] != '\n') changed[nl + 1 - changed] = '#';
+  }
+
+  double best = -1;
+  size_t pieces = 0;
+  for (size_t r = 0; r < runs; r++) {
+    char reload_path[] = "/tmp/fred_bench_reload_XXXXXX";
+    char new_path[sizeof(reload_path) + 4];
+    int fd = mkstemp(reload_path);
+    if (fd == -1) ERR("failed to create temp file, %s.", strerror(errno));
+    if (write(fd, text.text, text.size) != (ssize_t)text.size) ERR("failed to write the temp file.");
+    close(fd);
+    FredEditor fe = {0};
+    if (fred_editor_init(&fe, reload_path)) ERR("failed to initialize fred.");
+    fe.cursor.row = fe.lines_len.len / 2;
+    for (size_t i = 0; i < 8; i++) {
+      if (FRED_insert_text(&fe, 'x')) ERR("failed to insert text.");
+    }
+
+    snprintf(new_path, sizeof(new_path), "%s.new", reload_path);
+    FILE* f = fopen(new_path, "wb");
+    if (f == NULL || fwrite(changed, 1, text.size, f) != text.size) ERR("failed to write the changed file.");
+    fclose(f);
+    if (rename(new_path, reload_path) == -1) ERR("failed to replace the file, %s.", strerror(errno));
+
+    double start = monotonic_ms();
+    if (FRED_reload_check(&fe, reload_path)) ERR("failed to reload the file.");
+    double elapsed = monotonic_ms() - start;
+    if (FRED_text_len(&fe) != text.size + 8) ERR("the edits didn't survive the reload.");
+    if (best < 0 || elapsed < best) best = elapsed;
+    pieces = fe.piece_table.len;
+    FRED_journal_close(&fe, true);
+    fred_editor_free(&fe);
+    unlink(reload_path);
+  }
+  free(changed);
+  FRED_close_file(&text);
+  char name[48];
+  snprintf(name, sizeof(name), "%zu lines changed", changed_lines);
+  printf("  %-28s %9.2f ms  (%zu pieces)\n", name, best, pieces);
+}
+
+
+// DESC: lines_scan_file() on the file as loaded, with 1, 2, 4, ... 
+// threads and then 'max_threads'
+void bench_scan_threads(size_t runs, size_t max_threads, size_t text_len)
+{
+  FredEditor fe = {0};
+  if (fred_editor_init(&fe, text_file_path)) ERR("failed to initialize fred.");
+  double one_thread = -1;
+  for (size_t threads = 1; threads <= max_threads; threads = threads * 2 > max_threads && threads < max_threads ? max_threads : threads * 2) {
+    fe.index_threads = threads;
+    double best = -1;
+    for (size_t r = 0; r < runs; r++) {
+      double start = monotonic_ms();
+      if (lines_scan_file(&fe, 0)) ERR("failed to scan the lines.");
+      double elapsed = monotonic_ms() - start;
+      if (best < 0 || elapsed < best) best = elapsed;
+    }
+    if (one_thread < 0) one_thread = best;
+    char name[32];
+    snprintf(name, sizeof(name), "scan, %zu thread%s", threads, threads > 1 ? "s" : "");
+    printf("  %-28s %9.2f ms  %8.1f MB/s  x%.2f\n", name, best, text_len / 1e6 / (best / 1e3), one_thread / best);
+  }
+  fred_editor_free(&fe);
+}
+
+
+// DESC: types JOURNAL_KEYS keys, moving to the next line every 
+// JOURNAL_KEYS_PER_LINE, flushing the journal in between
+void bench_journal(size_t runs)
+{
+  printf("  %-28s %9.2f ms\n", "loading without a journal", bench_open(runs, true));
+
+  FredEditor fe = {0};
+  if (fred_editor_init(&fe, text_file_path)) ERR("failed to initialize fred.");
+  bool running = true, insert = false;
+  size_t typed = 0, flushes = 0;
+  double flush_ms = 0;
+
+  for (size_t k = 0; k < JOURNAL_KEYS; k++) {
+    if (k % JOURNAL_KEYS_PER_LINE == 0) {
+      char esc[] = {ESC_CH, 0};
+      FRED_handle_input(&fe, &running, &insert, esc, 1);
+      FRED_handle_input(&fe, &running, &insert, "j", 1);
+      FRED_handle_input(&fe, &running, &insert, "i", 1);
+    }
+    char key[] = {'a' + k % 26, 0};
+    if (FRED_handle_input(&fe, &running, &insert, key, 1)) ERR("failed to handle key.");
+    typed++;
+    if (k % JOURNAL_KEYS_PER_FLUSH == JOURNAL_KEYS_PER_FLUSH - 1) {
+      double start = monotonic_ms();
+      if (FRED_journal_flush(&fe)) ERR("failed to flush the journal.");
+      flush_ms += monotonic_ms() - start;
+      flushes++;
+    }
+  }
+  if (FRED_journal_flush(&fe) || FRED_journal_sync(&fe)) ERR("failed to flush the journal.");
+  size_t journal_bytes = fe.journal.bytes_written;
+  size_t pieces = fe.piece_table.len;
+  fred_editor_free(&fe); // NOTE: keeps the journal, like a crash
+
+  printf("  %zu bytes typed, %zu flushes of %.1f us each\n", typed, flushes, flush_ms * 1e3 / flushes);
+  printf("  %zu journal bytes, %.2f per byte typed\n", journal_bytes, (double)journal_bytes / typed);
+
+  double best = -1;
+  for (size_t r = 0; r < runs; r++) {
+    FredEditor recovered = {0};
+    double start = monotonic_ms();
+    if (fred_editor_init(&recovered, text_file_path)) ERR("failed to initialize fred.");
+    double elapsed = monotonic_ms() - start;
+    if (!recovered.journal.recovered || recovered.piece_table.len != pieces) ERR("failed to recover from the journal.");
+    if (best < 0 || elapsed < best) best = elapsed;
+    if (r + 1 == runs) FRED_journal_close(&recovered, true);
+    fred_editor_free(&recovered);
+  }
+  printf("  %-28s %9.2f ms  (%zu pieces)\n", "recovery", best, pieces);
+}
+
+
+typedef size_t (*CountLines)(FredEditor* fe);
+
+
+void bench_count_lines(FredEditor* fe, const char* name, CountLines count_lines, size_t runs, size_t text_len)
+{
+  double best = -1;
+  size_t lines = 0;
+  for (size_t r = 0; r < runs; r++) {
+    double start = monotonic_ms();
+    lines = count_lines(fe);
+    double elapsed = monotonic_ms() - start;
+    if (best < 0 || elapsed < best) best = elapsed;
+  }
+  printf("  %-28s %9.2f ms  %8.1f MB/s  (%zu lines)\n", name, best, text_len / 1e6 / (best / 1e3), lines);
+}
+
+
+// DESC: the text split in 'count' pieces, like after a long editing 
+// session: seeking to random offsets walks the pieces adding up their 
+// lengths, and each char typed at the start of a random line splits 
+// a piece and moves all the ones after it
+void bench_pieces(size_t runs, size_t count, size_t text_len)
+{
+  FredEditor fe = {0};
+  if (fred_editor_init(&fe, text_file_path)) ERR("failed to initialize fred.");
+  size_t piece_len = text_len / count ? text_len / count : 1;
+
+  fragment_table(&fe, piece_len);
+  double best = -1;
+  size_t walked = 0;
+  for (size_t r = 0; r < runs; r++) {
+    srand(2);
+    walked = 0;
+    double start = monotonic_ms();
+    for (size_t k = 0; k < PIECES_SEEKS; k++) {
+      PieceIter it = piece_iter_at(&fe, (size_t)rand() % text_len);
+      walked += it.piece_idx;
+    }
+    double elapsed = monotonic_ms() - start;
+    if (best < 0 || elapsed < best) best = elapsed;
+  }
+  char name[48];
+  snprintf(name, sizeof(name), "%zu seeks, %zuK pieces", (size_t)PIECES_SEEKS, fe.piece_table.len >> 10);
+  printf("  %-28s %9.2f ms  %8.1f M pieces/s\n", name, best, walked / 1e6 / (best / 1e3));
+
+  best = -1;
+  for (size_t r = 0; r < runs; r++) {
+    fragment_table(&fe, piece_len);
+    if (FRED_get_lines_len(&fe)) ERR("failed to get lines-length.");
+    srand(3);
+    double start = monotonic_ms();
+    for (size_t k = 0; k < PIECES_EDITS; k++) {
+      fe.cursor = (Cursor){ .row = (size_t)rand() % fe.lines_len.len, .col = 0 };
+      if (FRED_insert_text(&fe, 'x')) ERR("failed to insert text.");
+    }
+    double elapsed = monotonic_ms() - start;
+    if (best < 0 || elapsed < best) best = elapsed;
+  }
+  snprintf(name, sizeof(name), "%zu edits, %zuK pieces", (size_t)PIECES_EDITS, fe.piece_table.len >> 10);
+  printf("  %-28s %9.2f ms  %8.0f edits/s\n", name, best, PIECES_EDITS / (best / 1e3));
+  fred_editor_free(&fe);
+}
+
+
+// NOTE: Piece as it was before the flags got folded into its offset, 
+// kept to bench the two layouts side by side, see bench_piece_layouts()
+typedef struct {
+  bool which_buf;
+  bool is_ascii;
+  size_t offset;
+  size_t len;
+} PieceWide;
+
+
+// DESC: the seeks and edits of bench_pieces() on a bare array of 
+// 'count' pieces of 'type', all 'piece_len' long: a seek adds up the 
+// lengths from the first piece, an edit splits a piece in 3 moving 
+// all the ones after it; best of 'runs' in 'seeks_ms' and 'edits_ms'
+#define BENCH_LAYOUT(type, count, piece_len, runs, seeks_ms, edits_ms) do { \
+  size_t cap = (count) + 2 * PIECES_EDITS;                                   \
+  type* items = malloc(cap * sizeof(type));                                   \
+  if (items == NULL) ERR("not enough memory.");                                \
+  for (size_t r = 0; r < (runs); r++) {                                        \
+    size_t len = (count);                                                      \
+    for (size_t i = 0; i < len; i++) {                                         \
+      items[i] = (type){ .which_buf = i % 2, .is_ascii = 1,                    \
+                         .offset = i * (piece_len), .len = (piece_len) };      \
+    }                                                                          \
+    size_t text_len = len * (piece_len);                                       \
+    srand(2);                                                                  \
+    double start = monotonic_ms();                                             \
+    for (size_t k = 0; k < PIECES_SEEKS; k++) {                                \
+      size_t offset = (size_t)rand() % text_len, i = 0, at = 0;                \
+      while (i < len && at + items[i].len <= offset) at += items[i++].len;     \
+      bench_sink += i;                                                         \
+    }                                                                          \
+    double elapsed = monotonic_ms() - start;                                   \
+    if ((seeks_ms) < 0 || elapsed < (seeks_ms)) (seeks_ms) = elapsed;          \
+    srand(3);                                                                  \
+    start = monotonic_ms();                                                    \
+    for (size_t k = 0; k < PIECES_EDITS; k++) {                                \
+      size_t i = (size_t)rand() % len;                                         \
+      type p = items[i];                                                       \
+      memmove(items + i + 3, items + i + 1, (len - i - 1) * sizeof(type));     \
+      items[i].len = p.len / 2;                                                \
+      items[i + 1] = (type){ .which_buf = 1, .is_ascii = 1,                    \
+                             .offset = k, .len = 1 };                          \
+      items[i + 2] = p;                                                        \
+      items[i + 2].offset += p.len / 2;                                        \
+      items[i + 2].len -= p.len / 2;                                           \
+      len += 2;                                                                \
+    }                                                                          \
+    elapsed = monotonic_ms() - start;                                          \
+    if ((edits_ms) < 0 || elapsed < (edits_ms)) (edits_ms) = elapsed;          \
+  }                                                                            \
+  free(items);                                                                 \
+} while (0)
+
+
+// DESC: the same table in the 24 bytes layout Piece had and in the 
+// 16 bytes one it has now, so the difference can be measured on any 
+// machine, not just against numbers from an older build
+void bench_piece_layouts(size_t runs, size_t count, size_t text_len)
+{
+  size_t piece_len = text_len / count ? text_len / count : 1;
+  double wide_seeks = -1, wide_edits = -1, seeks = -1, edits = -1;
+  BENCH_LAYOUT(PieceWide, count, piece_len, runs, wide_seeks, wide_edits);
+  BENCH_LAYOUT(Piece, count, piece_len, runs, seeks, edits);
+  printf("  %-28s %9.2f ms  %9.2f ms  (%zu, %zu bytes a piece)\n", "seeks, old vs packed layout", 
+         wide_seeks, seeks, sizeof(PieceWide), sizeof(Piece));
+  printf("  %-28s %9.2f ms  %9.2f ms\n", "edits, old vs packed layout", wide_edits, edits);
+}
+
+
+// DESC: 'MULTI_PREFIX' typed at the start of 'MULTI_LINES' lines, 
+// all at once with a block insert, or one line at a time
+void bench_multi(size_t runs, bool block)
+{
+  double best = -1;
+  size_t lines = 0;
+  for (size_t r = 0; r < runs; r++) {
+    FredEditor fe = {0};
+    if (fred_editor_init(&fe, text_file_path)) ERR("failed to initialize fred.");
+    size_t rows = fe.lines_len.len < MULTI_LINES ? fe.lines_len.len : MULTI_LINES;
+    lines = 0;
+
+    double start = monotonic_ms();
+    if (block) {
+      fe.multi.selecting = true;
+      fe.cursor = (Cursor){ .row = rows - 1 };
+      if (FRED_block_insert_start(&fe)) ERR("failed to start the block insert.");
+      for (const char* c = MULTI_PREFIX; *c; c++) {
+        if (FRED_multi_insert(&fe, *c)) ERR("failed to insert text.");
+      }
+      lines = fe.multi.len;
+    } else {
+      for (size_t row = 0; row < rows; row++) {
+        if (!fe.lines_len.items[row]) continue; // NOTE: like the block insert
+        fe.cursor = (Cursor){ .row = row };
+        for (const char* c = MULTI_PREFIX; *c; c++) {
+          if (FRED_insert_text(&fe, *c)) ERR("failed to insert text.");
+        }
+        lines++;
+      }
+    }
+    double elapsed = monotonic_ms() - start;
+    if (best < 0 || elapsed < best) best = elapsed;
+    fred_editor_free(&fe);
+  }
+  char name[48];
+  snprintf(name, sizeof(name), "%zu lines, %s", lines, block ? "block insert" : "line by line");
+  printf("  %-28s %9.2f ms\n", name, best);
+}
+
+
+// DESC: ':%s/<pat>/<rep>/g' on the whole text, the matches counted 
+// from how much longer it got ('rep' must be one byte longer)
+void bench_substitute(size_t runs, const char* pat, const char* rep)
+{
+  double best = -1;
+  size_t matches = 0, pieces = 0, added = 0;
+  for (size_t r = 0; r < runs; r++) {
+    FredEditor fe = {0};
+    if (fred_editor_init(&fe, text_file_path)) ERR("failed to initialize fred.");
+    if (FRED_index_until(&fe, SIZE_MAX)) ERR("failed to scan the lines.");
+    size_t text_len = FRED_text_len(&fe);
+    size_t add_len = fe.add_buf.len;
+
+    double start = monotonic_ms();
+    if (FRED_substitute(&fe, 0, fe.lines_len.len - 1, pat, strlen(pat), rep, strlen(rep), true)) {
+      ERR("failed to substitute.");
+    }
+    double elapsed = monotonic_ms() - start;
+    if (best < 0 || elapsed < best) best = elapsed;
+    matches = FRED_text_len(&fe) - text_len;
+    pieces = fe.piece_table.len;
+    added = fe.add_buf.len - add_len;
+    fred_editor_free(&fe);
+  }
+  char name[48];
+  snprintf(name, sizeof(name), ":%%s/%s/%s/g", pat, rep);
+  printf("  %-28s %9.2f ms  %8.1f M matches/s  (%zu matches, %zu pieces, %zu bytes added)\n", 
+         name, best, matches / 1e6 / (best / 1e3), matches, pieces, added);
+}
+
+
+// DESC: the whole text yanked, put under its last line and half of 
+// it deleted, on a table of pieces 'piece_len' long: each takes the 
+// time of the pieces, no byte gets copied
+void bench_registers(size_t runs, size_t piece_len)
+{
+  double best[3] = { -1, -1, -1 };
+  size_t text_len = 0, pieces = 0;
+  for (size_t r = 0; r < runs; r++) {
+    FredEditor fe = {0};
+    if (fred_editor_init(&fe, text_file_path)) ERR("failed to initialize fred.");
+    fragment_table(&fe, piece_len);
+    if (FRED_index_until(&fe, SIZE_MAX)) ERR("failed to scan the lines.");
+    text_len = FRED_text_len(&fe);
+    pieces = fe.piece_table.len;
+    double elapsed[3] = {0};
+
+    double start = monotonic_ms();
+    fe.cursor = (Cursor){0};
+    if (FRED_motion_op(&fe, 'y', 'j', fe.lines_len.len)) ERR("failed to yank.");
+    elapsed[0] = monotonic_ms() - start;
+
+    start = monotonic_ms();
+    fe.cursor = (Cursor){ .row = fe.lines_len.len - 1 };
+    if (FRED_put(&fe, 1)) ERR("failed to put.");
+    elapsed[1] = monotonic_ms() - start;
+    if (FRED_text_len(&fe) != 2 * text_len + 1) ERR("the put text is %zu bytes long, not %zu.", FRED_text_len(&fe), 2 * text_len + 1);
+
+    start = monotonic_ms();
+    if (FRED_delete_range(&fe, text_len / 2, text_len / 2 + text_len)) ERR("failed to delete.");
+    elapsed[2] = monotonic_ms() - start;
+    if (FRED_text_len(&fe) != text_len + 1) ERR("the text is %zu bytes long after the delete, not %zu.", FRED_text_len(&fe), text_len + 1);
+
+    for (int k = 0; k < 3; k++) {
+      if (best[k] < 0 || elapsed[k] < best[k]) best[k] = elapsed[k];
+    }
+    fred_editor_free(&fe);
+  }
+  const char* names[3] = { "yank all", "put all", "delete half a text" };
+  printf("  (%zu MB, %zuK pieces)\n", text_len / 1000 / 1000, pieces >> 10);
+  for (int k = 0; k < 3; k++) {
+    printf("  %-28s %9.2f ms  %8.1f GB/s\n", names[k], best[k], text_len / 1e9 / (best[k] / 1e3));
+  }
+}
+
+
+// DESC: a '/' search through the whole text (the pattern isn't in 
+// it), forward span by span and backward chunk by chunk
+void bench_search(FredEditor* fe, size_t runs, size_t text_len)
+{
+  const char pat[] = "fred\x01";
+  for (int back = 0; back <= 1; back++) {
+    double best = -1;
+    for (size_t r = 0; r < runs; r++) {
+      double start = monotonic_ms();
+      size_t found = back ? text_find_back(fe, 0, text_len, pat, sizeof(pat) - 1) 
+                          : text_find(fe, 0, text_len, pat, sizeof(pat) - 1, false);
+      double elapsed = monotonic_ms() - start;
+      if (found != SIZE_MAX) ERR("found a pattern that isn't in the text.");
+      if (best < 0 || elapsed < best) best = elapsed;
+    }
+    printf("  %-28s %9.2f ms  %8.1f MB/s\n", back ? "text_find_back()" : "text_find()", best, text_len / 1e6 / (best / 1e3));
+  }
+}
+
+
+void usage(const char* program)
+{
+  fprintf(stderr, "usage: %s [-m <text-MB>] [-p <piece-length>] [-r <runs>] [-j <max-threads>]\n", program);
+  fprintf(stderr, "  -m: size of the generated text in MB (default: %d)\n", DEFAULT_TEXT_MB);
+  fprintf(stderr, "  -p: length of each piece (default: %d)\n", DEFAULT_PIECE_LEN);
+  fprintf(stderr, "  -r: runs per benchmark, the best one is reported (default: %d)\n", DEFAULT_RUNS);
+  fprintf(stderr, "  -j: most threads scanning the lines (default: one per core)\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+  size_t text_mb = DEFAULT_TEXT_MB;
+  size_t piece_len = DEFAULT_PIECE_LEN;
+  size_t runs = DEFAULT_RUNS;
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t max_threads = cores > 0 ? cores : 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      ERR("missing value for '%s'.", argv[i]);
+    }
+    if      (0 == strcmp(argv[i], "-m")) text_mb = strtoul(argv[++i], NULL, 10);
+    else if (0 == strcmp(argv[i], "-p")) piece_len = strtoul(argv[++i], NULL, 10);
+    else if (0 == strcmp(argv[i], "-r")) runs = strtoul(argv[++i], NULL, 10);
+    else if (0 == strcmp(argv[i], "-j")) max_threads = strtoul(argv[++i], NULL, 10);
+    else {
+      usage(argv[0]);
+      ERR("unknown argument '%s'.", argv[i]);
+    }
+  }
+  if (piece_len == 0) piece_len = 1;
+  if (runs == 0) runs = 1;
+  if (max_threads == 0) max_threads = 1;
+  if (max_threads > LINES_MAX_THREADS) max_threads = LINES_MAX_THREADS;
+
+  size_t text_len = make_text_file(text_mb * 1000 * 1000);
+  FredEditor fe = {0};
+  if (fred_editor_init(&fe, text_file_path)) ERR("failed to initialize fred.");
+  fe.tab_width = TAB_WIDTH_DEFAULT;
+  fragment_table(&fe, piece_len);
+
+  printf("text: %.1f MB, %zu pieces of %zu bytes\n", text_len / 1e6, fe.piece_table.len, piece_len);
+  printf("counting lines:\n");
+  bench_count_lines(&fe, "per-byte buf() macro", count_lines_buf_macro, runs, text_len);
+  bench_count_lines(&fe, "per-byte piece_iter_next()", count_lines_iter_next, runs, text_len);
+  bench_count_lines(&fe, "spans + memchr()", count_lines_iter_spans, runs, text_len);
+
+  printf("lines length and width:\n");
+  bench_count_lines(&fe, "per-byte buf() macro", lines_len_buf_macro, runs, text_len);
+  bench_count_lines(&fe, "FRED_get_lines_len()", lines_len_iter, runs, text_len);
+
+  printf("searching:\n");
+  bench_search(&fe, runs, text_len);
+
+  fred_editor_free(&fe);
+
+  printf("pieces:\n");
+  bench_pieces(runs, PIECES_COUNT, text_len);
+  bench_piece_layouts(runs, PIECES_COUNT, text_len);
+
+  snprintf(lines_cache_path, sizeof(lines_cache_path), "/tmp/.%s.fred-lines", text_file_path + strlen("/tmp/"));
+  printf("block insert:\n");
+  bench_multi(runs, true);
+  bench_multi(1, false); // NOTE: shifts all the line-starts after each key, many seconds a run
+
+  printf("substituting:\n");
+  bench_substitute(runs, "ab", "xyz");
+  bench_substitute(runs, "a", "bc");
+
+  printf("registers:\n");
+  bench_registers(runs, piece_len);
+
+  printf("opening:\n");
+  printf("  %-28s %9.2f ms\n", "scanning the lines", bench_open(runs, false)); // NOTE: leaves the cache there
+  printf("  %-28s %9.2f ms\n", "from the lines-cache", bench_open(runs, true));
+  printf("  %-28s %9.2f ms\n", "first frame, all indexed", bench_first_frame(runs, false));
+  printf("  %-28s %9.2f ms\n", "first frame, progressive", bench_first_frame(runs, true));
+  bench_typing_frames(runs);
+  bench_scan_threads(runs, max_threads, text_len);
+  bench_follow(runs, 64 << 10);
+  bench_follow(runs, 1 << 20);
+
+  printf("reloading:\n");
+  bench_reload(runs, 1);
+  bench_reload(runs, 1000);
+
+  printf("journal:\n");
+  bench_journal(runs);
+  unlink(text_file_path);
+  unlink(lines_cache_path);
+  return 0;
+}
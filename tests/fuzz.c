@@ -0,0 +1,1670 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+
+#include "./../src/fred.h"
+
+
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//
+// Differential fuzzer for the editing core: random keys are fed both to
+// FRED_handle_input() and to a trivial reference model (a flat byte array
+// with a cursor). After every key the text, the cursor and the LinesLen of
+// the two are compared, along with the lines display width and the
+// RowIndex of the wrapped rows. The pieces get compacted every few
+// keys, as the editor does when idle, and the journal gets flushed; at
+// the end a second editor recovers from the journal and gets compared
+// to the model too. Every SCAN_CHECK_EVERY iterations a random big file
+// gets its lines built the ways a load does and checked against a
+// plain scan of the same text. Every RELOAD_CHECK_EVERY iterations a
+// random file gets edited and then changed under the editor, and the
+// merge of FRED_reload_check() gets checked against model_reload().
+//
+// It can be built as:
+//   - a standalone driver (make Fuzz): random keys generated from a seed;
+//   - a libFuzzer target (make LibFuzzer, needs clang), where the input
+//     bytes get mapped to keys.
+//
+// On failure the keys get shrunk and the smallest failing case is
+// emitted as a 'fred_test' folder (keys.txt, snaps.txt, ...), so it can
+// be replayed with 'test.c' like the ones generated with Neovim.
+//
+// ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+
+#define ERR(...) do { \
+  fprintf(stderr, "ERROR: "); \
+  fprintf(stderr, __VA_ARGS__); \
+  fprintf(stderr, "\n"); \
+  exit(1); \
+} while (0)
+
+#define assert_(cond, ...) do { \
+  if (!(cond)){ \
+    fprintf(stderr, "[%s, line: %d] ASSERTION FAILED '" #cond "':\n", __FILE__, __LINE__); \
+    fprintf(stderr, __VA_ARGS__); \
+    fprintf(stderr, "\n"); \
+    exit(1); \
+  } \
+} while (0)
+
+
+#define DEL_CH 127
+#define DEFAULT_ITERATIONS 1000
+#define DEFAULT_MAX_KEYS 2000
+#define SCAN_CHECK_EVERY 100 // NOTE: iterations between two checks of the line scans of a big file
+#define RELOAD_CHECK_EVERY 10 // NOTE: iterations between two checks of a reload merging in a change to the file
+
+
+char empty_file_path[] = "/tmp/fred_fuzz_XXXXXX";
+char big_file_path[] = "/tmp/fred_fuzz_big_XXXXXX";
+char reload_file_path[] = "/tmp/fred_fuzz_reload_XXXXXX";
+
+
+typedef struct {
+  char* text;
+  size_t len;
+  size_t cap;
+  size_t row;
+  size_t col;
+  bool insert;
+  size_t count; // NOTE: count typed before a normal-mode key
+  char prefix;
+  bool cmdline; // NOTE: typing a ':' command or a '/' pattern
+  char cmd_kind;
+  char cmd[CMDLINE_MAX_LEN + 1];
+  size_t cmd_len;
+  char search[CMDLINE_MAX_LEN];
+  size_t search_len;
+  size_t op_count;
+  char visual; // NOTE: 'v' or 'V' while selecting from 'visual_row', 'visual_col'
+  size_t visual_row;
+  size_t visual_col;
+  char* reg; // NOTE: the text yanked or deleted, as a copy
+  size_t reg_len;
+  bool reg_linewise;
+  bool selecting; // NOTE: a block selected with Ctrl-V
+  size_t anchor_row;
+  size_t anchor_disp_col;
+  size_t* mc_rows; // NOTE: the cursors of a block insert, at 'mc_cols' plus what got typed
+  size_t* mc_cols;
+  size_t mc_len;
+  size_t typed;
+} Model;
+
+
+typedef struct {
+  size_t step; // NOTE: index of the key after which fred and the model diverged
+  char msg[256];
+} Mismatch;
+
+
+
+void model_free(Model* m)
+{
+  free(m->text);
+  free(m->mc_rows);
+  free(m->mc_cols);
+  free(m->reg);
+  *m = (Model){0};
+}
+
+
+size_t model_lines_count(Model* m)
+{
+  size_t lines = 1;
+  for (size_t i = 0; i < m->len; i++) lines += m->text[i] == '\n';
+  return lines;
+}
+
+
+// DESC: returns offset of the first char of 'row'
+size_t model_line_start(Model* m, size_t row)
+{
+  size_t offset = 0;
+  for (size_t r = 0; r < row; r++) {
+    while (m->text[offset] != '\n') offset++;
+    offset++;
+  }
+  return offset;
+}
+
+
+size_t model_line_len(Model* m, size_t row)
+{
+  size_t start = model_line_start(m, row);
+  size_t end = start;
+  while (end < m->len && m->text[end] != '\n') end++;
+  return end - start;
+}
+
+
+int model_char_class(char c)
+{
+  if (c == SPACE_CH || c == '\t' || c == '\n' || c == '\0') return 0;
+  if ((unsigned char)c >= 0x80 || c == '_' || (c >= '0' && c <= '9') ||
+      (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) return 2;
+  return 1;
+}
+
+
+void model_set_offset(Model* m, size_t offset)
+{
+  m->row = 0;
+  size_t line_start = 0;
+  for (size_t i = 0; i < offset; i++) {
+    if (m->text[i] == '\n') {
+      m->row++;
+      line_start = i + 1;
+    }
+  }
+  m->col = offset - line_start;
+}
+
+
+void model_move_rows(Model* m, size_t rows, bool down)
+{
+  size_t tot_lines = model_lines_count(m);
+  if (down) m->row = rows < tot_lines - 1 - m->row ? m->row + rows : tot_lines - 1;
+  else m->row = rows < m->row ? m->row - rows : 0;
+  size_t line_len = model_line_len(m, m->row);
+  if (m->col > line_len) m->col = line_len;
+}
+
+
+// DESC: display column where 'col' of 'row' starts, with 
+// the width of the char there in 'width' (the text is ascii)
+size_t model_disp_col(Model* m, size_t row, size_t col, size_t* width)
+{
+  size_t start = model_line_start(m, row);
+  size_t disp_col = 0;
+  for (size_t i = 0; i < col; i++) {
+    if (m->text[start + i] == '\t') disp_col += TAB_WIDTH_DEFAULT - disp_col % TAB_WIDTH_DEFAULT;
+    else disp_col++;
+  }
+  if (width) *width = start + col < m->len && m->text[start + col] == '\t' ? TAB_WIDTH_DEFAULT - disp_col % TAB_WIDTH_DEFAULT : 1;
+  return disp_col;
+}
+
+
+// DESC: 'I', a cursor at the left column of the block on every line 
+// that reaches into it, or the first non-blank char of the line
+void model_block_insert_start(Model* m)
+{
+  m->insert = true;
+  m->mc_len = 0;
+  m->typed = 0;
+  if (!m->selecting) {
+    size_t start = model_line_start(m, m->row);
+    size_t line_len = model_line_len(m, m->row);
+    for (m->col = 0; m->col < line_len; m->col++) {
+      if (m->text[start + m->col] != SPACE_CH && m->text[start + m->col] != '\t') break;
+    }
+    return;
+  }
+
+  m->selecting = false;
+  size_t disp_col = model_disp_col(m, m->row, m->col, NULL);
+  size_t left = disp_col < m->anchor_disp_col ? disp_col : m->anchor_disp_col;
+  size_t top = m->row < m->anchor_row ? m->row : m->anchor_row;
+  size_t bottom = m->row < m->anchor_row ? m->anchor_row : m->row;
+  m->mc_rows = realloc(m->mc_rows, (bottom - top + 1) * sizeof(*m->mc_rows));
+  m->mc_cols = realloc(m->mc_cols, (bottom - top + 1) * sizeof(*m->mc_cols));
+  assert_(m->mc_rows != NULL && m->mc_cols != NULL, "not enough memory");
+  for (size_t row = top; row <= bottom; row++) {
+    size_t line_len = model_line_len(m, row);
+    for (size_t col = 0; col < line_len; col++) {
+      size_t width = 0;
+      if (model_disp_col(m, row, col, &width) + width > left) { // NOTE: the char over the left column
+        m->mc_rows[m->mc_len] = row;
+        m->mc_cols[m->mc_len++] = col;
+        break;
+      }
+    }
+  }
+  if (m->mc_len) {
+    m->row = m->mc_rows[0];
+    m->col = m->mc_cols[0];
+  }
+  if (m->mc_len == 1) m->mc_len = 0;
+}
+
+
+// DESC: types 'key' (or deletes the char before, for 'DEL_CH') at 
+// all the cursors of a block insert, from the last one up so the 
+// offsets of the others stay put
+void model_multi_apply(Model* m, char key)
+{
+  for (size_t k = m->mc_len; k-- > 0;) {
+    size_t offset = model_line_start(m, m->mc_rows[k]) + m->mc_cols[k] + m->typed;
+    if (key == DEL_CH) {
+      memmove(m->text + offset - 1, m->text + offset, m->len - offset);
+      m->len--;
+      continue;
+    }
+    if (m->len + 1 > m->cap) {
+      m->cap = m->cap ? m->cap * 2 : 64;
+      m->text = realloc(m->text, m->cap);
+      assert_(m->text != NULL, "not enough memory");
+    }
+    memmove(m->text + offset + 1, m->text + offset, m->len - offset);
+    m->text[offset] = key;
+    m->len++;
+  }
+  m->typed = key == DEL_CH ? m->typed - 1 : m->typed + 1;
+  m->row = m->mc_rows[0];
+  m->col = m->mc_cols[0] + m->typed;
+}
+
+
+// DESC: ':s/pat/rep/' and ':%s/pat/rep/', with or without 'g', 
+// copying the text with the matches replaced
+void model_substitute(Model* m)
+{
+  bool whole_text = m->cmd[0] == '%';
+  const char* c = m->cmd + whole_text + 1;
+  char parts[2][CMDLINE_MAX_LEN];
+  size_t parts_len[2] = {0};
+  for (size_t i = 0; i < 2 && *c == '/'; i++) {
+    for (c++; *c && *c != '/'; c++) {
+      if (*c == '\\' && (c[1] == '/' || c[1] == '\\')) c++;
+      parts[i][parts_len[i]++] = *c;
+    }
+  }
+  if (*c == '/') c++;
+  bool global = strcmp(c, "g") == 0;
+  if (*c && !global) return;
+  if (parts_len[0]) {
+    memcpy(m->search, parts[0], parts_len[0]);
+    m->search_len = parts_len[0];
+  }
+  if (!m->search_len) return;
+
+  size_t top = whole_text ? 0 : m->row;
+  size_t bottom = whole_text ? model_lines_count(m) - 1 : m->row;
+  size_t cap = m->len * (parts_len[1] + 1) + 1;
+  char* text = malloc(cap);
+  assert_(text != NULL, "not enough memory");
+  size_t len = 0, row = 0, last_row = SIZE_MAX;
+  bool taken = false; // NOTE: a match replaced on the line already
+  for (size_t i = 0; i < m->len;) {
+    if (row >= top && row <= bottom && (global || !taken) && i + m->search_len <= m->len && 
+        memcmp(m->text + i, m->search, m->search_len) == 0) {
+      memcpy(text + len, parts[1], parts_len[1]);
+      len += parts_len[1];
+      i += m->search_len;
+      taken = true;
+      last_row = row;
+      continue;
+    }
+    if (m->text[i] == '\n') {
+      row++;
+      taken = false;
+    }
+    text[len++] = m->text[i++];
+  }
+  free(m->text);
+  m->text = text;
+  m->len = len;
+  m->cap = cap;
+  if (last_row == SIZE_MAX) return;
+
+  m->row = last_row;
+  size_t start = model_line_start(m, m->row);
+  size_t line_len = model_line_len(m, m->row);
+  for (m->col = 0; m->col < line_len; m->col++) {
+    if (m->text[start + m->col] != SPACE_CH && m->text[start + m->col] != '\t') break;
+  }
+}
+
+
+// DESC: 'w', 'b' and 'e' on the flat text, one word at a time
+size_t model_word_motion(Model* m, size_t o, char key)
+{
+#define cls_at(i) model_char_class(m->text[(i)])
+  if (key == 'w') {
+    int cls = o < m->len ? cls_at(o) : 0;
+    if (cls) while (o < m->len && cls_at(o) == cls) o++;
+    while (o < m->len) {
+      char c = m->text[o];
+      if (model_char_class(c)) break;
+      o++;
+      if (o < m->len && c == '\n' && m->text[o] == '\n') break;
+    }
+  } else if (key == 'b') {
+    if (o == 0) return o;
+    o--;
+    while (!cls_at(o)) {
+      if (m->text[o] == '\n' && (o == 0 || m->text[o - 1] == '\n')) return o;
+      if (o == 0) return o;
+      o--;
+    }
+    int cls = cls_at(o);
+    while (o > 0 && cls_at(o - 1) == cls) o--;
+  } else {
+    size_t n = o;
+    do {
+      if (n + 1 >= m->len) return o;
+      n++;
+    } while (!cls_at(n));
+    o = n;
+    int cls = cls_at(o);
+    while (o + 1 < m->len && cls_at(o + 1) == cls) o++;
+  }
+  return o;
+#undef cls_at
+}
+
+
+// DESC: the motions in MOTION_KEYS, 'n' times
+void model_move(Model* m, char key, size_t n)
+{
+  switch (key) {
+    case 'h': { m->col = n < m->col ? m->col - n : 0; break; }
+    case 'l': { 
+      size_t line_len = model_line_len(m, m->row);
+      m->col = n < line_len - m->col ? m->col + n : line_len; 
+      break; 
+    }
+    case 'j': case CTRL_KEY('d'): case CTRL_KEY('f'): { model_move_rows(m, n, true); break; }
+    case 'k': case CTRL_KEY('u'): case CTRL_KEY('b'): { model_move_rows(m, n, false); break; }
+    case '0': { m->col = 0; break; }
+    case '$': { m->col = model_line_len(m, m->row); break; }
+    case 'w': case 'b': case 'e': {
+      size_t o = model_line_start(m, m->row) + m->col;
+      for (size_t i = 0; i < n; i++) {
+        size_t next = model_word_motion(m, o, key);
+        if (next == o) break;
+        o = next;
+      }
+      model_set_offset(m, o);
+      break;
+    }
+  }
+}
+
+
+// DESC: [from, to) copied in the register, with the '\n' the last 
+// line doesn't have when 'newline'
+void model_yank(Model* m, size_t from, size_t to, bool linewise, bool newline)
+{
+  m->reg = realloc(m->reg, to - from + newline + 1);
+  assert_(m->reg != NULL, "not enough memory");
+  memcpy(m->reg, m->text + from, to - from);
+  if (newline) m->reg[to - from] = '\n';
+  m->reg_len = to - from + newline;
+  m->reg_linewise = linewise;
+}
+
+
+void model_delete(Model* m, size_t from, size_t to)
+{
+  memmove(m->text + from, m->text + to, m->len - to);
+  m->len -= to - from;
+}
+
+
+void model_first_non_blank(Model* m)
+{
+  size_t start = model_line_start(m, m->row);
+  size_t line_len = model_line_len(m, m->row);
+  for (m->col = 0; m->col < line_len; m->col++) {
+    if (m->text[start + m->col] != SPACE_CH && m->text[start + m->col] != '\t') break;
+  }
+}
+
+
+// DESC: 'dd', 'yy' and the others on whole lines
+void model_lines_op(Model* m, char op, size_t top, size_t bottom)
+{
+  size_t lines = model_lines_count(m);
+  if (bottom >= lines) bottom = lines - 1;
+  size_t from = model_line_start(m, top);
+  size_t to = bottom + 1 < lines ? model_line_start(m, bottom + 1) : m->len;
+  model_yank(m, from, to, true, bottom + 1 >= lines);
+  if (op == 'y') {
+    if (m->row > top) m->row = top;
+    size_t line_len = model_line_len(m, m->row);
+    if (m->col > line_len) m->col = line_len;
+    return;
+  }
+  if (bottom + 1 >= lines && top > 0) from--;
+  model_delete(m, from, to);
+  lines = model_lines_count(m);
+  m->row = top < lines ? top : lines - 1;
+  model_first_non_blank(m);
+}
+
+
+// DESC: 'd{motion}' and 'y{motion}'
+void model_motion_op(Model* m, char op, char motion, size_t n)
+{
+  size_t row = m->row, col = m->col;
+  model_move(m, motion, n);
+  size_t target_row = m->row, target_col = m->col;
+  m->row = row;
+  m->col = col;
+  if (strchr("jk\x04\x15\x06\x02", motion)) {
+    if (target_row == row) return;
+    model_lines_op(m, op, row < target_row ? row : target_row, row < target_row ? target_row : row);
+    return;
+  }
+  size_t from = model_line_start(m, row) + col;
+  size_t to = model_line_start(m, target_row) + target_col;
+  if (motion == 'w' && target_row > row) to = model_line_start(m, row) + model_line_len(m, row);
+  if (to < from) {
+    size_t tmp = to;
+    to = from;
+    from = tmp;
+  }
+  if (motion == 'e' && to < m->len) to++;
+  if (from == to) return;
+  model_yank(m, from, to, false, false);
+  if (op == 'd') model_delete(m, from, to);
+  model_set_offset(m, from);
+}
+
+
+// DESC: 'd' or 'y' on the selection of 'v' or 'V'
+void model_visual_op(Model* m, char op)
+{
+  char kind = m->visual;
+  m->visual = 0;
+  size_t lines = model_lines_count(m);
+  size_t anchor_row = m->visual_row < lines ? m->visual_row : lines - 1;
+  size_t anchor_len = model_line_len(m, anchor_row);
+  size_t anchor_col = m->visual_col < anchor_len ? m->visual_col : anchor_len;
+  if (kind == 'V') {
+    size_t top = m->row < anchor_row ? m->row : anchor_row;
+    size_t bottom = m->row < anchor_row ? anchor_row : m->row;
+    model_lines_op(m, op, top, bottom);
+    return;
+  }
+  size_t from = model_line_start(m, anchor_row) + anchor_col;
+  size_t to = model_line_start(m, m->row) + m->col;
+  if (to < from) {
+    size_t tmp = to;
+    to = from;
+    from = tmp;
+  }
+  if (to < m->len) to++;
+  if (from == to) return;
+  model_yank(m, from, to, false, false);
+  if (op == 'd') model_delete(m, from, to);
+  model_set_offset(m, from);
+}
+
+
+// DESC: 'p', 'n' times the register after the cursor's char, 
+// or under the cursor's line
+void model_put(Model* m, size_t n)
+{
+  if (!m->reg_len) return;
+  size_t lines = model_lines_count(m);
+  bool at_end = m->reg_linewise && m->row + 1 >= lines;
+  size_t at = 0;
+  if (m->reg_linewise) at = at_end ? m->len : model_line_start(m, m->row + 1);
+  else at = model_line_start(m, m->row) + m->col + (m->col < model_line_len(m, m->row));
+  size_t put_len = n * m->reg_len; // NOTE: with a '\n' first and one less at the end, 'at_end'
+  if (m->len + put_len > m->cap) {
+    m->cap = m->len + put_len;
+    m->text = realloc(m->text, m->cap);
+    assert_(m->text != NULL, "not enough memory");
+  }
+  memmove(m->text + at + put_len, m->text + at, m->len - at);
+  size_t o = at;
+  if (at_end) m->text[o++] = '\n';
+  for (size_t k = 0; k < n; k++) {
+    size_t len = at_end && k == n - 1 ? m->reg_len - 1 : m->reg_len;
+    memcpy(m->text + o, m->reg, len);
+    o += len;
+  }
+  m->len += put_len;
+  if (m->reg_linewise) {
+    m->row++;
+    model_first_non_blank(m);
+  } else {
+    model_set_offset(m, at + put_len - 1);
+  }
+}
+
+
+// DESC: 'n' times the next (or previous) match of the last pattern, 
+// wrapping around; byte by byte, with no pieces to cross
+void model_search(Model* m, bool forward, size_t n)
+{
+  if (!m->search_len) return;
+  size_t at = model_line_start(m, m->row) + m->col;
+  size_t tot = m->len >= m->search_len ? m->len - m->search_len + 1 : 0; // NOTE: offsets a match can start at
+#define match_at(o) (!memcmp(m->text + (o), m->search, m->search_len))
+  for (size_t k = 0; k < n; k++) {
+    size_t found = SIZE_MAX;
+    for (size_t i = 1; i <= m->len && found == SIZE_MAX; i++) {
+      size_t o = forward ? (at + i) % (m->len + 1) : (at + m->len + 1 - i) % (m->len + 1);
+      if (o < tot && match_at(o)) found = o;
+    }
+    if (found == SIZE_MAX && at < tot && match_at(at)) found = at;
+    if (found == SIZE_MAX) break;
+    at = found;
+  }
+#undef match_at
+  model_set_offset(m, at);
+}
+
+
+// DESC: applies 'key' with the same semantics Fred has,
+// e.g. 'j'/'k' clamp the column to the byte length of the line; 
+// page motions move a single line, since there's no window
+void model_apply(Model* m, char key)
+{
+  if (m->cmdline) {
+    if (key == ESC_CH) {
+      m->cmdline = false;
+    } else if (key == '\n' || key == '\r') {
+      m->cmdline = false;
+      m->cmd[m->cmd_len] = '\0';
+      if (m->cmd_kind == '/') {
+        if (m->cmd_len) {
+          memcpy(m->search, m->cmd, m->cmd_len);
+          m->search_len = m->cmd_len;
+        }
+        model_search(m, true, 1);
+        return;
+      }
+      if (strncmp(m->cmd, "s/", 2) == 0 || strncmp(m->cmd, "%s/", 3) == 0) {
+        model_substitute(m);
+        return;
+      }
+      char* num_end = NULL;
+      unsigned long long line = strtoull(m->cmd, &num_end, 10);
+      if (m->cmd_len && m->cmd[0] >= '0' && m->cmd[0] <= '9' && *num_end == '\0') {
+        size_t tot_lines = model_lines_count(m);
+        if (line < 1) line = 1;
+        m->row = line > tot_lines ? tot_lines - 1 : line - 1;
+        m->col = 0;
+      }
+    } else if (key == DEL_CH) {
+      if (!m->cmd_len) m->cmdline = false;
+      else m->cmd_len--;
+    } else if (key >= SPACE_CH && key < DEL_CH && m->cmd_len < CMDLINE_MAX_LEN) {
+      m->cmd[m->cmd_len++] = key;
+    }
+    return;
+  }
+
+  if (!m->insert) {
+    char prefix = m->prefix;
+    m->prefix = 0;
+    if (key >= '0' && key <= '9' && (key != '0' || m->count)) {
+      if (m->count < UINT32_MAX) m->count = m->count * 10 + (key - '0');
+      if (prefix == 'd' || prefix == 'y') m->prefix = prefix;
+      return;
+    }
+    size_t count = m->count;
+    size_t n = count ? count : 1;
+    m->count = 0;
+    size_t tot_lines = model_lines_count(m);
+
+    if (prefix == 'g') {
+      if (key == 'g') {
+        m->row = (count ? count : 1) > tot_lines ? tot_lines - 1 : (count ? count : 1) - 1;
+        m->col = 0;
+      }
+      return;
+    }
+    if (prefix == 'd' || prefix == 'y') {
+      size_t op_n = m->op_count || count ? (m->op_count ? m->op_count : 1) * (count ? count : 1) : 1;
+      m->op_count = 0;
+      if (key == prefix) model_lines_op(m, prefix, m->row, m->row + op_n - 1);
+      else if (key && strchr(MOTION_KEYS, key)) model_motion_op(m, prefix, key, op_n);
+      return;
+    }
+    switch (key) {
+      case 'g': { m->prefix = 'g'; m->count = count; break; }
+      case 'G': { 
+        m->row = (count ? count : tot_lines) > tot_lines ? tot_lines - 1 : (count ? count : tot_lines) - 1;
+        m->col = 0;
+        break;
+      }
+      case 'i': { m->insert = true; m->selecting = false; m->visual = 0; break; }
+      case 'I': { m->visual = 0; model_block_insert_start(m); break; }
+      case CTRL_KEY('v'): {
+        m->selecting = !m->selecting;
+        m->anchor_row = m->row;
+        m->anchor_disp_col = model_disp_col(m, m->row, m->col, NULL);
+        m->visual = 0;
+        break;
+      }
+      case ESC_CH: { m->selecting = false; m->visual = 0; break; }
+      case ':': case '/': { m->cmdline = true; m->cmd_kind = key; m->cmd_len = 0; m->visual = 0; break; }
+      case 'n': case 'N': { model_search(m, key == 'n', n); break; }
+      case 'd': case 'y': {
+        if (m->visual) {
+          model_visual_op(m, key);
+        } else {
+          m->prefix = key;
+          m->op_count = count;
+        }
+        break;
+      }
+      case 'p': { model_put(m, n); break; }
+      case 'v': case 'V': {
+        m->visual = m->visual == key ? 0 : key;
+        m->visual_row = m->row;
+        m->visual_col = m->col;
+        if (m->visual) m->selecting = false;
+        break;
+      }
+      default: { model_move(m, key, n); break; }
+    }
+    return;
+  }
+
+  if (m->mc_len) {
+    if (key == ESC_CH || key == '\n' || (key == DEL_CH && !m->typed)) {
+      m->mc_len = 0;
+    } else {
+      model_multi_apply(m, key);
+      return;
+    }
+  }
+
+  if (key == ESC_CH) {
+    m->insert = false;
+    return;
+  }
+
+  size_t offset = model_line_start(m, m->row) + m->col;
+
+  if (key == DEL_CH) {
+    if (offset == 0) return;
+    if (m->col == 0) {
+      m->row--;
+      m->col = model_line_len(m, m->row);
+    } else {
+      m->col--;
+    }
+    memmove(m->text + offset - 1, m->text + offset, m->len - offset);
+    m->len--;
+    return;
+  }
+
+  if (m->len + 1 > m->cap) {
+    m->cap = m->cap ? m->cap * 2 : 64;
+    m->text = realloc(m->text, m->cap);
+    assert_(m->text != NULL, "not enough memory");
+  }
+  memmove(m->text + offset + 1, m->text + offset, m->len - offset);
+  m->text[offset] = key;
+  m->len++;
+  if (key == '\n') {
+    m->row++;
+    m->col = 0;
+  } else {
+    m->col++;
+  }
+}
+
+
+
+// DESC: checks fred's text, cursor and lines-length against the model
+bool compare_to_model(FredEditor* fe, Model* m, Mismatch* mm)
+{
+  Cursor* cr = &fe->cursor;
+  if (cr->row != m->row || cr->col != m->col) {
+    snprintf(mm->msg, sizeof(mm->msg), "mismatched cursors: fred %zu:%zu, model %zu:%zu",
+             cr->row + 1, cr->col + 1, m->row + 1, m->col + 1);
+    return false;
+  }
+
+  PieceIter it = piece_iter_at(fe, 0);
+  PieceSpan span;
+  while ((span = piece_iter_span(&it)).len) {
+    if (it.offset + span.len > m->len || 0 != memcmp(span.text, m->text + it.offset, span.len)) {
+      snprintf(mm->msg, sizeof(mm->msg), "mismatched text in piece %zu (offset %zu)", it.piece_idx, it.offset);
+      return false;
+    }
+    piece_iter_skip(&it, span.len);
+  }
+  size_t offset = it.offset;
+  if (offset != m->len) {
+    snprintf(mm->msg, sizeof(mm->msg), "mismatched lengths: fred %zu, model %zu", offset, m->len);
+    return false;
+  }
+
+  // NOTE: seeking back from the end must land on the cursor's byte
+  size_t curs_offset = model_line_start(m, m->row) + m->col;
+  piece_iter_seek(&it, curs_offset);
+  char curs_char = curs_offset < m->len ? m->text[curs_offset] : 0;
+  if (it.offset != curs_offset || piece_iter_char(&it) != curs_char || FRED_char_at(fe, curs_offset) != curs_char) {
+    snprintf(mm->msg, sizeof(mm->msg), "piece iterator seek to offset %zu is off", curs_offset);
+    return false;
+  }
+
+  LinesLen* ll = &fe->lines_len;
+  size_t tot_lines = model_lines_count(m);
+  if (ll->len != tot_lines) {
+    snprintf(mm->msg, sizeof(mm->msg), "mismatched lines count: fred %zu, model %zu", ll->len, tot_lines);
+    return false;
+  }
+  for (size_t row = 0, start = 0; row < tot_lines; row++) {
+    size_t end = start;
+    while (end < m->len && m->text[end] != '\n') end++;
+    if (row >= fe->line_starts.len || LINE_START(&fe->line_starts, row) != start) {
+      snprintf(mm->msg, sizeof(mm->msg), "mismatched start of line %zu: fred %zu, model %zu",
+               row + 1, row < fe->line_starts.len ? LINE_START(&fe->line_starts, row) : 0, start);
+      return false;
+    }
+    size_t line_len = ll->items[row];
+    if (line_len != end - start) {
+      snprintf(mm->msg, sizeof(mm->msg), "mismatched length of line %zu: fred %zu, model %zu",
+               row + 1, line_len, end - start);
+      return false;
+    }
+    size_t line_width = 0;
+    for (size_t i = start; i < end; i++) {
+      if (m->text[i] == '\t') line_width += fe->tab_width - line_width % fe->tab_width;
+      else line_width++;
+    }
+    if (row >= fe->lines_width.len || LINE_WIDTH(fe->lines_width.items[row]) != line_width) {
+      snprintf(mm->msg, sizeof(mm->msg), "mismatched display width of line %zu: fred %zu, model %zu", row + 1,
+               row < fe->lines_width.len ? (size_t)LINE_WIDTH(fe->lines_width.items[row]) : 0, line_width);
+      return false;
+    }
+    if (row == m->row) {
+      size_t disp_col = 0;
+      for (size_t i = start; i < start + m->col; i++) {
+        if (m->text[i] == '\t') disp_col += fe->tab_width - disp_col % fe->tab_width;
+        else disp_col++;
+      }
+      size_t fred_disp_col = FRED_get_disp_col(fe, cr->row, cr->col);
+      if (fred_disp_col != disp_col) {
+        snprintf(mm->msg, sizeof(mm->msg), "mismatched display column: fred %zu, model %zu", 
+                 fred_disp_col, disp_col);
+        return false;
+      }
+    }
+    start = end + 1;
+  }
+  return true;
+}
+
+
+// DESC: checks the RowIndex prefix and find queries 
+// against the visual rows summed line by line
+bool compare_row_index(FredEditor* fe, TermWin* tw, Mismatch* mm)
+{
+  if (row_index_update(fe, tw)) {
+    snprintf(mm->msg, sizeof(mm->msg), "row_index_update() failed");
+    return false;
+  }
+  RowIndex* ri = &tw->row_index;
+  LinesWidth* lw = &fe->lines_width;
+  size_t row_w = tw->width - tw->linenum_width;
+  size_t vrows = 0;
+  for (size_t line = 0; line < lw->len; line++) {
+    size_t fred_vrows = row_index_prefix(ri, line);
+    if (fred_vrows != vrows) {
+      snprintf(mm->msg, sizeof(mm->msg), "mismatched visual rows before line %zu: fred %zu, expected %zu", 
+               line + 1, fred_vrows, vrows);
+      return false;
+    }
+    size_t line_rows = LINE_WIDTH(lw->items[line]) / row_w + 1;
+    for (size_t r = vrows; r < vrows + line_rows; r++) {
+      if (row_index_find(ri, r) != line) {
+        snprintf(mm->msg, sizeof(mm->msg), "visual row %zu not mapped to line %zu", r, line + 1);
+        return false;
+      }
+    }
+    vrows += line_rows;
+  }
+  return true;
+}
+
+
+// DESC: feeds 'keys' to both fred and the model, returns true
+// and fills 'mm' on the first divergence
+bool run_keys(const char* keys, size_t keys_count, Mismatch* mm)
+{
+  FredEditor fe = {0};
+  if (fred_editor_init(&fe, empty_file_path)) ERR("failed to initialize fred.");
+
+  // NOTE: narrow window so lines wrap often
+  TermWin tw = {0};
+  tw.linenum_width = 8;
+  tw.width = tw.linenum_width + 7;
+
+  Model m = {0};
+  bool running = true;
+  bool insert = false;
+  bool failed = false;
+
+  for (size_t i = 0; i < keys_count; i++) {
+    char key_str[2] = {keys[i], '\0'};
+    mm->step = i;
+    if (FRED_handle_input(&fe, &running, &insert, key_str, 1)) {
+      snprintf(mm->msg, sizeof(mm->msg), "FRED_handle_input() failed");
+      failed = true;
+      break;
+    }
+    if (i % 8 == 7) FRED_compact_pieces(&fe); // NOTE: like the editor does when idle
+    if (i % 16 == 15 && FRED_journal_flush(&fe)) {
+      snprintf(mm->msg, sizeof(mm->msg), "FRED_journal_flush() failed");
+      failed = true;
+      break;
+    }
+    model_apply(&m, keys[i]);
+    if (insert != m.insert || fe.cmdline.active != m.cmdline) {
+      snprintf(mm->msg, sizeof(mm->msg), "mismatched modes");
+      failed = true;
+      break;
+    }
+    if (!compare_to_model(&fe, &m, mm) || !compare_row_index(&fe, &tw, mm)) {
+      failed = true;
+      break;
+    }
+  }
+
+  // NOTE: as if fred crashed right after flushing the journal
+  if (!failed && !FRED_journal_flush(&fe) && !FRED_journal_wait(&fe)) {
+    FredEditor recovered = {0};
+    if (fred_editor_init(&recovered, empty_file_path)) ERR("failed to initialize fred from the journal.");
+    if (!compare_to_model(&recovered, &m, mm)) {
+      char msg[sizeof(mm->msg)];
+      snprintf(msg, sizeof(msg), "after recovering from the journal, %.200s", mm->msg);
+      memcpy(mm->msg, msg, sizeof(msg));
+      failed = true;
+    }
+    FRED_journal_close(&recovered, false);
+    fred_editor_free(&recovered);
+  } else if (!failed) {
+    snprintf(mm->msg, sizeof(mm->msg), "FRED_journal_flush() failed");
+    failed = true;
+  }
+
+  FRED_journal_close(&fe, true); // NOTE: else the next run would recover from it
+  fred_editor_free(&fe);
+  free(tw.row_index.items);
+  model_free(&m);
+  return failed;
+}
+
+
+// DESC: appends 'len' bytes of random lines to 'f': ascii, tabs and 
+// 2 to 4 bytes chars (some of them wide), now and then a line longer 
+// than 65535 bytes; no '\n' in the last 'tail' bytes
+void write_random_lines(FILE* f, size_t len, size_t tail)
+{
+  const char* chars[] = { "a", "b", "z", " ", " ", "\t", "\xc3\xa9", "\xe4\xb8\xad", "\xf0\x9f\x98\x80" };
+  size_t line_left = rand() % 200;
+  for (size_t i = 0; i < len; ) {
+    if (!line_left && i < len - tail) {
+      fputc('\n', f);
+      i++;
+      line_left = rand() % 64 ? rand() % 200 : 65536 + rand() % 8192;
+      continue;
+    }
+    const char* c = chars[rand() % (sizeof(chars) / sizeof(*chars))];
+    size_t c_len = strlen(c);
+    if (c_len > len - i) c = "x", c_len = 1;
+    fwrite(c, 1, c_len, f);
+    i += c_len;
+    line_left -= line_left > 0;
+  }
+}
+
+
+// DESC: puts a 4 bytes char (wide) over the 2 bytes before and after 
+// each offset in 'at' of the file, so it straddles whatever boundary 
+// a scan would put there
+void straddle_offsets(const char* path, const size_t* at, size_t at_len)
+{
+  FILE* f = fopen(path, "r+b");
+  if (f == NULL) ERR("failed to open '%s', %s.", path, strerror(errno));
+  struct stat sb;
+  if (fstat(fileno(f), &sb) == -1) ERR("failed to stat '%s', %s.", path, strerror(errno));
+  for (size_t i = 0; i < at_len; i++) {
+    if (at[i] < 2 || at[i] + 2 > (size_t)sb.st_size) continue;
+    fseek(f, at[i] - 2, SEEK_SET);
+    fwrite("\xf0\x9f\x98\x80", 1, 4, f);
+  }
+  fclose(f);
+}
+
+
+// DESC: checks the LinesLen, LinesWidth and LineStarts of 'fe' against 
+// the ones lines_scan_from() builds from the start of the same text; 
+// 'what' is how they got built, for the message
+bool compare_to_scan(FredEditor* fe, const char* what, Mismatch* mm)
+{
+  size_t lines = fe->lines_len.len;
+  uint32_t* ll = malloc(lines * sizeof(*ll) + 1);
+  uint32_t* lw = malloc(lines * sizeof(*lw) + 1);
+  size_t* ls = malloc(lines * sizeof(*ls) + 1);
+  assert_(ll != NULL && lw != NULL && ls != NULL, "not enough memory");
+  memcpy(ll, fe->lines_len.items, lines * sizeof(*ll));
+  memcpy(lw, fe->lines_width.items, lines * sizeof(*lw));
+  bool same = fe->lines_width.len == lines && fe->line_starts.len == lines;
+  for (size_t row = 0; same && row < lines; row++) ls[row] = LINE_START(&fe->line_starts, row);
+  if (lines_scan_from(fe, 0)) ERR("failed to scan the lines.");
+
+  if (!same || fe->lines_len.len != lines) {
+    snprintf(mm->msg, sizeof(mm->msg), "%s: %zu lines, a full scan has %zu", what, lines, fe->lines_len.len);
+    same = false;
+  }
+  for (size_t row = 0; same && row < lines; row++) {
+    if (ll[row] != fe->lines_len.items[row] || lw[row] != fe->lines_width.items[row] || ls[row] != fe->line_starts.items[row]) {
+      snprintf(mm->msg, sizeof(mm->msg), "%s: line %zu has start %zu, length %u, width %u; a full scan %zu, %u, %u", 
+               what, row + 1, ls[row], ll[row], lw[row], 
+               fe->line_starts.items[row], fe->lines_len.items[row], fe->lines_width.items[row]);
+      same = false;
+    }
+  }
+  free(ll);
+  free(lw);
+  free(ls);
+  return same;
+}
+
+
+// DESC: opens the big file read-only, with its lines-cache (read and 
+// written) if 'cached'; the lines scanned by 'threads' threads, or 
+// only the first ones if 'progressive'
+void open_big_file(FredEditor* fe, size_t threads, bool progressive, bool cached)
+{
+  *fe = (FredEditor){ 
+    .read_only = true, 
+    .lines_cache = cached ? LINES_CACHE_ON : LINES_CACHE_OFF, 
+    .index_threads = threads, 
+    .progressive = progressive,
+  };
+  if (fred_editor_init(fe, big_file_path)) ERR("failed to open '%s'.", big_file_path);
+}
+
+
+// DESC: indexes the rest of the file a few random steps at a time, 
+// then the rest either in steps or through the worker, like the 
+// editor loop does
+void index_big_file(FredEditor* fe)
+{
+  for (size_t steps = rand() % 4; steps > 0; steps--) {
+    if (FRED_index_step(fe, 1 + rand() % (3 << 20))) ERR("failed to index the lines.");
+  }
+  if (rand() % 2) {
+    if (FRED_index_until(fe, SIZE_MAX)) ERR("failed to index the lines.");
+    return;
+  }
+  FRED_index_start(fe);
+  while (!fe->index.done) {
+    if (!fe->index.worker_on) {
+      if (FRED_index_step(fe, LINES_INDEX_SLICE)) ERR("failed to index the lines.");
+      continue;
+    }
+    struct pollfd pfd = { .fd = fe->index.event_fd, .events = POLLIN };
+    if (poll(&pfd, 1, -1) == -1 && errno != EINTR) ERR("failed to wait for the worker, %s.", strerror(errno));
+    if (FRED_index_take(fe)) ERR("failed to take the lines of the worker.");
+  }
+}
+
+
+// DESC: builds the lines of a random big file the ways a load does 
+// and checks each against a plain full scan: split in chunks on a 
+// random number of threads, indexed progressively, and from the 
+// lines-cache of the file as it was and after it grew
+bool check_line_scans(Mismatch* mm)
+{
+  size_t threads = 2 + rand() % (LINES_MAX_THREADS - 1);
+  size_t size = LINES_PARALLEL_MIN_SIZE + rand() % (2 << 20);
+  size_t chunk_len = size / threads;
+  // NOTE: a tail with no '\n' past a few chunk boundaries, 
+  // a last line not ended by '\n', or a final '\n'
+  size_t tails[] = { chunk_len * (1 + rand() % 3) + rand() % chunk_len, 1 + rand() % 100, 0 };
+  size_t tail = tails[rand() % 3];
+  if (tail >= size) tail = size - 1;
+
+  FILE* f = fopen(big_file_path, "wb");
+  if (f == NULL) ERR("failed to create '%s', %s.", big_file_path, strerror(errno));
+  write_random_lines(f, size, tail);
+  fclose(f);
+  size_t at[LINES_MAX_THREADS];
+  for (size_t k = 0; k < threads - 1; k++) at[k] = (k + 1) * chunk_len;
+  at[threads - 1] = LINES_INDEX_FIRST; // NOTE: the end of the first screen's slice
+  straddle_offsets(big_file_path, at, threads);
+  // NOTE: the file may grow in the middle of a char, see below
+  bool split_char = tail && rand() % 2;
+  if (split_char) {
+    f = fopen(big_file_path, "r+b");
+    if (f == NULL) ERR("failed to open '%s', %s.", big_file_path, strerror(errno));
+    fseek(f, -2, SEEK_END);
+    fwrite("\xf0\x9f", 1, 2, f);
+    fclose(f);
+  }
+
+  FredEditor fe;
+  open_big_file(&fe, threads, false, false);
+  char what[64];
+  snprintf(what, sizeof(what), "scanned on %zu threads", threads);
+  bool same = compare_to_scan(&fe, what, mm);
+  fred_editor_free(&fe);
+  if (!same) return same;
+
+  open_big_file(&fe, threads, true, false);
+  index_big_file(&fe);
+  same = compare_to_scan(&fe, "indexed progressively", mm);
+  fred_editor_free(&fe);
+  if (!same) return same;
+
+  char* cache_path = sidecar_path(big_file_path, ".fred-lines");
+  assert_(cache_path != NULL, "not enough memory");
+  unlink(cache_path);
+  open_big_file(&fe, threads, false, true); // NOTE: writes the cache
+  fred_editor_free(&fe);
+  struct stat sb;
+  if (stat(cache_path, &sb) == -1) {
+    snprintf(mm->msg, sizeof(mm->msg), "no lines-cache written at '%s'", cache_path);
+    same = false;
+  }
+  if (same) {
+    open_big_file(&fe, threads, false, true);
+    same = compare_to_scan(&fe, "loaded from the lines-cache", mm);
+    fred_editor_free(&fe);
+  }
+  if (same) {
+    f = fopen(big_file_path, "ab");
+    if (f == NULL) ERR("failed to open '%s', %s.", big_file_path, strerror(errno));
+    if (split_char) fwrite("\x98\x80", 1, 2, f);
+    write_random_lines(f, 1 + rand() % (1 << 20), rand() % 2 ? 0 : rand() % 100);
+    fclose(f);
+    bool progressive = rand() % 2;
+    open_big_file(&fe, threads, progressive, true);
+    if (progressive) index_big_file(&fe);
+    same = compare_to_scan(&fe, progressive ? "indexed progressively from the lines-cache of the file before it grew" 
+                                            : "loaded from the lines-cache of the file before it grew", mm);
+    fred_editor_free(&fe);
+  }
+  unlink(cache_path);
+  free(cache_path);
+  return same;
+}
+
+
+// DESC: maps raw bytes into keys, the mapping depends on
+// the mode the keys so far would leave the editor in
+size_t bytes_to_keys(const uint8_t* data, size_t size, char* keys)
+{
+  bool insert = false;
+  bool cmdline = false;
+  char cmd_kind = 0;
+  size_t cmd_len = 0;
+  for (size_t i = 0; i < size; i++) {
+    uint8_t b = data[i];
+    char key = 0;
+    if (cmdline && cmd_kind == '/') { // NOTE: short patterns, so they match the typed text now and then
+      if      (b < 16) { key = ESC_CH; cmdline = false; }
+      else if (b < 96) { key = '\n'; cmdline = false; }
+      else if (b < 104) { key = DEL_CH; cmdline = cmd_len > 0; cmd_len -= cmd_len > 0; }
+      else             { key = SPACE_CH + b % 95; cmd_len++; }
+    } else if (cmdline && cmd_kind == '%') {
+      key = 's';
+      cmd_kind = 's';
+      cmd_len++;
+    } else if (cmdline && cmd_kind == 's') { // NOTE: ':s' with short patterns, like for '/'
+      const char sub_keys[] = "///g";
+      if      (b < 8)   { key = ESC_CH; cmdline = false; }
+      else if (b < 64)  { key = '\n'; cmdline = false; }
+      else if (b < 72)  { key = DEL_CH; cmdline = cmd_len > 0; cmd_len -= cmd_len > 0; }
+      else if (b < 136) { key = sub_keys[b % (sizeof(sub_keys) - 1)]; cmd_len++; }
+      else              { key = SPACE_CH + b % 95; cmd_len++; }
+    } else if (cmdline) { // NOTE: mostly ':N' commands
+      if      (b < 16) { key = ESC_CH; cmdline = false; }
+      else if (b < 48) { key = '\n'; cmdline = false; }
+      else if (b < 56) { key = DEL_CH; cmdline = cmd_len > 0; cmd_len -= cmd_len > 0; }
+      else if (b < 96 && !cmd_len) { key = b < 80 ? 's' : '%'; cmd_kind = key; cmd_len++; }
+      else             { key = '0' + b % 10; cmd_len++; }
+    } else if (!insert) {
+      const char normal_keys[] = "hhjjkklliiiiwbe0$Ggg25::/nN\x04\x15\x06\x02\x16\x16IIddyypvVd";
+      key = normal_keys[b % (sizeof(normal_keys) - 1)];
+      if (key == 'i' || key == 'I') insert = true;
+      if (key == ':' || key == '/') { cmdline = true; cmd_kind = key; cmd_len = 0; }
+    } else {
+      if      (b < 8)  { key = ESC_CH; insert = false; }
+      else if (b < 40) key = DEL_CH;
+      else if (b < 60) key = '\n';
+      else if (b < 68) key = '\t';
+      else             key = SPACE_CH + (b % 95);
+    }
+    keys[i] = key;
+  }
+  return size;
+}
+
+
+// DESC: the whole file at 'path', '*len' bytes
+char* read_whole_file(const char* path, size_t* len)
+{
+  FILE* f = fopen(path, "rb");
+  if (f == NULL) ERR("failed to open '%s', %s.", path, strerror(errno));
+  struct stat sb;
+  if (fstat(fileno(f), &sb) == -1) ERR("failed to stat '%s', %s.", path, strerror(errno));
+  char* text = malloc(sb.st_size + 1);
+  assert_(text != NULL, "not enough memory");
+  *len = fread(text, 1, sb.st_size, f);
+  if (*len != (size_t)sb.st_size) ERR("failed to read '%s'.", path);
+  fclose(f);
+  return text;
+}
+
+
+// DESC: writes to 'f' a copy of 'old' with a few runs of it deleted, 
+// replaced by random lines, or with random lines put before them
+void write_mutated(FILE* f, const char* old, size_t old_len)
+{
+  size_t at = 0;
+  for (size_t edits = 1 + rand() % 8; edits > 0; edits--) {
+    size_t next = at + rand() % ((old_len - at) / edits + 1);
+    fwrite(old + at, 1, next - at, f);
+    int kind = rand() % 3; // NOTE: 0 deletes, 1 replaces, 2 inserts
+    size_t cut = kind == 2 ? 0 : 1 + rand() % (rand() % 8 ? 64 : 4096);
+    if (cut > old_len - next) cut = old_len - next;
+    if (kind) write_random_lines(f, 1 + rand() % 128, rand() % 2 ? 0 : rand() % 16);
+    at = next + cut;
+  }
+  fwrite(old + at, 1, old_len - at, f);
+}
+
+
+// DESC: appends 'n' bytes to the text being built by model_reload()
+void model_reload_push(Model* m, const char* bytes, size_t n)
+{
+  while (m->len + n > m->cap) {
+    m->cap = m->cap ? 2 * m->cap : 4096;
+    m->text = realloc(m->text, m->cap);
+    assert_(m->text != NULL, "not enough memory");
+  }
+  memcpy(m->text + m->len, bytes, n);
+  m->len += n;
+}
+
+
+// DESC: the text a reload should leave in 'fe' (not reloaded yet), the 
+// file having gone from 'old_size' bytes to 'new', with 'diff' between 
+// them. Built run by run of the pieces, by the rules reload_pieces() 
+// follows: the typed bytes stay; the file's bytes go where 'diff' moves 
+// them; the bytes replacing a run of the file go where its first byte 
+// was, if it's in the text, or after the byte before them if they 
+// replace nothing. '*cursor', an offset in the text before, gets moved 
+// like reload_map_offset() does: a byte the reload changed goes to the 
+// start of the changes around it.
+void model_reload(FredEditor* fe, FileDiff* diff, size_t old_size, const char* new, size_t new_len, 
+                  Model* m, size_t* cursor)
+{
+  PieceTable* table = &fe->piece_table;
+  size_t old_offset = 0; // NOTE: in the text before the reload
+  size_t run = SIZE_MAX; // NOTE: where the changes around the last byte started, SIZE_MAX after a byte kept
+  size_t mapped = SIZE_MAX;
+#define MODEL_INSERTS_AT(at, k) do {                                                   \
+    for (size_t j = (k); j < diff->len && diff->items[j].old_offset == (at); j++) {     \
+      FileDiffOp* ins = &diff->items[j];                                                \
+      if (ins->equal || ins->old_len || !ins->new_len) continue;                        \
+      if (run == SIZE_MAX) run = m->len;                                                \
+      model_reload_push(m, new + ins->new_offset, ins->new_len);                        \
+    }                                                                                   \
+  } while (0)
+#define HAS_CURSOR(n) (*cursor >= old_offset && *cursor < old_offset + (n))
+
+  for (size_t i = 0; i < table->len; i++) {
+    Piece p = table->items[i];
+    if (p.which_buf) {
+      if (HAS_CURSOR(p.len)) mapped = m->len + (*cursor - old_offset);
+      model_reload_push(m, fe->add_buf.items + p.offset, p.len);
+      old_offset += p.len;
+      run = SIZE_MAX;
+      continue;
+    }
+    if (p.offset == 0) MODEL_INSERTS_AT(0, 0);
+    for (size_t x = p.offset; x < p.offset + p.len; ) {
+      size_t lo = 0, hi = diff->len; // NOTE: the op with byte 'x', the first one ending past it
+      while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (diff->items[mid].old_offset + diff->items[mid].old_len <= x) lo = mid + 1;
+        else hi = mid;
+      }
+      assert_(lo < diff->len, "no diff op has byte %zu of the file", x);
+      FileDiffOp* op = &diff->items[lo];
+      size_t op_end = op->old_offset + op->old_len;
+      size_t n = (op_end < p.offset + p.len ? op_end : p.offset + p.len) - x;
+      if (op->equal) {
+        if (HAS_CURSOR(n)) mapped = m->len + (*cursor - old_offset);
+        model_reload_push(m, new + op->new_offset + (x - op->old_offset), n);
+        run = SIZE_MAX;
+      } else {
+        if (run == SIZE_MAX) run = m->len;
+        if (HAS_CURSOR(n)) mapped = run;
+        if (x == op->old_offset) model_reload_push(m, new + op->new_offset, op->new_len);
+      }
+      x += n;
+      old_offset += n;
+      if (x == op_end) MODEL_INSERTS_AT(x, lo + 1);
+    }
+  }
+  if (!old_size && new_len) model_reload_push(m, new, new_len); // NOTE: like reload_pieces()
+  *cursor = mapped == SIZE_MAX ? m->len : mapped;
+#undef HAS_CURSOR
+#undef MODEL_INSERTS_AT
+}
+
+
+// DESC: sets 'm' to the cursor at 'row', 'col' of its text, moved back 
+// to the first byte of its char like snap_to_char_start() does
+void model_snap_cursor(Model* m, size_t row, size_t col)
+{
+  size_t start = model_line_start(m, row);
+  size_t c = col;
+  while (c > 0 && col - c < 3 && start + c < m->len && IS_UTF8_CONT(m->text[start + c])) c--;
+  if (start + c >= m->len || !IS_UTF8_CONT(m->text[start + c])) col = c;
+  m->row = row;
+  m->col = col;
+}
+
+
+// DESC: checks the text and the cursor of 'fe' against 'm' 
+// (the lines are checked by compare_to_scan())
+bool compare_to_text(FredEditor* fe, Model* m, const char* what, Mismatch* mm)
+{
+  Cursor* cr = &fe->cursor;
+  if (cr->row != m->row || cr->col != m->col) {
+    snprintf(mm->msg, sizeof(mm->msg), "%s: cursor at %zu:%zu, expected %zu:%zu",
+             what, cr->row + 1, cr->col + 1, m->row + 1, m->col + 1);
+    return false;
+  }
+  PieceIter it = piece_iter_at(fe, 0);
+  PieceSpan span;
+  while ((span = piece_iter_span(&it)).len) {
+    if (it.offset + span.len > m->len || 0 != memcmp(span.text, m->text + it.offset, span.len)) {
+      snprintf(mm->msg, sizeof(mm->msg), "%s: mismatched text in piece %zu (offset %zu)", what, it.piece_idx, it.offset);
+      return false;
+    }
+    piece_iter_skip(&it, span.len);
+  }
+  if (it.offset != m->len) {
+    snprintf(mm->msg, sizeof(mm->msg), "%s: %zu bytes of text, expected %zu", what, it.offset, m->len);
+    return false;
+  }
+  return true;
+}
+
+
+// DESC: feeds 'fe' up to 'max_keys' random keys
+void feed_random_keys(FredEditor* fe, size_t max_keys)
+{
+  size_t size = 1 + rand() % max_keys;
+  uint8_t* data = malloc(size);
+  char* keys = malloc(size);
+  assert_(data != NULL && keys != NULL, "not enough memory");
+  for (size_t i = 0; i < size; i++) data[i] = (uint8_t)(rand() & 0xff);
+  size_t keys_count = bytes_to_keys(data, size, keys);
+  bool running = true, insert = false;
+  for (size_t i = 0; i < keys_count; i++) {
+    char key_str[2] = {keys[i], '\0'};
+    if (FRED_handle_input(fe, &running, &insert, key_str, 1)) ERR("FRED_handle_input() failed.");
+  }
+  free(data);
+  free(keys);
+}
+
+
+// DESC: opens a random file, edits it with random keys, then another 
+// writer changes it (replacing it, or writing over it in place) and 
+// FRED_reload_check() merges that in. The text and the cursor get 
+// checked against model_reload() (or, for a mapped file written over 
+// in place, the whole new file if there were no edits and the text 
+// cut to it otherwise), the lines against a full scan.
+bool check_reload(Mismatch* mm)
+{
+  bool mapped = rand() % 8 == 0; // NOTE: big enough to get mapped, only then written over in place conflicts
+  size_t size = mapped ? FILE_MMAP_MIN_SIZE + rand() % 65536 : rand() % 4096;
+  FILE* f = fopen(reload_file_path, "wb");
+  if (f == NULL) ERR("failed to create '%s', %s.", reload_file_path, strerror(errno));
+  write_random_lines(f, size, rand() % 2 ? 0 : rand() % 100);
+  fclose(f);
+  size_t old_size;
+  char* old = read_whole_file(reload_file_path, &old_size);
+  struct stat sb;
+  if (stat(reload_file_path, &sb) == -1) ERR("failed to stat '%s', %s.", reload_file_path, strerror(errno));
+
+  FredEditor fe = { .lines_cache = LINES_CACHE_OFF };
+  if (fred_editor_init(&fe, reload_file_path)) ERR("failed to open '%s'.", reload_file_path);
+  feed_random_keys(&fe, 200);
+  bool edited = !text_is_file(&fe);
+  size_t row = fe.cursor.row, col = fe.cursor.col;
+  size_t cursor = get_line_offset(&fe, row) + col;
+
+  // NOTE: a new file renamed over it, or the same one written over
+  bool in_place = rand() % 2;
+  char new_path[PATH_MAX];
+  snprintf(new_path, sizeof(new_path), "%s.new", reload_file_path);
+  f = fopen(new_path, "wb");
+  if (f == NULL) ERR("failed to create '%s', %s.", new_path, strerror(errno));
+  write_mutated(f, old, old_size);
+  fclose(f);
+  size_t new_len;
+  char* new = read_whole_file(new_path, &new_len);
+  if (in_place) {
+    f = fopen(reload_file_path, "r+b");
+    if (f == NULL || ftruncate(fileno(f), 0) == -1) ERR("failed to write over '%s', %s.", reload_file_path, strerror(errno));
+    if (fwrite(new, 1, new_len, f) != new_len) ERR("failed to write over '%s'.", reload_file_path);
+    fclose(f);
+    unlink(new_path);
+  } else if (rename(new_path, reload_file_path) == -1) {
+    ERR("failed to rename '%s', %s.", new_path, strerror(errno));
+  }
+  // NOTE: a later mtime, in case the writes fell in the same tick
+  struct timespec times[2] = { { .tv_nsec = UTIME_OMIT }, { .tv_sec = sb.st_mtim.tv_sec + 1 } };
+  if (utimensat(AT_FDCWD, reload_file_path, times, 0) == -1) ERR("failed to touch '%s', %s.", reload_file_path, strerror(errno));
+
+  Model m = {0};
+  bool conflict = in_place && mapped && edited;
+  char what[64];
+  snprintf(what, sizeof(what), "reloaded %s%s%s", in_place ? "in place" : "renamed over", 
+           mapped ? ", mapped" : "", edited ? ", with edits" : "");
+  if (in_place && mapped && !edited) {
+    model_reload_push(&m, new, new_len);
+    cursor = cursor < new_len ? cursor : new_len;
+  } else if (conflict) {
+    // NOTE: the file pieces show the new bytes, the ones past the end are cut
+    size_t kept = old_size < new_len ? old_size : new_len;
+    PieceTable* table = &fe.piece_table;
+    for (size_t i = 0; i < table->len; i++) {
+      Piece p = table->items[i];
+      if (p.which_buf) model_reload_push(&m, fe.add_buf.items + p.offset, p.len);
+      else if (p.offset < kept) model_reload_push(&m, new + p.offset, (p.offset + p.len < kept ? p.offset + p.len : kept) - p.offset);
+    }
+  } else {
+    FileDiff diff = {0};
+    if (file_diff(&diff, old, old_size, new, new_len)) ERR("failed to diff the file.");
+    model_reload(&fe, &diff, old_size, new, new_len, &m, &cursor);
+    free(diff.items);
+  }
+  if (conflict) {
+    size_t lines = model_lines_count(&m);
+    row = row < lines ? row : lines - 1;
+    size_t line_len = model_line_len(&m, row);
+    model_snap_cursor(&m, row, col < line_len ? col : line_len);
+  } else {
+    size_t start = 0;
+    row = 0;
+    for (size_t i = 0; i < cursor; i++) {
+      if (m.text[i] == '\n') row++, start = i + 1;
+    }
+    model_snap_cursor(&m, row, cursor - start);
+  }
+
+  bool same = !FRED_reload_check(&fe, reload_file_path);
+  if (!same) snprintf(mm->msg, sizeof(mm->msg), "%s: FRED_reload_check() failed", what);
+  if (same && fe.reload.conflict != conflict) {
+    snprintf(mm->msg, sizeof(mm->msg), "%s: %s conflict", what, conflict ? "no" : "a");
+    same = false;
+  }
+  same = same && compare_to_text(&fe, &m, what, mm) && compare_to_scan(&fe, what, mm);
+  if (same) {
+    feed_random_keys(&fe, 200); // NOTE: nothing of the text before may be left around
+    snprintf(what, sizeof(what), "edited after a reload");
+    same = compare_to_scan(&fe, what, mm);
+  }
+
+  FRED_journal_close(&fe, true);
+  fred_editor_free(&fe);
+  model_free(&m);
+  free(old);
+  free(new);
+  return same;
+}
+
+
+// DESC: shrinks the failing keys by removing chunks of
+// decreasing size as long as the case keeps failing
+size_t shrink_keys(char* keys, size_t keys_count)
+{
+  Mismatch mm = {0};
+  char* candidate = malloc(keys_count ? keys_count : 1);
+  assert_(candidate != NULL, "not enough memory");
+
+  run_keys(keys, keys_count, &mm);
+  keys_count = mm.step + 1; // NOTE: keys after the divergence are useless
+
+  for (size_t chunk = keys_count / 2; chunk > 0; chunk /= 2) {
+    size_t start = 0;
+    while (start < keys_count) {
+      size_t n = chunk < keys_count - start ? chunk : keys_count - start;
+      memcpy(candidate, keys, start);
+      memcpy(candidate + start, keys + start + n, keys_count - start - n);
+      if (run_keys(candidate, keys_count - n, &mm)) {
+        keys_count = mm.step + 1;
+        memcpy(keys, candidate, keys_count);
+      } else {
+        start += n;
+      }
+    }
+  }
+
+  free(candidate);
+  return keys_count;
+}
+
+
+void write_key_readable(FILE* f, char key)
+{
+  switch (key) {
+    case DEL_CH: { fprintf(f, "BACKSPACE"); break; }
+    case ESC_CH: { fprintf(f, "ESC"); break; }
+    case '\n':   { fprintf(f, "NEWLINE"); break; }
+    case '\t':   { fprintf(f, "TAB"); break; }
+    case CTRL_KEY('d'): case CTRL_KEY('u'): case CTRL_KEY('f'): case CTRL_KEY('b'): case CTRL_KEY('v'): {
+      fprintf(f, "CTRL-%c", key + 'A' - 1);
+      break;
+    }
+    default:     { fprintf(f, "%c", key); break; }
+  }
+}
+
+
+FILE* open_test_file(const char* dir, const char* name)
+{
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE* f = fopen(path, "w");
+  if (f == NULL) ERR("failed to create '%s', %s.", path, strerror(errno));
+  return f;
+}
+
+
+// DESC: writes a 'fred_test' folder with the same layout
+// 'gen_test_with_neovim.lua' generates, using the model's
+// text as the expected snapshots
+void emit_test(const char* dir, const char* keys, size_t keys_count, unsigned int seed)
+{
+  if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+    ERR("failed to create folder '%s', %s.", dir, strerror(errno));
+  }
+
+  fclose(open_test_file(dir, "fred_output.txt"));
+
+  FILE* keys_file = open_test_file(dir, "keys.txt");
+  FILE* readable_file = open_test_file(dir, "keys_readable.txt");
+  FILE* snaps_file = open_test_file(dir, "snaps.txt");
+
+  Model m = {0};
+  size_t snap_num = 0;
+  for (size_t i = 0; i < keys_count; i++) {
+    char key = keys[i];
+    fprintf(keys_file, "%d\n", key);
+    write_key_readable(readable_file, key);
+    fprintf(readable_file, "\n");
+
+    bool was_insert = m.insert;
+    size_t prev_row = m.row, prev_col = m.col;
+    model_apply(&m, key);
+
+    if (was_insert && m.insert) {
+      fprintf(snaps_file, "\n[snapshot: %zu, inserted: \"", ++snap_num);
+      if (key == '"' || key == '\\') fprintf(snaps_file, "\\");
+      write_key_readable(snaps_file, key);
+      fprintf(snaps_file, "\", %zu:%zu]\n", prev_row + 1, prev_col + 1);
+      fwrite(m.text, 1, m.len, snaps_file);
+    }
+  }
+
+  FILE* output_file = open_test_file(dir, "output.txt");
+  fwrite(m.text, 1, m.len, output_file);
+  fclose(output_file);
+
+  FILE* seed_file = open_test_file(dir, "seed.txt");
+  fprintf(seed_file, "{\n  generator = \"fuzz.c\",\n  seed = %u,\n  keys = %zu\n}", seed, keys_count);
+  fclose(seed_file);
+
+  fclose(keys_file);
+  fclose(readable_file);
+  fclose(snaps_file);
+  model_free(&m);
+}
+
+
+
+void make_empty_file(void)
+{
+  int fd = mkstemp(empty_file_path);
+  if (fd == -1) ERR("failed to create temporary file, %s.", strerror(errno));
+  close(fd);
+}
+
+
+
+#ifdef FRED_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+  static bool initialized = false;
+  if (!initialized) {
+    make_empty_file();
+    initialized = true;
+  }
+
+  char* keys = malloc(size ? size : 1);
+  assert_(keys != NULL, "not enough memory");
+  size_t keys_count = bytes_to_keys(data, size, keys);
+
+  Mismatch mm = {0};
+  if (run_keys(keys, keys_count, &mm)) {
+    fprintf(stderr, "MISMATCH at key %zu: %s\n", mm.step + 1, mm.msg);
+    abort();
+  }
+  free(keys);
+  return 0;
+}
+
+#else
+
+void usage(const char* program)
+{
+  fprintf(stderr, "usage: %s [-s <seed>] [-n <iterations>] [-k <max-keys>] [-o <out-folder>]\n", program);
+  fprintf(stderr, "  -s: seed of the first iteration, the i-th one uses seed + i (default: time)\n");
+  fprintf(stderr, "  -n: iterations (default: %d)\n", DEFAULT_ITERATIONS);
+  fprintf(stderr, "  -k: max keys fed per iteration (default: %d)\n", DEFAULT_MAX_KEYS);
+  fprintf(stderr, "  -o: where to emit the failing case (default: ./tests/fred_test_fuzz_<seed>)\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+  unsigned int seed = (unsigned int)time(NULL);
+  size_t iterations = DEFAULT_ITERATIONS;
+  size_t max_keys = DEFAULT_MAX_KEYS;
+  const char* out_dir = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      ERR("missing value for '%s'.", argv[i]);
+    }
+    if      (0 == strcmp(argv[i], "-s")) seed = strtoul(argv[++i], NULL, 10);
+    else if (0 == strcmp(argv[i], "-n")) iterations = strtoul(argv[++i], NULL, 10);
+    else if (0 == strcmp(argv[i], "-k")) max_keys = strtoul(argv[++i], NULL, 10);
+    else if (0 == strcmp(argv[i], "-o")) out_dir = argv[++i];
+    else {
+      usage(argv[0]);
+      ERR("unknown argument '%s'.", argv[i]);
+    }
+  }
+  if (max_keys == 0) max_keys = 1;
+
+  make_empty_file();
+  int big_fd = mkstemp(big_file_path);
+  if (big_fd == -1) ERR("failed to create temporary file, %s.", strerror(errno));
+  close(big_fd);
+  int reload_fd = mkstemp(reload_file_path);
+  if (reload_fd == -1) ERR("failed to create temporary file, %s.", strerror(errno));
+  close(reload_fd);
+
+  uint8_t* data = malloc(max_keys);
+  char* keys = malloc(max_keys);
+  assert_(data != NULL && keys != NULL, "not enough memory");
+
+  for (size_t iter = 0; iter < iterations; iter++) {
+    unsigned int iter_seed = seed + (unsigned int)iter;
+    srand(iter_seed);
+    size_t size = 1 + rand() % max_keys;
+    for (size_t i = 0; i < size; i++) data[i] = (uint8_t)(rand() & 0xff);
+
+    Mismatch mm = {0};
+    if (iter % SCAN_CHECK_EVERY == 0 && !check_line_scans(&mm)) {
+      fprintf(stderr, "\033[48:5:196mFUZZ FAILED\033[0m: seed %u, big file '%s': %s\n", iter_seed, big_file_path, mm.msg);
+      unlink(empty_file_path);
+      return 1;
+    }
+    if (iter % RELOAD_CHECK_EVERY == 0 && !check_reload(&mm)) {
+      fprintf(stderr, "\033[48:5:196mFUZZ FAILED\033[0m: seed %u, file '%s': %s\n", iter_seed, reload_file_path, mm.msg);
+      unlink(empty_file_path);
+      return 1;
+    }
+
+    size_t keys_count = bytes_to_keys(data, size, keys);
+    if (!run_keys(keys, keys_count, &mm)) continue;
+
+    fprintf(stderr, "\033[48:5:196mFUZZ FAILED\033[0m: seed %u, key %zu: %s\n", iter_seed, mm.step + 1, mm.msg);
+    keys_count = shrink_keys(keys, keys_count);
+    run_keys(keys, keys_count, &mm);
+    fprintf(stderr, "shrunk to %zu keys: %s\n", keys_count, mm.msg);
+
+    char default_dir[PATH_MAX];
+    if (out_dir == NULL) {
+      snprintf(default_dir, sizeof(default_dir), "./tests/fred_test_fuzz_%u", iter_seed);
+      out_dir = default_dir;
+    }
+    emit_test(out_dir, keys, keys_count, iter_seed);
+    fprintf(stderr, "failing case written to '%s'\n", out_dir);
+
+    unlink(empty_file_path);
+    unlink(big_file_path);
+    unlink(reload_file_path);
+    return 1;
+  }
+
+  printf("\033[48:5:48mFUZZ PASSED\033[0m: %zu iterations, seeds %u..%u\n",
+         iterations, seed, seed + (unsigned int)iterations - 1);
+  unlink(empty_file_path);
+  unlink(big_file_path);
+  unlink(reload_file_path);
+  free(data);
+  free(keys);
+  return 0;
+}
+
+#endif
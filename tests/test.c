@@ -6,6 +6,11 @@
 #include <sys/stat.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
 
 #include "./../src/fred.h"
 
@@ -23,6 +28,7 @@ File snaps_file = {0};
 size_t snaps_count = 0;
 size_t* snaps_offsets = NULL; 
 size_t* curs_coords = NULL; // FIXME: no need for it to be size_t
+bool fast_mode = false; // NOTE: compare only the last snapshot
 
 
 
@@ -104,6 +110,29 @@ File read_file(const char* filename)
 }
 
 
+// DESC: maps the file read-only instead of copying it; snaps.txt 
+// of the big tests is several MBs and is only ever read. 
+// NOTE: the text is NOT null-terminated
+File map_file(const char* filename)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) ERR("could not open file '%s', %s.", filename, strerror(errno));
+
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) ERR("could not retrieve info about file '%s', %s.", filename, strerror(errno));
+
+  File f = {.txt = NULL, .size = sb.st_size};
+  if (f.size > 0) {
+    void* addr = mmap(NULL, f.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) ERR("could not map file '%s', %s.", filename, strerror(errno));
+    madvise(addr, f.size, MADV_SEQUENTIAL);
+    f.txt = addr;
+  }
+  close(fd);
+  return f;
+}
+
+
 // DESC: convert content of keys.txt from ascii-int to chars and 
 // save it in a buffer
 char* get_keys(const char* file_name) 
@@ -173,14 +202,14 @@ size_t get_cursor_coords(size_t end_label_idx, size_t curs_coords_idx)
 // They can be easily accessed with the currently tested 'snap_num'
 void parse_snaps()
 {
-#define matches_label(ch) ((ch) == '\n' && 0 == strncmp(&(ch), label, label_len))
+#define matches_label(ch) ((ch) == '\n' && i + label_len <= snaps_file.size && 0 == memcmp(&(ch), label, label_len))
 
   const char* label = "\n[snapshot: ";
   const size_t label_len = strlen(label);
   
-  for (int i = snaps_file.size; i >= 0 ; i--){
+  for (size_t i = snaps_file.size; i-- > 0;){
     if (matches_label(snaps_file.txt[i])){
-      char* count_str = &snaps_file.txt[(size_t)i + label_len];
+      char* count_str = &snaps_file.txt[i + label_len];
       snaps_count = (size_t)strtol(count_str, NULL, 10);
       break;
     }
@@ -219,7 +248,7 @@ void parse_snaps()
 
 
 
-char* build_fred_output(PieceTable* table, FileBuf* fb, AddBuf* ab, size_t output_len)
+char* build_fred_output(FredEditor* fe, size_t output_len)
 {
   char* output_buf = malloc((output_len ? output_len : 1) * sizeof(*output_buf));
   assert_(output_buf != NULL, "not enough memory");
@@ -229,12 +258,11 @@ char* build_fred_output(PieceTable* table, FileBuf* fb, AddBuf* ab, size_t outpu
     // NOTE: not returning a string literal cause 
     // we would need an extra check when freeing it
   } else {
-    size_t offset = 0;
-    for (size_t i = 0; i < table->len; i++) {
-      Piece* p = &table->items[i];
-      char* buf = !p->which_buf ? fb->text : ab->items;
-      strncpy(output_buf + offset, buf + p->offset, p->len);
-      offset += p->len;
+    PieceIter it = piece_iter_at(fe, 0);
+    PieceSpan span;
+    while ((span = piece_iter_span(&it)).len) {
+      memcpy(output_buf + it.offset, span.text, span.len);
+      piece_iter_skip(&it, span.len);
     }
   }
   return output_buf;
@@ -243,6 +271,22 @@ char* build_fred_output(PieceTable* table, FileBuf* fb, AddBuf* ab, size_t outpu
 
 
 
+// DESC: compares the piece-table's text against 'snap' one piece 
+// at a time, so the full text only needs to be built on failure.
+// The snapshot's length must already match the text's length.
+bool table_matches_snap(FredEditor* fe, const char* snap)
+{
+  PieceIter it = piece_iter_at(fe, 0);
+  PieceSpan span;
+  while ((span = piece_iter_span(&it)).len) {
+    if (0 != memcmp(span.text, snap + it.offset, span.len)) return false;
+    piece_iter_skip(&it, span.len);
+  }
+  return true;
+}
+
+
+
 // DESC: print info and highlight differences between 
 // fred's output and given snapshot
 void test_failure(FredEditor* fe, size_t key_num, char* key, size_t snap_num,
@@ -366,40 +410,35 @@ void compare_to_snap(FredEditor* fe, size_t key_num, char* key_str, size_t snap_
   Cursor* cr = &fe->cursor; 
 
   if (snap_row != (cr->prev_row + 1) || snap_col != (cr->prev_col + 1)) {
-    char* fred_output = build_fred_output(&fe->piece_table, &fe->file_buf, &fe->add_buf, fred_output_len);
+    char* fred_output = build_fred_output(fe, fred_output_len);
     char* msg = "Mismatched cursors: edit happened in different places";
     test_failure(fe, key_num, key_str, snap_num, fred_output, fred_output_len, snap, snap_len, msg);
   }
 
   if (snap_len != fred_output_len) {
-    char* fred_output = build_fred_output(&fe->piece_table, &fe->file_buf, &fe->add_buf, fred_output_len);
+    char* fred_output = build_fred_output(fe, fred_output_len);
     char* msg = "Mismatched lengths";
     test_failure(fe, key_num, key_str, snap_num, fred_output, fred_output_len, snap, snap_len, msg);
   }
 
   if (snap_len == 0) return;
 
-  char* fred_output = build_fred_output(&fe->piece_table, &fe->file_buf, &fe->add_buf, fred_output_len);
-  if (0 != strncmp(fred_output, snap, snap_len)) {
+  if (!table_matches_snap(fe, snap)) {
+    char* fred_output = build_fred_output(fe, fred_output_len);
     char* msg = "Mismatched characters";
     test_failure(fe, key_num, key_str, snap_num, fred_output, fred_output_len, snap, snap_len, msg);
   }
-
-  free(fred_output);
 }
 
 
 
 
-int main(int argc, char* argv[])
+// DESC: runs the fred_test at 'test_dir_path'. Any failure 
+// exits the process, so in '--all' mode this is always 
+// called inside a forked worker.
+void run_test(void)
 {
-  if (argc > 2) ERR("momentarily handling one test-folder at a time.");
-  else if (argc < 2) ERR("please provide a test-folder path."); 
-
-  test_dir_path = argv[1];
-
   char* fred_output_path = make_path("fred_output.txt");
-  char* output_path = make_path("output.txt");
   char* keys_path = make_path("keys.txt");
   char* snaps_path = make_path("snaps.txt");
 
@@ -407,7 +446,7 @@ int main(int argc, char* argv[])
   if (fred_editor_init(&fe, fred_output_path)) exit(1);
 
   keys = get_keys(keys_path);
-  snaps_file = read_file(snaps_path);
+  snaps_file = map_file(snaps_path);
   parse_snaps();
 
   bool _running = true; // NOTE: dummy flag, the tests never generate 'q' for quitting
@@ -422,13 +461,314 @@ int main(int argc, char* argv[])
     }
 
     if (!just_entered_insert_mode && insert_mode){
-      compare_to_snap(&fe, i + 1, key_str, snap_num);
+      if (!fast_mode || snap_num + 1 == snaps_count) {
+        compare_to_snap(&fe, i + 1, key_str, snap_num);
+      }
       snap_num++;
     }
   }
   // TODO: time spent, snaps compared 
   printf("\033[48:5:48mTEST PASSED\033[0m\n");
 
-  return 0;
+  fred_editor_free(&fe);
+  if (snaps_file.txt != NULL) munmap(snaps_file.txt, snaps_file.size);
+  free(fred_output_path);
+  free(keys_path);
+  free(snaps_path);
+}
+
+
+
+typedef enum {
+  TEST_PASSED,
+  TEST_FAILED,
+  TEST_SKIPPED,
+} TestStatus;
+
+typedef struct {
+  char* dir_path;
+  pid_t pid;
+  FILE* output; // NOTE: the worker's stdout and stderr 
+  double start;
+  double wall_time;
+  TestStatus status;
+} TestJob;
+
+
+double now_secs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+// DESC: sorts 'fred_test_2' before 'fred_test_10'
+int cmp_test_names(const void* a, const void* b)
+{
+  const char* name_a = *(const char**)a;
+  const char* name_b = *(const char**)b;
+  size_t n = strcspn(name_a, "0123456789");
+  size_t m = strcspn(name_b, "0123456789");
+  if (n == m && 0 == strncmp(name_a, name_b, n) && name_a[n] && name_b[m]) {
+    long num_a = strtol(name_a + n, NULL, 10);
+    long num_b = strtol(name_b + m, NULL, 10);
+    if (num_a != num_b) return num_a < num_b ? -1 : 1;
+  }
+  return strcmp(name_a, name_b);
 }
 
+
+// DESC: collects every 'fred_test*' folder inside 'tests_dir'
+char** find_test_dirs(const char* tests_dir, size_t* count)
+{
+  DIR* dir = opendir(tests_dir);
+  if (dir == NULL) ERR("failed to open tests-folder '%s', %s.", tests_dir, strerror(errno));
+
+  size_t cap = 16;
+  char** dirs = malloc(cap * sizeof(*dirs));
+  assert_(dirs != NULL, "not enough memory");
+  *count = 0;
+
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (0 != strncmp(entry->d_name, "fred_test", strlen("fred_test"))) continue;
+
+    size_t len = strlen(tests_dir) + strlen(entry->d_name) + 2;
+    char* path = malloc(len * sizeof(*path));
+    assert_(path != NULL, "not enough memory");
+    snprintf(path, len, "%s/%s", tests_dir, entry->d_name);
+
+    struct stat sb;
+    if (stat(path, &sb) == -1 || (sb.st_mode & S_IFMT) != S_IFDIR) {
+      free(path);
+      continue;
+    }
+
+    if (*count == cap) {
+      cap *= 2;
+      void* temp = realloc(dirs, cap * sizeof(*dirs));
+      assert_(temp != NULL, "not enough memory");
+      dirs = temp;
+    }
+    dirs[(*count)++] = path;
+  }
+  closedir(dir);
+
+  qsort(dirs, *count, sizeof(*dirs), cmp_test_names);
+  return dirs;
+}
+
+
+// DESC: returns the name of the first test-file missing 
+// from 'dir_path', NULL if the folder is complete
+const char* missing_test_file(const char* dir_path)
+{
+  const char* needed[] = {"fred_output.txt", "keys.txt", "snaps.txt"};
+  for (size_t i = 0; i < sizeof(needed) / sizeof(*needed); i++) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir_path, needed[i]);
+    struct stat sb;
+    if (stat(path, &sb) == -1 || (sb.st_mode & S_IFMT) != S_IFREG) return needed[i];
+  }
+  return NULL;
+}
+
+
+// DESC: appends the worker's output of a failed test to the 
+// log-file, which gets created on the first failure
+void log_failure(FILE** log, const char* log_path, TestJob* job)
+{
+  if (*log == NULL) {
+    *log = fopen(log_path, "w");
+    if (*log == NULL) ERR("failed to create log-file '%s', %s.", log_path, strerror(errno));
+  }
+
+  time_t t = time(NULL);
+  char stamp[32];
+  strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&t));
+  fprintf(*log, "================================================\n");
+  fprintf(*log, "[%s] %s (%.3fs)\n", stamp, job->dir_path, job->wall_time);
+  fprintf(*log, "================================================\n");
+
+  char chunk[4096];
+  size_t n = 0;
+  rewind(job->output);
+  while ((n = fread(chunk, 1, sizeof(chunk), job->output)) > 0) {
+    fwrite(chunk, 1, n, *log);
+  }
+  fprintf(*log, "\n");
+}
+
+
+// DESC: runs every fred_test found in 'tests_dir', each one in its 
+// own forked worker (so every test gets its own FredEditor and 
+// globals), at most 'max_workers' at a time. Failures don't stop 
+// the other tests: their output is collected into a timestamped 
+// log-file and a summary with the wall time of each test is printed.
+int run_all_tests(const char* tests_dir, size_t max_workers)
+{
+  size_t jobs_count = 0;
+  char** dirs = find_test_dirs(tests_dir, &jobs_count);
+  if (jobs_count == 0) ERR("no 'fred_test' folders found in '%s'.", tests_dir);
+
+  TestJob* jobs = calloc(jobs_count, sizeof(*jobs));
+  assert_(jobs != NULL, "not enough memory");
+
+  char log_path[PATH_MAX];
+  {
+    time_t t = time(NULL);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d_%H-%M-%S", localtime(&t));
+    snprintf(log_path, sizeof(log_path), "%s/test_log_%s.txt", tests_dir, stamp);
+  }
+  FILE* log = NULL;
+
+  double all_start = now_secs();
+  size_t next_job = 0, running = 0, done = 0;
+
+  while (done < jobs_count) {
+    while (running < max_workers && next_job < jobs_count) {
+      TestJob* job = &jobs[next_job++];
+      job->dir_path = dirs[next_job - 1];
+
+      if (missing_test_file(job->dir_path) != NULL) {
+        job->status = TEST_SKIPPED;
+        done++;
+        continue;
+      }
+
+      job->output = tmpfile();
+      if (job->output == NULL) ERR("failed to create temporary file, %s.", strerror(errno));
+      fflush(stdout);
+      fflush(stderr);
+
+      job->start = now_secs();
+      job->pid = fork();
+      if (job->pid == -1) ERR("failed to fork test-worker, %s.", strerror(errno));
+
+      if (job->pid == 0) {
+        int fd = fileno(job->output);
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        test_dir_path = job->dir_path;
+        run_test();
+        fflush(stdout);
+        _exit(0);
+      }
+      running++;
+    }
+
+    if (running == 0) continue;
+
+    int wstatus = 0;
+    pid_t pid = wait(&wstatus);
+    if (pid == -1) {
+      if (errno == EINTR) continue;
+      ERR("failed to wait for test-workers, %s.", strerror(errno));
+    }
+
+    for (size_t i = 0; i < next_job; i++) {
+      TestJob* job = &jobs[i];
+      if (job->pid != pid) continue;
+      job->wall_time = now_secs() - job->start;
+      bool passed = WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0;
+      job->status = passed ? TEST_PASSED : TEST_FAILED;
+      if (!passed) log_failure(&log, log_path, job);
+      fclose(job->output);
+      job->output = NULL;
+      break;
+    }
+    running--;
+    done++;
+  }
+
+  size_t passed = 0, failed = 0, skipped = 0;
+  for (size_t i = 0; i < jobs_count; i++) {
+    TestJob* job = &jobs[i];
+    switch (job->status) {
+      case TEST_PASSED: {
+        passed++;
+        printf("\033[38:5:48mPASSED \033[0m %-40s %8.3fs\n", job->dir_path, job->wall_time);
+        break;
+      }
+      case TEST_FAILED: {
+        failed++;
+        printf("\033[38:5:196mFAILED \033[0m %-40s %8.3fs\n", job->dir_path, job->wall_time);
+        break;
+      }
+      case TEST_SKIPPED: {
+        skipped++;
+        printf("\033[38:5:220mSKIPPED\033[0m %-40s (missing '%s')\n", 
+               job->dir_path, missing_test_file(job->dir_path));
+        break;
+      }
+    }
+  }
+
+  printf("\n%zu passed, %zu failed, %zu skipped in %.3fs (%zu workers)\n", 
+         passed, failed, skipped, now_secs() - all_start, max_workers);
+  if (log != NULL) {
+    fclose(log);
+    printf("failures logged in '%s'\n", log_path);
+  }
+
+  if (failed) printf("\033[48:5:196mTESTS FAILED\033[0m\n");
+  else printf("\033[48:5:48mALL TESTS PASSED\033[0m\n");
+
+  for (size_t i = 0; i < jobs_count; i++) free(dirs[i]);
+  free(dirs);
+  free(jobs);
+  return failed ? 1 : 0;
+}
+
+
+
+void usage(const char* program)
+{
+  fprintf(stderr, "usage: %s [--fast] <test-folder>\n", program);
+  fprintf(stderr, "       %s --all [--fast] [tests-folder] [-j <workers>]\n", program);
+  fprintf(stderr, "  --fast: feed all the keys and compare only the last snapshot\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+  // NOTE: '--fast' can go anywhere, the other args are positional 
+  for (int i = 1; i < argc; i++) {
+    if (0 == strcmp(argv[i], "--fast")) {
+      fast_mode = true;
+      memmove(&argv[i], &argv[i + 1], (argc - i) * sizeof(*argv));
+      argc--;
+      i--;
+    }
+  }
+
+  if (argc < 2) {
+    usage(argv[0]);
+    ERR("please provide a test-folder path."); 
+  }
+
+  if (0 == strcmp(argv[1], "--all")) {
+    const char* tests_dir = "./tests";
+    long max_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 2; i < argc; i++) {
+      if (0 == strcmp(argv[i], "-j") && i + 1 < argc) {
+        max_workers = strtol(argv[++i], NULL, 10);
+      } else {
+        tests_dir = argv[i];
+      }
+    }
+    if (max_workers < 1) max_workers = 1;
+    return run_all_tests(tests_dir, (size_t)max_workers);
+  }
+
+  if (argc > 2) {
+    usage(argv[0]);
+    ERR("pass '--all' to run more than one test-folder.");
+  }
+
+  test_dir_path = argv[1];
+  run_test();
+  return 0;
+}